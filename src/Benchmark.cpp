@@ -0,0 +1,266 @@
+#include "Benchmark.h"
+#include "FileFormat.h"
+#include "MappedFile.h"
+#include "Timing.h"
+#include "delta.h"
+#include "exe_filter.h"
+#include "rle.h"
+#include "lz77.h"
+#include "lz_optimal.h"
+#include "bwt.h"
+#include "mtf.h"
+#include "arithmetic_coder.h"
+#include "rans.h"
+#include "huffman.h"
+#include "context_mixing.h"
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <fstream>
+#include <cstring>
+#include <algorithm>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+#ifdef _WIN32
+    // Windows ではピークをリセットできないので、プロセス開始からのピークになる
+    void ResetPeakMemory() {}
+
+    uint64_t PeakMemory() {
+        PROCESS_MEMORY_COUNTERS counters;
+        if ( !GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) ) return 0;
+        return counters.PeakWorkingSetSize;
+    }
+#else
+    // Linux では clear_refs に 5 を書くと VmHWM (ピークの常駐サイズ) が現在の値に戻る
+    void ResetPeakMemory() {
+        std::ofstream clearRefs("/proc/self/clear_refs");
+        if ( clearRefs ) clearRefs << "5";
+    }
+
+    uint64_t PeakMemory() {
+        std::ifstream status("/proc/self/status");
+        std::string line;
+        while ( std::getline(status, line) ) {
+            if ( line.rfind("VmHWM:", 0) == 0 ) return std::stoull(line.substr(6)) * 1024;
+        }
+        // /proc が無い場合はプロセス開始からのピーク
+        rusage usage {};
+        getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+        return static_cast<uint64_t>( usage.ru_maxrss );
+#else
+        return static_cast<uint64_t>( usage.ru_maxrss ) * 1024;
+#endif
+    }
+#endif
+
+    // CSV のフィールド (カンマや引用符を含む場合は引用符で囲む)
+    std::string CsvField(const std::string& value) {
+        if ( value.find_first_of(",\"\n") == std::string::npos ) return value;
+        std::string quoted = "\"";
+        for ( const char c : value ) {
+            if ( c == '"' ) quoted += '"';
+            quoted += c;
+        }
+        return quoted + "\"";
+    }
+}
+
+Benchmark::Benchmark(const Compressor& compressor, int level, Cmp::Entropy entropy, size_t contextMixingMemory)
+    : compressor(compressor) {
+    // 各段は単体で元のデータを符号化・復号する (Transform 系の段は大きさが変わらないので比率は1前後になる)
+    stages = {
+        { "delta", [] (auto data, auto& out) { Cmp::Delta::Compress(data, out); },
+                   [] (auto data, auto& out) { Cmp::Delta::Decompress(data, out); } },
+        { "exe", [] (auto data, auto& out) { Cmp::ExeFilter::Transform(data, out); },
+                 [] (auto data, auto& out) { Cmp::ExeFilter::InverseTransform(data, out); } },
+        { "rle", [] (auto data, auto& out) { Cmp::Rle::Compress(data, out); },
+                 [] (auto data, auto& out) { Cmp::Rle::Decompress(data, out); } },
+        { "lz77", [] (auto data, auto& out) {
+                      std::vector<Cmp::Lz77Token> tokens;
+                      Cmp::Lz77::Compress(data, tokens);
+                      Cmp::Lz77::SerializeTokens(tokens, out);
+                  },
+                  [] (auto data, auto& out) { if ( !Cmp::Lz77::DecompressSerialized(data, out) ) out.clear(); } },
+        { "lzopt", [ = ] (auto data, auto& out) { Cmp::LzOptimal::Compress(data, entropy, out, level); },
+                   [ = ] (auto data, auto& out) { Cmp::LzOptimal::Decompress(data, entropy, out); } },
+        // primary index は末尾の8バイトに置く
+        { "bwt", [] (auto data, auto& out) {
+                     const uint64_t primaryIndex = Cmp::Bwt::Transform(data, out);
+                     const char* bytes = reinterpret_cast<const char*>( &primaryIndex );
+                     out.insert(out.end(), bytes, bytes + sizeof(primaryIndex));
+                 },
+                 [] (auto data, auto& out) {
+                     uint64_t primaryIndex = 0;
+                     std::memcpy(&primaryIndex, data.data() + data.size() - sizeof(primaryIndex), sizeof(primaryIndex));
+                     Cmp::Bwt::InverseTransform(data.first(data.size() - sizeof(primaryIndex)), static_cast<size_t>( primaryIndex ), out);
+                 } },
+        { "mtf", [] (auto data, auto& out) { Cmp::Mtf::Transform(data, out); },
+                 [] (auto data, auto& out) { Cmp::Mtf::InverseTransform(data, out); } },
+        { "arith", [] (auto data, auto& out) { Cmp::ArithmeticCoder::Compress(data, out); },
+                   [] (auto data, auto& out) { Cmp::ArithmeticCoder::Decompress(data, out); } },
+        { "arith-adaptive", [] (auto data, auto& out) { Cmp::ArithmeticCoder::CompressAdaptive(data, out); },
+                            [] (auto data, auto& out) { Cmp::ArithmeticCoder::DecompressAdaptive(data, out); } },
+        { "rans", [] (auto data, auto& out) { Cmp::Rans::Compress(data, out); },
+                  [] (auto data, auto& out) { Cmp::Rans::Decompress(data, out); } },
+        { "huffman", [] (auto data, auto& out) { Cmp::Huffman::Compress(data, out); },
+                     [] (auto data, auto& out) { Cmp::Huffman::Decompress(data, out); } },
+        { "cm", [ = ] (auto data, auto& out) { Cmp::ContextMixing::Compress(data, out, contextMixingMemory); },
+                [] (auto data, auto& out) { Cmp::ContextMixing::Decompress(data, out); }, false },
+        // アーカイブの1エントリと同じ圧縮 (種類の推定とパイプラインの選択を含む)。algorithmId を先頭に置く
+        // 他の段と同じく1スレッドで測る
+        { "pipeline", [ this ] (auto data, auto& out) {
+                          std::vector<char> compressed;
+                          const uint8_t algorithmId = this->compressor.CompressBuffer(data, compressed, 1);
+                          out.assign(1, static_cast<char>( algorithmId ));
+                          out.insert(out.end(), compressed.begin(), compressed.end());
+                      },
+                      [ this ] (auto data, auto& out) {
+                          if ( !decompressor.DecodeData(static_cast<uint8_t>( data[0] ), data.subspan(1), out, UINT64_MAX, 1) ) out.clear();
+                      } },
+    };
+}
+
+bool Benchmark::SelectStages(const std::string& list) {
+    for ( auto& stage : stages ) stage.selected = false;
+    size_t begin = 0;
+    while ( begin <= list.size() ) {
+        size_t end = list.find(',', begin);
+        if ( end == std::string::npos ) end = list.size();
+        const std::string name = list.substr(begin, end - begin);
+        if ( name == "all" ) {
+            for ( auto& stage : stages ) stage.selected = true;
+        }
+        else {
+            auto it = std::find_if(stages.begin(), stages.end(), [ & ] (const Stage& stage) { return stage.name == name; });
+            if ( it == stages.end() ) return false;
+            it->selected = true;
+        }
+        begin = end + 1;
+    }
+    return true;
+}
+
+bool Benchmark::Run(const std::vector<std::string>& folders) {
+    // 1. 対象のファイルを列挙する (空のファイルは測るものがないので除く)
+    std::vector<fs::path> files;
+    try {
+        for ( const auto& folder : folders ) {
+            for ( const auto& entry : fs::recursive_directory_iterator(folder) ) {
+                if ( entry.is_regular_file() && entry.file_size() > 0 ) {
+                    files.push_back(entry.path());
+                }
+            }
+        }
+    }
+    catch ( const fs::filesystem_error& e ) {
+        std::cerr << "Error: Failed to access source folder: " << e.what() << std::endl;
+        return false;
+    }
+    std::sort(files.begin(), files.end());
+
+    // 2. 段ごとに全ファイルを計測し、ファイルごとの行と合計の行 (file が "*") を書く
+    std::cerr << "Benchmarking " << files.size() << " file(s), " << iterations << " iteration(s) per stage...\n";
+    std::cout << "stage,file,original_bytes,encoded_bytes,ratio,encode_mb_s,decode_mb_s,peak_memory_kb,iterations,result\n";
+    size_t failed = 0;
+    for ( const auto& stage : stages ) {
+        if ( !stage.selected ) continue;
+        std::cerr << "  " << stage.name << "\n";
+        Measurement total;
+        for ( const auto& path : files ) {
+            Measurement measurement;
+            Cmp::MappedFile source;
+            if ( source.OpenRead(path) ) {
+                measurement = Measure(stage, std::span<const char>(source.Data(), source.Size()));
+            }
+            else {
+                measurement.error = "cannot read the file";
+            }
+            PrintRow(stage.name, path.generic_string(), measurement);
+            if ( !measurement.error.empty() ) {
+                std::cerr << "    FAIL " << path.generic_string() << ": " << measurement.error << "\n";
+                failed++;
+                if ( total.error.empty() ) total.error = measurement.error;
+            }
+            total.originalSize += measurement.originalSize;
+            total.encodedSize += measurement.encodedSize;
+            total.encodeSeconds += measurement.encodeSeconds;
+            total.decodeSeconds += measurement.decodeSeconds;
+            total.peakMemory = std::max(total.peakMemory, measurement.peakMemory);
+        }
+        PrintRow(stage.name, "*", total);
+        std::cout.flush();
+    }
+    std::cerr << "Benchmark finished: " << failed << " failure(s).\n";
+    return failed == 0;
+}
+
+Benchmark::Measurement Benchmark::Measure(const Stage& stage, std::span<const char> data) const {
+    Measurement result;
+    result.originalSize = data.size();
+    // 大きなファイルはアーカイブと同じチャンクに分ける (作業メモリをメモリ上限に収めるため)
+    const size_t chunkSize = compressor.ChunkSize();
+    std::vector<char> encoded;
+    std::vector<char> decoded;
+    try {
+        ResetPeakMemory();
+        for ( unsigned iteration = 0; iteration < std::max(iterations, 1u); ++iteration ) {
+            uint64_t encodedSize = 0;
+            double encodeSeconds = 0;
+            double decodeSeconds = 0;
+            for ( size_t offset = 0; offset < data.size(); offset += chunkSize ) {
+                const std::span<const char> chunk = data.subspan(offset, std::min(chunkSize, data.size() - offset));
+                const auto begin = Cmp::Clock::now();
+                stage.encode(chunk, encoded);
+                const auto encodedAt = Cmp::Clock::now();
+                stage.decode(encoded, decoded);
+                const auto end = Cmp::Clock::now();
+                encodedSize += encoded.size();
+                encodeSeconds += Cmp::Seconds(begin, encodedAt);
+                decodeSeconds += Cmp::Seconds(encodedAt, end);
+
+                if ( result.error.empty() ) {
+                    if ( decoded.size() != chunk.size() ) {
+                        result.error = "size mismatch at offset " + std::to_string(offset) + " (expected " + std::to_string(chunk.size()) +
+                            ", actual " + std::to_string(decoded.size()) + ")";
+                    }
+                    else if ( !std::equal(chunk.begin(), chunk.end(), decoded.begin()) ) {
+                        result.error = "content mismatch in the chunk at offset " + std::to_string(offset);
+                    }
+                }
+            }
+            result.encodedSize = encodedSize;
+            result.encodeSeconds = ( iteration == 0 ) ? encodeSeconds : std::min(result.encodeSeconds, encodeSeconds);
+            result.decodeSeconds = ( iteration == 0 ) ? decodeSeconds : std::min(result.decodeSeconds, decodeSeconds);
+        }
+        result.peakMemory = PeakMemory();
+    }
+    catch ( const std::exception& e ) {
+        result.error = e.what();
+    }
+    return result;
+}
+
+void Benchmark::PrintRow(const std::string& stage, const std::string& file, const Measurement& measurement) const {
+    const double ratio = ( measurement.encodedSize == 0 ) ? 0 : static_cast<double>( measurement.originalSize ) / measurement.encodedSize;
+    std::ostringstream row;
+    row << CsvField(stage) << "," << CsvField(file) << ","
+        << measurement.originalSize << "," << measurement.encodedSize << ","
+        << std::fixed << std::setprecision(4) << ratio << ","
+        << std::setprecision(2) << Cmp::Throughput(measurement.originalSize, measurement.encodeSeconds) << ","
+        << Cmp::Throughput(measurement.originalSize, measurement.decodeSeconds) << ","
+        << measurement.peakMemory / 1024 << "," << iterations << ","
+        << ( measurement.error.empty() ? "OK" : "FAIL" ) << "\n";
+    std::cout << row.str();
+}
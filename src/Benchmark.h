@@ -0,0 +1,60 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <span>
+#include <functional>
+#include <filesystem>
+#include <cstdint>
+#include "Compressor.h"
+#include "Decompressor.h"
+
+// 各コーデックの段 (Delta・LZ・BWT・エントロピー符号化器など) とパイプライン全体を、
+// フォルダ内のファイルに対して繰り返し実行し、符号化・復号の速度と圧縮率、ピークメモリを測る
+// 結果は段とファイルごとに1行の CSV として標準出力に書く (進捗は標準エラー出力)
+class Benchmark {
+public:
+    static constexpr unsigned DEFAULT_ITERATIONS = 3;
+
+    // パイプライン全体の段 ("pipeline") は compressor の設定で圧縮する
+    explicit Benchmark(const Compressor& compressor, int level = Cmp::LzOptimal::DEFAULT_LEVEL,
+        Cmp::Entropy entropy = Cmp::Entropy::ADAPTIVE_ARITHMETIC, size_t contextMixingMemory = Cmp::ContextMixing::DEFAULT_MEMORY);
+
+    // folders 以下の全ファイルで計測する。全ての段で復号結果が元と一致すれば true
+    bool Run(const std::vector<std::string>& folders);
+
+    // 計測の繰り返し回数を設定する (各回の最短時間を速度とする)
+    void SetIterations(unsigned count) { iterations = count; }
+    // "lz77,bwt,huffman" のようなカンマ区切りの段の名前で計測する段を選ぶ ("all" は全て)
+    // 既定では遅いコンテキストミキシング ("cm") 以外の全ての段を計測する。知らない名前があれば false
+    bool SelectStages(const std::string& list);
+
+private:
+    using Codec = std::function<void(std::span<const char>, std::vector<char>&)>;
+
+    struct Stage {
+        std::string name;
+        Codec encode;
+        Codec decode;           // 復号できない場合は出力を空にするか例外を投げる
+        bool selected = true;
+    };
+
+    // 1つの段を1ファイルに対して計測した結果
+    struct Measurement {
+        uint64_t originalSize = 0;
+        uint64_t encodedSize = 0;
+        double encodeSeconds = 0;   // 繰り返しのうち最短の時間 (チャンクの合計)
+        double decodeSeconds = 0;
+        uint64_t peakMemory = 0;    // 計測中のプロセスのピーク使用メモリ (バイト)
+        std::string error;          // 復号結果が元と一致しなかった理由
+    };
+
+    // data を chunkSize ごとに区切って stage で符号化・復号し、iterations 回の最短時間を測る
+    Measurement Measure(const Stage& stage, std::span<const char> data) const;
+    // 1行分の結果を CSV で書く
+    void PrintRow(const std::string& stage, const std::string& file, const Measurement& measurement) const;
+
+    const Compressor& compressor;
+    Decompressor decompressor;
+    std::vector<Stage> stages;
+    unsigned iterations = DEFAULT_ITERATIONS;
+};
@@ -5,23 +5,46 @@
 #include <fstream>
 #include <vector>
 #include <filesystem>
+#include <optional>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <algorithm>
 
 #include "lz77.h"
+#include "lz_optimal.h"
 #include "rle.h"
 #include "delta.h"
 #include "bwt.h"
+#include "bwt_block.h"
 #include "mtf.h"
 #include "huffman.h"
+#include "crc32c.h"
+#include "context_mixing.h"
 
 #include "exe_filter.h"
+#include "content_analyzer.h"
+#include "trial_race.h"
 #include "arithmetic_coder.h"
+#include "entropy_coder.h"
+#include "Parallel.h"
+#include "MappedFile.h"
 
 namespace fs = std::filesystem;
 
+namespace {
+    // 入力1バイトあたりの作業メモリの見積もり (読み込みバッファと各段の中間バッファの合計)
+    // LZの一致探索の分は圧縮レベルによって変わるので MemoryPerInputByte() で加える
+    constexpr size_t MEMORY_PER_INPUT_BYTE = 8;
+    // ストリーム圧縮のチャンクサイズの範囲
+    constexpr size_t MIN_CHUNK_SIZE = size_t(1) << 20;
+    constexpr size_t MAX_CHUNK_SIZE = size_t(64) << 20;
+}
+
 bool Compressor::CompressFolder(const std::string& sourceFolder, const std::string& outputFile) {
     Logger::Info("Compression process started for folder: {}", sourceFolder);
 
-    // 1. kΏۂ̃t@CXg쐬
+    // 1. 圧縮対象のファイルリストを作成
     std::vector<fs::path> filesToCompress;
     try {
         for ( const auto& entry : fs::recursive_directory_iterator(sourceFolder) ) {
@@ -42,14 +65,9 @@ bool Compressor::CompressFolder(const std::string& sourceFolder, const std::stri
         return true;
     }
 
-    if ( filesToCompress.size() > 255 ) {
-        Logger::Error("Too many files. A maximum of 255 files is supported.", filesToCompress.size());
-        std::cerr << "Error: The number of files (" << filesToCompress.size() << ") exceeds the limit of 255." << std::endl;
-        return false;
-    }
     Logger::Info("Found {} files to compress.", filesToCompress.size());
 
-    // 2. o̓t@CJ
+    // 2. 出力ファイルを開く
     std::ofstream outFile(outputFile, std::ios::binary);
     if ( !outFile.is_open() ) {
         Logger::Error("Failed to open output file: {}", outputFile);
@@ -57,117 +75,476 @@ bool Compressor::CompressFolder(const std::string& sourceFolder, const std::stri
         return false;
     }
 
-    // 3. S̃wb_쐬ď
+    // 3. 全体ヘッダを作成して書き込む
     Cmp::GlobalHeader header;
     header.magic[0] = 'C';
     header.magic[1] = 'M';
     header.magic[2] = 'P';
     header.magic[3] = 'C';
-    header.version = 1;
-    header.fileCount = static_cast<uint8_t>( filesToCompress.size() );
+    header.version = Cmp::FORMAT_VERSION_3;
+    header.fileCount = 0; // バージョン2以降は件数は末尾のインデックスに持つ
 
     outFile.write(reinterpret_cast<const char*>( &header ), sizeof(header));
-    Logger::Info("Global header written. Version: {}, File count: {}", header.version, header.fileCount);
+    Logger::Info("Global header written. Version: {}", header.version);
+
+    // 4. 各ファイルをワーカーで並列に圧縮し、書き込みはファイル順に1か所で行う
+    //    (出力は逐次処理と同じバイト列になる)
+    const size_t fileCount = filesToCompress.size();
+    const unsigned workerCount = Cmp::ResolveThreadCount(threadCount);
+    const size_t window = static_cast<size_t>( workerCount ) * 2; // 書き込み待ちで保持する最大件数
+    Logger::Info("Compressing with {} worker thread(s). Memory limit: {}, Chunk size: {}, Level: {}", workerCount, memoryLimit, ChunkSize(), level);
+
+    // 各ファイルの中の並列処理 (テキストのBWTブロック・試し圧縮) には、同時に処理するファイルで分けた残りのスレッドだけを使う
+    // (ワーカーが全て埋まるほどファイルがあれば1スレッド)。書き込みスレッドのストリーム圧縮は、
+    // ワーカーが使用中のスレッド数 busyThreads を見て空いている分だけを使う
+    const unsigned innerThreads = std::max<unsigned>(1, static_cast<unsigned>( workerCount / std::max<size_t>(1, std::min<size_t>(fileCount, workerCount)) ));
+    std::atomic<unsigned> busyThreads{ 0 };
 
-    // 4. et@C[vď
-    for ( const auto& filePath : filesToCompress ) {
-        Logger::Info("Processing file: {}", filePath.string());
+    std::vector<std::optional<CompressedFile>> results(fileCount);
+    std::mutex resultMutex;
+    std::condition_variable resultReady;
+    size_t writtenCount = 0;
+    size_t reservedMemory = 0;  // 圧縮中・書き込み待ちのエントリが確保している作業メモリの見積もり
+    std::vector<IndexRecord> index;
+    index.reserve(fileCount);
 
-        std::ifstream inFile(filePath, std::ios::binary);
-        if ( !inFile.is_open() ) {
-            Logger::Error("Failed to open source file: {}", filePath.string());
-            continue;
+    std::thread writer([ & ] () {
+        for ( size_t i = 0; i < fileCount; ++i ) {
+            CompressedFile entry;
+            {
+                std::unique_lock<std::mutex> lock(resultMutex);
+                resultReady.wait(lock, [ & ] () { return results[i].has_value(); });
+                entry = std::move(*results[i]);
+                results[i].reset();
+            }
+            if ( entry.ok && entry.streamed ) {
+                // 途中で失敗した場合は書きかけのエントリを巻き戻す (末尾の余りは最後に切り詰める)
+                const auto entryStart = outFile.tellp();
+                IndexRecord record;
+                bool written = false;
+                try {
+                    written = WriteStreamedEntry(outFile, entry, workerCount, busyThreads, record);
+                }
+                catch ( const std::exception& e ) {
+                    Logger::Error("Failed to compress file: {} ({})", entry.sourcePath.string(), e.what());
+                }
+                if ( written ) {
+                    index.push_back(std::move(record));
+                }
+                else {
+                    outFile.clear();
+                    outFile.seekp(entryStart);
+                }
+            }
+            else if ( entry.ok ) {
+                index.push_back(WriteEntry(outFile, entry));
+            }
+            {
+                std::lock_guard<std::mutex> lock(resultMutex);
+                writtenCount = i + 1;
+                reservedMemory -= entry.memoryCost;
+            }
+            resultReady.notify_all();
         }
+    });
 
-        std::vector<char> fileData(
-            ( std::istreambuf_iterator<char>(inFile) ),
-            std::istreambuf_iterator<char>()
-        );
-        inFile.close();
-
-        //  炪ASYIWbNiŏIŁj 
-        Cmp::Algorithm selectedAlgo;
-        std::vector<char> compressedData;
-
-        // ̃t@C^Cvɑ΂ẮAœKȃASYߑł
-        if ( filePath.extension() == ".txt" ) {
-            Logger::Info("  -> Selecting BWT for text file...");
-            selectedAlgo = Cmp::Algorithm::BWT_HUFFMAN;
-            auto bwt_result = Cmp::Bwt::Transform(fileData);
-            std::vector<char> bwt_serialized;
-            uint32_t index = static_cast<uint32_t>( bwt_result.second );
-            bwt_serialized.push_back(( index >> 24 ) & 0xFF);
-            bwt_serialized.push_back(( index >> 16 ) & 0xFF);
-            bwt_serialized.push_back(( index >> 8 ) & 0xFF);
-            bwt_serialized.push_back(index & 0xFF);
-            bwt_serialized.insert(bwt_serialized.end(), bwt_result.first.begin(), bwt_result.first.end());
-            auto mtf_bytes = Cmp::Mtf::Transform(bwt_serialized);
-            compressedData = Cmp::ArithmeticCoder::Compress(mtf_bytes);
+    Cmp::ParallelFor(fileCount, workerCount, [ & ] (size_t i) {
+        // ファイルサイズから作業メモリを見積もる (チャンクより大きいファイルはストリーム圧縮の分)
+        std::error_code ec;
+        const uint64_t fileSize = fs::file_size(filesToCompress[i], ec);
+        const size_t memoryCost = ( !ec && fileSize > ChunkSize() )
+            ? StreamSlots(workerCount) * EstimateMemory(ChunkSize())
+            : EstimateMemory(static_cast<size_t>( ec ? 0 : fileSize ));
+        {
+            // 書き込みが追いつくまで先読みしすぎないようにする。
+            // 次に書き込むエントリはメモリ上限を超えていても進める (そうしないと書き込みが止まる)
+            std::unique_lock<std::mutex> lock(resultMutex);
+            resultReady.wait(lock, [ & ] () {
+                return i < writtenCount + window &&
+                    ( reservedMemory + memoryCost <= memoryLimit || i == writtenCount );
+            });
+            reservedMemory += memoryCost;
         }
-        else if ( filePath.filename() == "explosion.wav" ) {
-            Logger::Info("  -> Selecting Delta+LZ77 for wave file...");
-            selectedAlgo = Cmp::Algorithm::DELTA_HUFFMAN;
-            auto delta_bytes = Cmp::Delta::Compress(fileData);
-            auto lz77_tokens = Cmp::Lz77::Compress(delta_bytes);
-            auto lz77_bytes = Cmp::Lz77::SerializeTokens(lz77_tokens);
-            compressedData = Cmp::ArithmeticCoder::Compress(lz77_bytes);
+        CompressedFile entry;
+        busyThreads += innerThreads;
+        try {
+            entry = CompressFile(filesToCompress[i], sourceFolder, innerThreads);
         }
-        else if ( filePath.extension() == ".exe" ) { //  .exe p̕𖾎Iɍ쐬
-            selectedAlgo = Cmp::Algorithm::EXE_FILTER_LZ77_HUFFMAN;
-            auto filtered_data = Cmp::ExeFilter::Transform(fileData);
-            auto lz77_tokens = Cmp::Lz77::Compress(filtered_data);
-            auto lz77_bytes = Cmp::Lz77::SerializeTokens(lz77_tokens);
-            compressedData = Cmp::ArithmeticCoder::Compress(lz77_bytes);
+        catch ( const std::exception& e ) {
+            Logger::Error("Failed to compress file: {} ({})", filesToCompress[i].string(), e.what());
+            entry = CompressedFile{};
         }
-        else {
-            // LȊOi.bmp, .exeȂǁj́ARLELZ77ėǂI
-            Logger::Info("  -> Performing trial compression (RLE vs LZ77)...");
-
-            // s1: RLE+Huffman
-            auto rle_bytes = Cmp::Rle::Compress(fileData);
-            auto rle_result = Cmp::ArithmeticCoder::Compress(rle_bytes);
-
-            // s2: LZ77+Huffman
-            auto lz77_tokens = Cmp::Lz77::Compress(fileData);
-            auto lz77_bytes = Cmp::Lz77::SerializeTokens(lz77_tokens);
-            auto lz77_result = Cmp::ArithmeticCoder::Compress(lz77_bytes);
-
-            // ʂrđI
-            if ( rle_result.size() < lz77_result.size() ) {
-                selectedAlgo = Cmp::Algorithm::RLE_HUFFMAN;
-                compressedData = rle_result;
-                Logger::Info("  -> Trial result: RLE selected (RLE: {}, LZ77: {}).", rle_result.size(), lz77_result.size());
-            }
-            else {
-                selectedAlgo = Cmp::Algorithm::LZ77_HUFFMAN;
-                compressedData = lz77_result;
-                Logger::Info("  -> Trial result: LZ77 selected (RLE: {}, LZ77: {}).", rle_result.size(), lz77_result.size());
-            }
+        busyThreads -= innerThreads;
+        entry.memoryCost = memoryCost;
+        {
+            std::lock_guard<std::mutex> lock(resultMutex);
+            results[i] = std::move(entry);
         }
+        resultReady.notify_all();
+    });
+    writer.join();
+
+    // 5. 末尾にインデックスを書き込む (件数は実際に書き込んだエントリ数)
+    WriteIndex(outFile, index);
+    if ( index.size() != fileCount ) {
+        Logger::Error("{} file(s) could not be compressed and were skipped.", fileCount - index.size());
+    }
+
+    // 巻き戻したエントリがあった場合、インデックスより後ろに古いデータが残るので切り詰める
+    const uint64_t archiveSize = static_cast<uint64_t>( outFile.tellp() );
+    outFile.close();
+    std::error_code ec;
+    if ( fs::file_size(outputFile, ec) > archiveSize && !ec ) {
+        fs::resize_file(outputFile, archiveSize, ec);
+    }
+
+    Logger::Info("Compression process successfully finished.");
+    return true;
+}
 
-        // --- wb_쐬Əݏ͕ύXȂ ---
-        Cmp::FileEntryHeader entryHeader;
-        entryHeader.algorithmId = static_cast<uint8_t>( selectedAlgo );
-        entryHeader.originalSize = static_cast<uint32_t>( fileData.size() );
-        entryHeader.compressedSize = static_cast<uint32_t>( compressedData.size() );
+Compressor::CompressedFile Compressor::CompressFile(const fs::path& filePath, const std::string& sourceFolder, unsigned threads) const {
+    CompressedFile result;
+    Logger::Info("Processing file: {}", filePath.string());
 
-        std::string relativePathStr = fs::relative(filePath, sourceFolder).string();
-        if ( relativePathStr.length() > 255 ) {
-            Logger::Error("File path is too long (max 255): {}", relativePathStr);
-            continue;
+    result.relativePath = fs::relative(filePath, sourceFolder).string();
+
+    // チャンクより大きいファイルはここでは読まず、書き込みスレッドでチャンクごとに圧縮する
+    std::error_code ec;
+    const uint64_t fileSize = fs::file_size(filePath, ec);
+    if ( !ec && fileSize > ChunkSize() ) {
+        Logger::Info("  -> Large file ({} bytes). Compressing as a stream of {} byte chunks...", fileSize, ChunkSize());
+        result.ok = true;
+        result.streamed = true;
+        result.sourcePath = filePath;
+        result.algorithm = Cmp::Algorithm::FRAMED;
+        result.originalSize = fileSize;
+        return result;
+    }
+
+    // ファイルをマップし、マップ上のデータをそのまま各段に渡す
+    Cmp::MappedFile source;
+    if ( !source.OpenRead(filePath) ) {
+        Logger::Error("Failed to open source file: {}", filePath.string());
+        return result;
+    }
+    std::span<const char> fileData(source.Data(), source.Size());
+
+    CompressData(fileData, result.algorithm, result.data, threads);
+    result.ok = true;
+    result.originalSize = fileData.size();
+    result.checksum = Cmp::Crc32c::Compute(fileData);
+    return result;
+}
+
+uint8_t Compressor::CompressBuffer(std::span<const char> data, std::vector<char>& compressedData, unsigned threads) const {
+    Cmp::Algorithm algorithm = Cmp::Algorithm::STORE;
+    CompressData(data, algorithm, compressedData, threads);
+    return Cmp::MakeAlgorithmId(algorithm, entropy);
+}
+
+void Compressor::CompressData(std::span<const char> fileData, Cmp::Algorithm& selectedAlgo, std::vector<char>& compressedData, unsigned threads) const {
+    SelectAndCompress(fileData, selectedAlgo, compressedData, threads);
+
+    // どのパイプラインでも元より小さくならなかったデータはそのまま格納する
+    if ( selectedAlgo != Cmp::Algorithm::STORE && compressedData.size() >= fileData.size() ) {
+        Logger::Info("  -> Coded size {} is not smaller than the input ({}). Falling back to STORE.", compressedData.size(), fileData.size());
+        selectedAlgo = Cmp::Algorithm::STORE;
+        compressedData.assign(fileData.begin(), fileData.end());
+    }
+}
+
+void Compressor::SelectAndCompress(std::span<const char> fileData, Cmp::Algorithm& selectedAlgo, std::vector<char>& compressedData, unsigned threads) const {
+    // ★★★ ここからがアルゴリズム選択ロジック（内容の解析による） ★★★
+    // 各パイプラインは試し圧縮で別々のスレッドから呼ばれるので、作業バッファはそれぞれの中で持つ
+
+    // 静的算術符号はストリームごとに約263KBのモデルを持つため、
+    // 4つのストリームに分けて符号化する最適パースLZは適応型算術符号/rANSのときだけ使う
+    const bool optimalLz = ( entropy != Cmp::Entropy::STATIC_ARITHMETIC );
+    const auto compressLz = [ & ] (std::span<const char> input, std::vector<char>& output) {
+        if ( optimalLz ) {
+            Cmp::LzOptimal::Compress(input, entropy, output, level);
+            return;
+        }
+        std::vector<Cmp::Lz77Token> tokens;
+        std::vector<char> serialized;
+        Cmp::Lz77::Compress(input, tokens);
+        Cmp::Lz77::SerializeTokens(tokens, serialized);
+        Cmp::EntropyCoder::Compress(serialized, entropy, output);
+    };
+    const auto compressRle = [ & ] (std::span<const char> input, std::vector<char>& output) {
+        std::vector<char> work;
+        Cmp::Rle::Compress(input, work);
+        Cmp::EntropyCoder::Compress(work, entropy, output);
+    };
+
+    // 差分 (stride 付き) -> LZ。静的算術符号の従来形式は stride 4 だけを扱える
+    const auto compressDelta = [ & ] (std::span<const char> input, int stride, std::vector<char>& output) {
+        std::vector<char> work(input.begin(), input.end());
+        Cmp::Delta::CompressInPlace(work, stride);
+        if ( optimalLz ) {
+            std::vector<char> lz;
+            Cmp::LzOptimal::Compress(work, entropy, lz, level);
+            output.clear();
+            output.reserve(lz.size() + 1);
+            output.push_back(static_cast<char>( stride ));
+            output.insert(output.end(), lz.begin(), lz.end());
+            return;
         }
-        entryHeader.fileNameLength = static_cast<uint8_t>( relativePathStr.length() );
+        compressLz(work, output);
+    };
+    const auto deltaAlgorithm = optimalLz ? Cmp::Algorithm::DELTA_STRIDE_LZ_OPTIMAL : Cmp::Algorithm::DELTA_HUFFMAN;
+    const auto deltaAvailable = [ & ] (int stride) { return optimalLz || stride == 4; };
 
-        outFile.write(reinterpret_cast<const char*>( &entryHeader ), sizeof(entryHeader));
-        outFile.write(relativePathStr.c_str(), relativePathStr.length());
-        outFile.write(compressedData.data(), compressedData.size());
+    // ヘッダと標本の統計から種類を推定し、決まったものはそのまま圧縮する
+    const Cmp::ContentProfile profile = Cmp::ContentAnalyzer::Analyze(fileData);
+    Logger::Info("  -> Analysis: format '{}', entropy {:.2f} (delta {:.2f} at stride {}), text {:.3f}, runs {:.3f}",
+        profile.format, profile.entropy, profile.strideEntropy, profile.bestStride, profile.textRatio, profile.runRatio);
 
-        double ratio = ( compressedData.empty() ) ? 0 : (double)entryHeader.originalSize / entryHeader.compressedSize;
-        Logger::Info("  -> Compressed. Ratio: {:.2f}:1, Size: {} -> {}, Path: '{}'",
-            ratio, entryHeader.originalSize, entryHeader.compressedSize, relativePathStr);
+    if ( profile.pipeline == Cmp::Pipeline::INCOMPRESSIBLE ) {
+        Logger::Info("  -> High-entropy data. Storing without compression...");
+        selectedAlgo = Cmp::Algorithm::STORE;
+        compressedData.assign(fileData.begin(), fileData.end());
+        return;
+    }
+    if ( profile.pipeline == Cmp::Pipeline::TEXT && textMode == TextMode::CONTEXT_MIXING ) {
+        Logger::Info("  -> Selecting context mixing for text (model memory: {})...", Cmp::ContextMixing::MemoryUsage(contextMixingMemory));
+        selectedAlgo = Cmp::Algorithm::CONTEXT_MIXING;
+        Cmp::ContextMixing::Compress(fileData, compressedData, contextMixingMemory);
+        return;
+    }
+    if ( profile.pipeline == Cmp::Pipeline::TEXT ) {
+        Logger::Info("  -> Selecting block-sorted BWT for text (block size: {})...", bwtBlockSize);
+        selectedAlgo = Cmp::Algorithm::BWT_BLOCK_SEGMENTED;
+        Cmp::BwtBlock::Compress(fileData, entropy, Cmp::BwtBlock::Stage::MTF_ZERO_RUN, Cmp::BwtBlock::Header::SEGMENT_STARTS, compressedData, bwtBlockSize, threads);
+        return;
+    }
+    if ( profile.pipeline == Cmp::Pipeline::EXECUTABLE ) {
+        Logger::Info("  -> Selecting EXE filter + LZ for {} executable...", profile.format);
+        selectedAlgo = optimalLz ? Cmp::Algorithm::EXE_FILTER_LZ_OPTIMAL : Cmp::Algorithm::EXE_FILTER_LZ77_HUFFMAN;
+        std::vector<char> work(fileData.begin(), fileData.end());
+        Cmp::ExeFilter::TransformInPlace(work);
+        compressLz(work, compressedData);
+        return;
+    }
+    if ( profile.pipeline == Cmp::Pipeline::DELTA && deltaAvailable(profile.stride) ) {
+        Logger::Info("  -> Selecting Delta (stride {}) + LZ for {} data...", profile.stride, profile.format);
+        selectedAlgo = deltaAlgorithm;
+        compressDelta(fileData, profile.stride, compressedData);
+        return;
     }
 
-    Logger::Info("Compression process successfully finished.");
-    outFile.close();
+    // 推定できなかったものは標本だけを候補のパイプラインで並列に試し、最も小さくなったもので全体を圧縮する
+    // 他の候補の結果より大きくなった候補は標本の途中で打ち切る
+    struct Candidate {
+        const char* name;
+        Cmp::Algorithm algorithm;
+    };
+    std::vector<Candidate> candidates;
+    std::vector<Cmp::TrialRace::Encoder> encoders;
+    // 静的算術符号はストリームごとに固定の大きなモデルを持ち、小さな標本では必ず STORE が勝つので、
+    // 標本を区切らずに試し、STORE は候補にしない
+    if ( ( trialCandidates & TRIAL_STORE ) && optimalLz ) {
+        candidates.push_back({ "STORE", Cmp::Algorithm::STORE });
+        encoders.push_back([] (std::span<const char> input, std::vector<char>& output) { output.assign(input.begin(), input.end()); });
+    }
+    if ( trialCandidates & TRIAL_RLE ) {
+        candidates.push_back({ "RLE", Cmp::Algorithm::RLE_HUFFMAN });
+        encoders.push_back(compressRle);
+    }
+    if ( trialCandidates & TRIAL_LZ ) {
+        candidates.push_back({ "LZ", optimalLz ? Cmp::Algorithm::LZ_OPTIMAL : Cmp::Algorithm::LZ77_HUFFMAN });
+        encoders.push_back(compressLz);
+    }
+    if ( ( trialCandidates & TRIAL_DELTA ) && profile.stride > 0 && deltaAvailable(profile.stride) ) {
+        candidates.push_back({ "Delta", deltaAlgorithm });
+        encoders.push_back([ &, stride = profile.stride ] (std::span<const char> input, std::vector<char>& output) { compressDelta(input, stride, output); });
+    }
+    if ( trialCandidates & TRIAL_BWT ) {
+        candidates.push_back({ "BWT", Cmp::Algorithm::BWT_BLOCK_SEGMENTED });
+        encoders.push_back([ & ] (std::span<const char> input, std::vector<char>& output) {
+            Cmp::BwtBlock::Compress(input, entropy, Cmp::BwtBlock::Stage::MTF_ZERO_RUN, Cmp::BwtBlock::Header::SEGMENT_STARTS, output, bwtBlockSize, 1);
+        });
+    }
+    // 圧縮する候補が1つも残らなかった場合 (STORE だけを指定した、Delta を使えないストライドだった等) もLZは試す
+    const bool hasCompressor = std::any_of(candidates.begin(), candidates.end(),
+        [] (const Candidate& candidate) { return candidate.algorithm != Cmp::Algorithm::STORE; });
+    if ( !hasCompressor ) {
+        candidates.push_back({ "LZ", optimalLz ? Cmp::Algorithm::LZ_OPTIMAL : Cmp::Algorithm::LZ77_HUFFMAN });
+        encoders.push_back(compressLz);
+    }
+
+    std::vector<char> sample;
+    Cmp::ContentAnalyzer::Sample(fileData, sample);
+    std::vector<size_t> sizes;
+    std::vector<char> winnerOutput;
+    const size_t pieceSize = optimalLz ? Cmp::ContentAnalyzer::SAMPLE_WINDOW : std::max<size_t>(1, sample.size());
+    const size_t winner = Cmp::TrialRace::Run(encoders, sample, pieceSize, threads, sizes, winnerOutput);
+    if ( winner >= candidates.size() ) {
+        // 候補は必ず1つ以上あるので起こらないはずだが、番号として使う前に STORE に戻す
+        Logger::Error("  -> Trial selected no candidate. Storing without compression...");
+        selectedAlgo = Cmp::Algorithm::STORE;
+        compressedData.assign(fileData.begin(), fileData.end());
+        return;
+    }
+
+    std::string summary;
+    for ( size_t i = 0; i < candidates.size(); ++i ) {
+        if ( !summary.empty() ) summary += ", ";
+        summary += candidates[i].name;
+        summary += ( sizes[i] == Cmp::TrialRace::CANCELLED ) ? " (cancelled)" : " " + std::to_string(sizes[i]);
+    }
+    Logger::Info("  -> Trial on {} byte sample: {}. Selected {}.", sample.size(), summary, candidates[winner].name);
+
+    // 標本がデータ全体で1区間に収まった (小さなファイル) なら、試した結果をそのまま使う
+    selectedAlgo = candidates[winner].algorithm;
+    if ( sample.size() == fileData.size() && sample.size() <= pieceSize ) {
+        compressedData.swap(winnerOutput);
+    }
+    else {
+        encoders[winner](fileData, compressedData);
+    }
+}
+
+Compressor::IndexRecord Compressor::WriteEntry(std::ofstream& outFile, const CompressedFile& entry) const {
+    IndexRecord record;
+    record.algorithmId = Cmp::MakeAlgorithmId(entry.algorithm, entropy);
+    record.originalSize = entry.originalSize;
+    record.compressedSize = entry.data.size();
+    record.checksum = entry.checksum;
+    record.relativePath = entry.relativePath;
+
+    // バージョン3のエントリヘッダ: algorithmId + varint (ファイル名長, 元サイズ, 圧縮後サイズ) + CRC32C
+    outFile.put(static_cast<char>( record.algorithmId ));
+    Cmp::WriteVarint(outFile, entry.relativePath.length());
+    Cmp::WriteVarint(outFile, record.originalSize);
+    Cmp::WriteVarint(outFile, record.compressedSize);
+    Cmp::WriteUint32(outFile, record.checksum);
+    outFile.write(entry.relativePath.c_str(), entry.relativePath.length());
+
+    record.dataOffset = static_cast<uint64_t>( outFile.tellp() );
+    outFile.write(entry.data.data(), entry.data.size());
+
+    double ratio = ( entry.data.empty() ) ? 0 : (double)record.originalSize / record.compressedSize;
+    Logger::Info("  -> Compressed. Ratio: {:.2f}:1, Size: {} -> {}, Path: '{}'",
+        ratio, record.originalSize, record.compressedSize, entry.relativePath);
+    return record;
+}
+
+bool Compressor::WriteStreamedEntry(std::ofstream& outFile, const CompressedFile& entry, unsigned workerCount,
+    const std::atomic<unsigned>& busyThreads, IndexRecord& record) const {
+    Cmp::MappedFile source;
+    if ( !source.OpenRead(entry.sourcePath) ) {
+        Logger::Error("Failed to open source file: {}", entry.sourcePath.string());
+        return false;
+    }
+
+    // エントリヘッダ。サイズと CRC32C は書き終えるまで分からないので固定長で仮置きする
+    record.algorithmId = Cmp::MakeAlgorithmId(Cmp::Algorithm::FRAMED, entropy);
+    record.relativePath = entry.relativePath;
+    outFile.put(static_cast<char>( record.algorithmId ));
+    Cmp::WriteVarint(outFile, entry.relativePath.length());
+    const auto sizePosition = outFile.tellp();
+    Cmp::WriteVarint(outFile, 0, Cmp::MAX_VARINT_LENGTH);
+    Cmp::WriteVarint(outFile, 0, Cmp::MAX_VARINT_LENGTH);
+    Cmp::WriteUint32(outFile, 0);
+    outFile.write(entry.relativePath.c_str(), entry.relativePath.length());
+    record.dataOffset = static_cast<uint64_t>( outFile.tellp() );
+
+    // マップ上の複数のチャンク (コピーせずスパンで参照) を並列に圧縮し、ファイル順にフレームとして書き出す
+    const size_t chunkSize = ChunkSize();
+    const size_t slots = StreamSlots(workerCount);
+    std::vector<std::span<const char>> chunks(slots);
+    std::vector<std::vector<char>> frames(slots);
+    std::vector<Cmp::Algorithm> algorithms(slots);
+    std::vector<uint32_t> checksums(slots);
+    uint64_t frameCount = 0;
+    record.originalSize = 0;
+    record.checksum = 0;
+    size_t position = 0;
+    while ( position < source.Size() ) {
+        size_t count = 0;
+        for ( ; count < slots && position < source.Size(); ++count ) {
+            const size_t length = std::min(chunkSize, source.Size() - position);
+            chunks[count] = std::span<const char>(source.Data() + position, length);
+            position += length;
+        }
+
+        // ワーカーが使っていないスレッドをチャンクに分ける (ワーカーが全て使っていれば1スレッドで順に圧縮する)
+        const unsigned busy = busyThreads.load();
+        const unsigned spareThreads = ( busy < workerCount ) ? workerCount - busy : 1;
+        const unsigned chunkThreads = std::max<unsigned>(1, static_cast<unsigned>( spareThreads / count ));
+        Cmp::ParallelFor(count, spareThreads, [ & ] (size_t k) {
+            CompressData(chunks[k], algorithms[k], frames[k], chunkThreads);
+            checksums[k] = Cmp::Crc32c::Compute(chunks[k]);
+        });
+
+        for ( size_t k = 0; k < count; ++k ) {
+            outFile.put(static_cast<char>( Cmp::MakeAlgorithmId(algorithms[k], entropy) ));
+            Cmp::WriteVarint(outFile, chunks[k].size());
+            Cmp::WriteVarint(outFile, frames[k].size());
+            Cmp::WriteUint32(outFile, checksums[k]);
+            outFile.write(frames[k].data(), frames[k].size());
+            // ファイル全体の CRC32C はチャンクの順に続けて計算する
+            record.checksum = Cmp::Crc32c::Update(record.checksum, chunks[k]);
+            record.originalSize += chunks[k].size();
+            frameCount++;
+        }
+    }
+    record.compressedSize = static_cast<uint64_t>( outFile.tellp() ) - record.dataOffset;
+
+    // 仮置きしたサイズを書き直す
+    const auto endPosition = outFile.tellp();
+    outFile.seekp(sizePosition);
+    Cmp::WriteVarint(outFile, record.originalSize, Cmp::MAX_VARINT_LENGTH);
+    Cmp::WriteVarint(outFile, record.compressedSize, Cmp::MAX_VARINT_LENGTH);
+    Cmp::WriteUint32(outFile, record.checksum);
+    outFile.seekp(endPosition);
+
+    double ratio = ( record.compressedSize == 0 ) ? 0 : (double)record.originalSize / record.compressedSize;
+    Logger::Info("  -> Compressed. Ratio: {:.2f}:1, Size: {} -> {}, Frames: {}, Path: '{}'",
+        ratio, record.originalSize, record.compressedSize, frameCount, entry.relativePath);
     return true;
-}
\ No newline at end of file
+}
+
+void Compressor::WriteIndex(std::ofstream& outFile, const std::vector<IndexRecord>& index) const {
+    Cmp::IndexFooterV2 footer;
+    footer.indexOffset = static_cast<uint64_t>( outFile.tellp() );
+    footer.entryCount = index.size();
+    footer.magic[0] = 'C';
+    footer.magic[1] = 'I';
+    footer.magic[2] = 'D';
+    footer.magic[3] = '2';
+
+    for ( const auto& record : index ) {
+        Cmp::WriteVarint(outFile, record.dataOffset);
+        outFile.put(static_cast<char>( record.algorithmId ));
+        Cmp::WriteVarint(outFile, record.relativePath.length());
+        Cmp::WriteVarint(outFile, record.originalSize);
+        Cmp::WriteVarint(outFile, record.compressedSize);
+        Cmp::WriteUint32(outFile, record.checksum);
+        outFile.write(record.relativePath.c_str(), record.relativePath.length());
+    }
+    outFile.write(reinterpret_cast<const char*>( &footer ), sizeof(footer));
+    Logger::Info("Archive index written. Entries: {}, Offset: {}", footer.entryCount, footer.indexOffset);
+}
+
+size_t Compressor::ChunkSize() const {
+    return std::clamp(memoryLimit / 64, MIN_CHUNK_SIZE, MAX_CHUNK_SIZE);
+}
+
+size_t Compressor::StreamSlots(unsigned workerCount) const {
+    const size_t affordable = memoryLimit / EstimateMemory(ChunkSize());
+    return std::clamp<size_t>(affordable, 1, workerCount);
+}
+
+size_t Compressor::MemoryPerInputByte() const {
+    return MEMORY_PER_INPUT_BYTE + Cmp::LzOptimal::MemoryPerByte(level);
+}
+
+size_t Compressor::EstimateMemory(size_t inputSize) const {
+    return inputSize * MemoryPerInputByte() + MemoryPerTask();
+}
+
+size_t Compressor::MemoryPerTask() const {
+    return ( textMode == TextMode::CONTEXT_MIXING ) ? Cmp::ContextMixing::MemoryUsage(contextMixingMemory) : 0;
+}
@@ -1,8 +1,119 @@
 #pragma once
 #include <string>
+#include <vector>
+#include <span>
+#include <fstream>
+#include <filesystem>
+#include <atomic>
+#include "bwt_block.h"
+#include "lz_optimal.h"
+#include "context_mixing.h"
+#include "FileFormat.h"
 
 class Compressor {
 public:
-    // ks
+    // 圧縮中に使う作業メモリの上限の既定値
+    static constexpr size_t DEFAULT_MEMORY_LIMIT = size_t(1) << 30;
+
+    // 内容から種類を推定できなかったデータで試すパイプライン (ビットの組み合わせ)
+    static constexpr unsigned TRIAL_STORE = 1 << 0;
+    static constexpr unsigned TRIAL_RLE = 1 << 1;
+    static constexpr unsigned TRIAL_LZ = 1 << 2;
+    static constexpr unsigned TRIAL_DELTA = 1 << 3;
+    static constexpr unsigned TRIAL_BWT = 1 << 4;
+    static constexpr unsigned DEFAULT_TRIAL_CANDIDATES = TRIAL_STORE | TRIAL_RLE | TRIAL_LZ | TRIAL_DELTA;
+    static constexpr unsigned ALL_TRIAL_CANDIDATES = DEFAULT_TRIAL_CANDIDATES | TRIAL_BWT;
+
+    // テキストと推定したデータの圧縮方式
+    enum class TextMode {
+        BWT,                // ブロック分割したBWT (高速)
+        CONTEXT_MIXING,     // コンテキストミキシング (圧縮率は高いが、圧縮・復号とも1MB/s程度)
+    };
+
+    // 圧縮処理を実行する
     bool CompressFolder(const std::string& sourceFolder, const std::string& outputFile);
+
+    // メモリ上のデータを、アーカイブの1エントリ (大きなファイルでは1フレーム) と同じ方法で圧縮し、algorithmId を返す
+    // 書き込まずに圧縮結果を確かめるためのもの (スレッドセーフ)
+    // threads はテキストのBWTブロックや試し圧縮を並列に処理するスレッド数 (呼び出し側が並列なら余った分だけを渡す)
+    uint8_t CompressBuffer(std::span<const char> data, std::vector<char>& compressedData, unsigned threads) const;
+    // ストリーム圧縮のチャンクサイズ (メモリ上限だけから決め、スレッド数によって出力が変わらないようにする)
+    size_t ChunkSize() const;
+    // inputSize バイトを圧縮するときの作業メモリの見積もり
+    size_t EstimateMemory(size_t inputSize) const;
+    size_t MemoryLimit() const { return memoryLimit; }
+
+    // テキスト用BWTのブロックサイズを設定する
+    void SetBwtBlockSize(size_t size) { bwtBlockSize = size; }
+    // 各パイプラインの最終段で使うエントロピー符号化器を設定する
+    void SetEntropy(Cmp::Entropy coder) { entropy = coder; }
+    // 並列に圧縮するスレッド数を設定する (0 はハードウェアの並列数)
+    void SetThreadCount(unsigned count) { threadCount = count; }
+    // 作業メモリの上限を設定する。大きなファイルはこの上限から決まるチャンク単位でストリーム圧縮する
+    void SetMemoryLimit(size_t bytes) { memoryLimit = bytes; }
+    // LZの圧縮レベル (1..9) を設定する。大きいほど一致探索が深く、ウィンドウが大きい
+    void SetLevel(int value) { level = value; }
+    // 試し圧縮の候補 (TRIAL_* の組み合わせ) を設定する
+    void SetTrialCandidates(unsigned candidates) { trialCandidates = candidates; }
+    // テキストの圧縮方式を設定する
+    void SetTextMode(TextMode mode) { textMode = mode; }
+    // コンテキストミキシングのモデルに使うメモリ (同時に圧縮するファイル・チャンクごとに確保する)
+    void SetContextMixingMemory(size_t bytes) { contextMixingMemory = bytes; }
+
+private:
+    // 1ファイル分の圧縮結果
+    struct CompressedFile {
+        bool ok = false;
+        bool streamed = false;          // true なら書き込みスレッドがチャンク単位で圧縮する
+        std::filesystem::path sourcePath;
+        size_t memoryCost = 0;          // 書き込みが終わるまで確保しておく作業メモリの見積もり
+        std::string relativePath;
+        Cmp::Algorithm algorithm = Cmp::Algorithm::STORE;
+        uint64_t originalSize = 0;
+        uint32_t checksum = 0;          // 元データの CRC32C
+        std::vector<char> data;
+    };
+
+    // ファイルを読み込み、アルゴリズムを選択して圧縮する (ワーカースレッドから呼ばれる)
+    // チャンクより大きなファイルは読み込まず、ストリーム圧縮の対象として返す
+    CompressedFile CompressFile(const std::filesystem::path& filePath, const std::string& sourceFolder, unsigned threads) const;
+    // データの内容 (ヘッダと標本の統計) からアルゴリズムを選び、メモリ上のデータを圧縮する
+    // 圧縮結果が元より小さくならなければ STORE に切り替える。threads は内部の並列処理に使うスレッド数
+    void CompressData(std::span<const char> data, Cmp::Algorithm& selectedAlgo, std::vector<char>& compressedData, unsigned threads) const;
+    // CompressData の本体 (アルゴリズムの選択と圧縮)
+    void SelectAndCompress(std::span<const char> data, Cmp::Algorithm& selectedAlgo, std::vector<char>& compressedData, unsigned threads) const;
+    // インデックスに載せる1エントリ分の情報
+    struct IndexRecord {
+        uint64_t dataOffset = 0;
+        uint8_t algorithmId = 0;
+        uint64_t originalSize = 0;
+        uint64_t compressedSize = 0;
+        uint32_t checksum = 0;
+        std::string relativePath;
+    };
+
+    // エントリヘッダ・ファイル名・圧縮データを書き込み、インデックス用の情報を返す
+    IndexRecord WriteEntry(std::ofstream& outFile, const CompressedFile& entry) const;
+    // 大きなファイルをチャンクごとに圧縮し、フレームとして順に書き込む (書き込みスレッドから呼ばれる)
+    // チャンクはワーカー (busyThreads 本を使用中) が使っていない分のスレッドで並列に圧縮する
+    bool WriteStreamedEntry(std::ofstream& outFile, const CompressedFile& entry, unsigned workerCount,
+        const std::atomic<unsigned>& busyThreads, IndexRecord& record) const;
+    // アーカイブ末尾にインデックスとフッタを書き込む
+    void WriteIndex(std::ofstream& outFile, const std::vector<IndexRecord>& index) const;
+
+    // ストリーム圧縮で同時に処理するチャンク数
+    size_t StreamSlots(unsigned workerCount) const;
+    // 入力1バイトあたりの作業メモリの見積もり (圧縮レベルの一致探索の分を含む)
+    size_t MemoryPerInputByte() const;
+    // 入力の大きさによらない1ファイル・1チャンクあたりの作業メモリ (コンテキストミキシングのモデル)
+    size_t MemoryPerTask() const;
+
+    size_t bwtBlockSize = Cmp::BwtBlock::DEFAULT_BLOCK_SIZE;
+    Cmp::Entropy entropy = Cmp::Entropy::ADAPTIVE_ARITHMETIC;
+    unsigned threadCount = 0;
+    size_t memoryLimit = DEFAULT_MEMORY_LIMIT;
+    int level = Cmp::LzOptimal::DEFAULT_LEVEL;
+    unsigned trialCandidates = DEFAULT_TRIAL_CANDIDATES;
+    TextMode textMode = TextMode::BWT;
+    size_t contextMixingMemory = Cmp::ContextMixing::DEFAULT_MEMORY;
 };
\ No newline at end of file
@@ -5,23 +5,166 @@
 #include <fstream>
 #include <vector>
 #include <filesystem>
+#include <iomanip>
+#include <sstream>
+#include <algorithm>
+#include <atomic>
 
 #include "lz77.h"
+#include "lz_optimal.h"
 #include "rle.h"
 #include "delta.h"
 #include "bwt.h"
+#include "bwt_block.h"
 #include "mtf.h"
 #include "huffman.h"
+#include "crc32c.h"
+#include "context_mixing.h"
 
 #include "exe_filter.h"
 #include "arithmetic_coder.h"
+#include "entropy_coder.h"
+#include "Parallel.h"
+#include "MappedFile.h"
 
 namespace fs = std::filesystem;
 
+const char* Decompressor::AlgorithmName(uint8_t algorithmId) {
+    switch ( Cmp::GetAlgorithm(algorithmId) ) {
+        case Cmp::Algorithm::STORE: return "STORE";
+        case Cmp::Algorithm::LZ77_HUFFMAN: return "LZ77";
+        case Cmp::Algorithm::RLE_HUFFMAN: return "RLE";
+        case Cmp::Algorithm::DELTA_HUFFMAN: return "DELTA";
+        case Cmp::Algorithm::BWT_HUFFMAN: return "BWT";
+        case Cmp::Algorithm::EXE_FILTER_LZ77_HUFFMAN: return "EXE";
+        case Cmp::Algorithm::BWT_BLOCK_HUFFMAN: return "BWT-BLOCK";
+        case Cmp::Algorithm::FRAMED: return "FRAMED";
+        case Cmp::Algorithm::LZ_OPTIMAL: return "LZOPT";
+        case Cmp::Algorithm::EXE_FILTER_LZ_OPTIMAL: return "EXE-LZOPT";
+        case Cmp::Algorithm::DELTA_LZ_OPTIMAL: return "DELTA-OPT";
+        case Cmp::Algorithm::BWT_BLOCK_ZERO_RUN: return "BWT-RLE0";
+        case Cmp::Algorithm::BWT_BLOCK_SEGMENTED: return "BWT-SEG";
+        case Cmp::Algorithm::DELTA_STRIDE_LZ_OPTIMAL: return "DELTA-N";
+        case Cmp::Algorithm::CONTEXT_MIXING: return "CM";
+        default: return "UNKNOWN";
+    }
+}
+
 bool Decompressor::DecompressArchive(const std::string& inputFile, const std::string& outputFolder) {
     Logger::Info("Decompression process started for file: {}", inputFile);
 
-    // 1. ̓t@CJ
+    // 1. アーカイブを開き、エントリ一覧を作る
+    std::vector<ArchiveEntry> entries;
+    if ( !OpenArchive(inputFile, entries) ) {
+        return false;
+    }
+
+    // 2. アーカイブ全体をマップする (各ワーカーはマップ上の圧縮データを直接参照する)
+    Cmp::MappedFile archive;
+    if ( !archive.OpenRead(inputFile) ) {
+        Logger::Error("Failed to map input file: {}", inputFile);
+        std::cerr << "Error: Failed to open input file " << inputFile << std::endl;
+        return false;
+    }
+
+    // 3. 出力先フォルダを作成
+    fs::create_directories(outputFolder);
+
+    // 4. 各エントリを並列に解凍する
+    const unsigned workerCount = Cmp::ResolveThreadCount(threadCount);
+    Logger::Info("Decompressing {} entries with {} worker thread(s).", entries.size(), workerCount);
+    // エントリの中の並列処理 (BWTブロックの逆変換) には、同時に解凍するエントリで分けた残りのスレッドだけを使う
+    const unsigned innerThreads = std::max<unsigned>(1, static_cast<unsigned>( workerCount / std::max<size_t>(1, std::min<size_t>(entries.size(), workerCount)) ));
+    std::atomic<size_t> failedCount{ 0 };
+    Cmp::ParallelFor(entries.size(), workerCount, [ & ] (size_t i) {
+        Logger::Info("Decompressing [{} / {}]: Path: '{}', Size: {}", i + 1, entries.size(), entries[i].relativePath, entries[i].compressedSize);
+        bool restored = false;
+        try {
+            restored = ExtractEntry(archive, entries[i], outputFolder, innerThreads);
+        }
+        catch ( const std::exception& e ) {
+            // 失敗した場合も他のファイルの処理は続ける
+            Logger::Error("  -> Failed to decompress '{}' ({})", entries[i].relativePath, e.what());
+        }
+        if ( !restored ) failedCount++;
+    });
+
+    // 壊れていたエントリがあれば、他のファイルを書き出した上で失敗を返す
+    if ( failedCount > 0 ) {
+        Logger::Error("{} of {} file(s) could not be restored.", failedCount.load(), entries.size());
+        std::cerr << "Error: " << failedCount.load() << " file(s) could not be restored." << std::endl;
+        return false;
+    }
+    Logger::Info("Decompression process successfully finished.");
+    return true;
+}
+
+bool Decompressor::ListArchive(const std::string& inputFile) {
+    std::vector<ArchiveEntry> entries;
+    if ( !OpenArchive(inputFile, entries) ) {
+        return false;
+    }
+
+    uint64_t totalOriginal = 0;
+    uint64_t totalCompressed = 0;
+    std::cout << "  Original  Compressed  Algorithm  CRC32C    Path\n";
+    for ( const auto& entry : entries ) {
+        std::ostringstream checksum;
+        if ( entry.hasChecksum ) checksum << std::hex << std::setfill('0') << std::setw(8) << entry.checksum;
+        else checksum << "-";
+        std::cout << std::setw(10) << entry.originalSize << "  "
+            << std::setw(10) << entry.compressedSize << "  "
+            << std::left << std::setw(9) << AlgorithmName(entry.algorithmId) << "  "
+            << std::setw(8) << checksum.str() << std::right << "  "
+            << entry.relativePath << "\n";
+        totalOriginal += entry.originalSize;
+        totalCompressed += entry.compressedSize;
+    }
+    std::cout << std::setw(10) << totalOriginal << "  " << std::setw(10) << totalCompressed
+        << "  " << entries.size() << " file(s)\n";
+    return true;
+}
+
+bool Decompressor::ExtractFile(const std::string& inputFile, const std::string& relativePath, const std::string& outputFolder) {
+    Logger::Info("Extracting '{}' from: {}", relativePath, inputFile);
+
+    std::vector<ArchiveEntry> entries;
+    if ( !OpenArchive(inputFile, entries) ) {
+        return false;
+    }
+
+    // 区切り文字の違い (Windows の '\\' と '/') は無視して比較する
+    auto normalize = [] (std::string path) {
+        std::replace(path.begin(), path.end(), '\\', '/');
+        return path;
+    };
+    const std::string target = normalize(relativePath);
+    auto it = std::find_if(entries.begin(), entries.end(), [ & ] (const ArchiveEntry& entry) {
+        return normalize(entry.relativePath) == target;
+    });
+    if ( it == entries.end() ) {
+        Logger::Error("File not found in archive: {}", relativePath);
+        std::cerr << "Error: '" << relativePath << "' was not found in " << inputFile << std::endl;
+        return false;
+    }
+
+    Cmp::MappedFile archive;
+    if ( !archive.OpenRead(inputFile) ) {
+        Logger::Error("Failed to map input file: {}", inputFile);
+        return false;
+    }
+    fs::create_directories(outputFolder);
+    try {
+        return ExtractEntry(archive, *it, outputFolder, Cmp::ResolveThreadCount(threadCount));
+    }
+    catch ( const std::exception& e ) {
+        Logger::Error("  -> Failed to decompress '{}' ({})", it->relativePath, e.what());
+        return false;
+    }
+}
+
+bool Decompressor::OpenArchive(const std::string& inputFile, std::vector<ArchiveEntry>& entries) const {
+    // (a) 入力ファイルを開く
     std::ifstream inFile(inputFile, std::ios::binary);
     if ( !inFile.is_open() ) {
         Logger::Error("Failed to open input file: {}", inputFile);
@@ -29,135 +172,362 @@ bool Decompressor::DecompressArchive(const std::string& inputFile, const std::st
         return false;
     }
 
-    // 2. S̃wb_ǂݍ݁A؂
+    // (b) 全体ヘッダを読み込み、検証する
     Cmp::GlobalHeader header;
     inFile.read(reinterpret_cast<char*>( &header ), sizeof(header));
 
-    if ( std::string(header.magic, 4) != "CMPC" ) {
+    if ( inFile.gcount() != sizeof(header) || std::string(header.magic, 4) != "CMPC" ) {
         Logger::Error("Invalid file format or not a CMPC file.");
         std::cerr << "Error: Invalid file format." << std::endl;
         return false;
     }
-    Logger::Info("Global header read. Version: {}, File count: {}", header.version, header.fileCount);
+    Logger::Info("Global header read. Version: {}", header.version);
 
-    // 3. o͐tH_쐬
-    fs::create_directories(outputFolder);
+    // (c) バージョンに応じてエントリ一覧を作る
+    bool indexRead = false;
+    if ( header.version == Cmp::FORMAT_VERSION_1 ) {
+        indexRead = ReadIndexV1(inFile, header.fileCount, entries);
+    }
+    else if ( header.version == Cmp::FORMAT_VERSION_2 || header.version == Cmp::FORMAT_VERSION_3 ) {
+        indexRead = ReadIndexV2(inFile, header.version == Cmp::FORMAT_VERSION_3, entries);
+    }
+    else {
+        Logger::Error("Unsupported format version: {}", header.version);
+        std::cerr << "Error: Unsupported format version " << static_cast<int>( header.version ) << "." << std::endl;
+        return false;
+    }
+
+    if ( !indexRead ) {
+        std::cerr << "Error: Corrupted archive." << std::endl;
+        return false;
+    }
+    return true;
+}
 
-    // 4. t@C[vĊet@C
-    for ( uint8_t i = 0; i < header.fileCount; ++i ) {
-        // (a) t@CGgwb_ǂݍ
+bool Decompressor::ReadIndexV1(std::ifstream& inFile, uint32_t fileCount, std::vector<ArchiveEntry>& entries) const {
+    entries.clear();
+    inFile.seekg(0, std::ios::end);
+    const uint64_t fileSize = static_cast<uint64_t>( inFile.tellg() );
+
+    // (a) 末尾のフッタを確認し、インデックスがあればそれを読む
+    Cmp::IndexFooter footer;
+    if ( fileSize >= sizeof(Cmp::GlobalHeader) + sizeof(footer) ) {
+        inFile.seekg(fileSize - sizeof(footer));
+        inFile.read(reinterpret_cast<char*>( &footer ), sizeof(footer));
+        const uint64_t indexEnd = fileSize - sizeof(footer);
+        if ( inFile.gcount() == sizeof(footer) && std::string(footer.magic, 4) == "CIDX" &&
+            footer.entryCount == fileCount && footer.indexOffset <= indexEnd ) {
+            inFile.seekg(footer.indexOffset);
+            bool valid = true;
+            for ( uint32_t i = 0; i < footer.entryCount && valid; ++i ) {
+                Cmp::IndexEntry indexEntry;
+                inFile.read(reinterpret_cast<char*>( &indexEntry ), sizeof(indexEntry));
+                ArchiveEntry entry;
+                entry.relativePath.resize(indexEntry.fileNameLength);
+                inFile.read(entry.relativePath.data(), indexEntry.fileNameLength);
+                entry.algorithmId = indexEntry.algorithmId;
+                entry.originalSize = indexEntry.originalSize;
+                entry.compressedSize = indexEntry.compressedSize;
+                entry.dataOffset = indexEntry.dataOffset;
+                valid = inFile.good() && entry.dataOffset + entry.compressedSize <= footer.indexOffset;
+                entries.push_back(std::move(entry));
+            }
+            if ( valid ) {
+                Logger::Info("Archive index read. Entries: {}", entries.size());
+                return true;
+            }
+            Logger::Error("Archive index is corrupted. Falling back to sequential scan.");
+            entries.clear();
+        }
+        inFile.clear();
+    }
+
+    // (b) インデックスが無ければ、エントリヘッダを順に読んでデータ部を読み飛ばす
+    inFile.seekg(sizeof(Cmp::GlobalHeader));
+    for ( uint32_t i = 0; i < fileCount; ++i ) {
         Cmp::FileEntryHeader entryHeader;
         inFile.read(reinterpret_cast<char*>( &entryHeader ), sizeof(entryHeader));
         if ( inFile.gcount() != sizeof(entryHeader) ) {
             Logger::Error("Failed to read file entry header for file #{}", i + 1);
-            return false; // wb_ǂ߂ȂΒvI
+            return false; // ヘッダが読めなければ致命的
         }
 
-        // (b) t@Cǂݍ
-        std::string relativePath(entryHeader.fileNameLength, '\0');
-        inFile.read(relativePath.data(), entryHeader.fileNameLength);
-
-        // (c) t@Cf[^ǂݍ
-        std::vector<char> compressedData(entryHeader.compressedSize);
-        inFile.read(compressedData.data(), entryHeader.compressedSize);
+        ArchiveEntry entry;
+        entry.relativePath.resize(entryHeader.fileNameLength);
+        inFile.read(entry.relativePath.data(), entryHeader.fileNameLength);
+        entry.algorithmId = entryHeader.algorithmId;
+        entry.originalSize = entryHeader.originalSize;
+        entry.compressedSize = entryHeader.compressedSize;
+        entry.dataOffset = static_cast<uint64_t>( inFile.tellg() );
+        if ( !inFile.good() || entry.dataOffset + entry.compressedSize > fileSize ) {
+            Logger::Error("File entry #{} exceeds the archive size.", i + 1);
+            return false;
+        }
+        inFile.seekg(entry.dataOffset + entry.compressedSize);
+        entries.push_back(std::move(entry));
+    }
+    return true;
+}
 
-        Logger::Info("Decompressing [{} / {}]: Path: '{}', Size: {}", i + 1, header.fileCount, relativePath, entryHeader.compressedSize);
+bool Decompressor::ReadIndexV2(std::ifstream& inFile, bool hasChecksum, std::vector<ArchiveEntry>& entries) const {
+    entries.clear();
+    inFile.seekg(0, std::ios::end);
+    const uint64_t fileSize = static_cast<uint64_t>( inFile.tellg() );
 
-        // (d) ASYɉĉ𓀏
-        std::vector<char> decompressedData;
-        bool success = true;
+    // (a) 末尾のフッタを読む
+    Cmp::IndexFooterV2 footer;
+    if ( fileSize < sizeof(Cmp::GlobalHeader) + sizeof(footer) ) {
+        Logger::Error("Archive is too small to contain an index.");
+        return false;
+    }
+    const uint64_t indexEnd = fileSize - sizeof(footer);
+    inFile.seekg(indexEnd);
+    inFile.read(reinterpret_cast<char*>( &footer ), sizeof(footer));
+    if ( inFile.gcount() != sizeof(footer) || std::string(footer.magic, 4) != "CID2" ||
+        footer.indexOffset < sizeof(Cmp::GlobalHeader) || footer.indexOffset > indexEnd ) {
+        Logger::Error("Archive index footer is missing or corrupted.");
+        return false;
+    }
 
-        // ύX
-        auto algorithm = static_cast<Cmp::Algorithm>( entryHeader.algorithmId );
-        if ( algorithm == Cmp::Algorithm::STORE ) {
-            // STORE[hȂ̂ŁAǂݍ񂾃f[^̂܂܌̃f[^
-            decompressedData = compressedData;
-        }
-        else if ( algorithm == Cmp::Algorithm::LZ77_HUFFMAN ) {
-            // ύX
-            // 1. Huffman𓀂LZ77̃oCgɖ߂
-            auto lz77_bytes = Cmp::ArithmeticCoder::Decompress(compressedData);
-
-            // 2. oCgg[NXgɃfVACY
-            auto lz77_tokens = Cmp::Lz77::DeserializeTokens(lz77_bytes);
-            if ( lz77_tokens.empty() && !compressedData.empty() ) {
-                Logger::Error("  -> LZ77 Deserialization failed.");
-                success = false;
-            }
-            else {
-                // 2. g[NXg猳̃f[^𕜌
-                decompressedData = Cmp::Lz77::Decompress(lz77_tokens);
-            }
+    // (b) 各エントリを読む (破損したアーカイブで巨大な予約をしないよう、件数はインデックスの長さで抑える)
+    inFile.seekg(footer.indexOffset);
+    entries.reserve(static_cast<size_t>( std::min<uint64_t>(footer.entryCount, indexEnd - footer.indexOffset) ));
+    for ( uint64_t i = 0; i < footer.entryCount; ++i ) {
+        ArchiveEntry entry;
+        uint64_t nameLength = 0;
+        int algorithmId = 0;
+        bool valid = Cmp::ReadVarint(inFile, entry.dataOffset);
+        valid = valid && ( algorithmId = inFile.get() ) != std::istream::traits_type::eof();
+        valid = valid && Cmp::ReadVarint(inFile, nameLength);
+        valid = valid && Cmp::ReadVarint(inFile, entry.originalSize);
+        valid = valid && Cmp::ReadVarint(inFile, entry.compressedSize);
+        valid = valid && ( !hasChecksum || Cmp::ReadUint32(inFile, entry.checksum) );
+        valid = valid && nameLength <= indexEnd - static_cast<uint64_t>( inFile.tellg() );
+        if ( valid ) {
+            entry.hasChecksum = hasChecksum;
+            entry.algorithmId = static_cast<uint8_t>( algorithmId );
+            entry.relativePath.resize(static_cast<size_t>( nameLength ));
+            inFile.read(entry.relativePath.data(), nameLength);
+            valid = inFile.good() && entry.dataOffset <= footer.indexOffset &&
+                entry.compressedSize <= footer.indexOffset - entry.dataOffset;
         }
-        else if ( algorithm == Cmp::Algorithm::RLE_HUFFMAN ) { //  ̃ubNǉ
-            auto rle_bytes = Cmp::ArithmeticCoder::Decompress(compressedData);
-            decompressedData = Cmp::Rle::Decompress(rle_bytes);
+        if ( !valid ) {
+            Logger::Error("Archive index entry #{} is corrupted.", i + 1);
+            return false;
         }
-        else if ( algorithm == Cmp::Algorithm::DELTA_HUFFMAN ) {
-            // 1. Huffman
-            auto lz77_bytes = Cmp::ArithmeticCoder::Decompress(compressedData);
-            // 2. LZ77
-            auto lz77_tokens = Cmp::Lz77::DeserializeTokens(lz77_bytes);
-            auto delta_bytes = Cmp::Lz77::Decompress(lz77_tokens);
-            // 3. ŌDeltatϊ
-            decompressedData = Cmp::Delta::Decompress(delta_bytes);
-        }
-        else if ( algorithm == Cmp::Algorithm::BWT_HUFFMAN ) {
-            // 1. Huffman -> MTFtϊ
-            auto mtf_bytes = Cmp::ArithmeticCoder::Decompress(compressedData);
-            auto bwt_serialized = Cmp::Mtf::InverseTransform(mtf_bytes);
-
-            // 2. indexBWTf[^𕪗
-            uint32_t index = 0;
-            index |= static_cast<uint32_t>( static_cast<uint8_t>( bwt_serialized[0] ) ) << 24;
-            index |= static_cast<uint32_t>( static_cast<uint8_t>( bwt_serialized[1] ) ) << 16;
-            index |= static_cast<uint32_t>( static_cast<uint8_t>( bwt_serialized[2] ) ) << 8;
-            index |= static_cast<uint32_t>( static_cast<uint8_t>( bwt_serialized[3] ) );
-
-            std::vector<char> bwt_data(bwt_serialized.begin() + 4, bwt_serialized.end());
-
-            // 3. BWTtϊ
-            decompressedData = Cmp::Bwt::InverseTransform({ bwt_data, index });
-        }
-        else if ( algorithm == Cmp::Algorithm::EXE_FILTER_LZ77_HUFFMAN ) { //  ̃ubNǉ
-            auto lz77_bytes = Cmp::ArithmeticCoder::Decompress(compressedData);
-            auto lz77_tokens = Cmp::Lz77::DeserializeTokens(lz77_bytes);
-            auto filtered_data = Cmp::Lz77::Decompress(lz77_tokens);
-            decompressedData = Cmp::ExeFilter::InverseTransform(filtered_data);
-        }
-        else {
-            Logger::Error("  -> Unsupported algorithm ID: {}", entryHeader.algorithmId);
+        entries.push_back(std::move(entry));
+    }
+    Logger::Info("Archive index read. Entries: {}", entries.size());
+    return true;
+}
+
+bool Decompressor::ExtractEntry(const Cmp::MappedFile& archive, const ArchiveEntry& entry, const std::string& outputFolder, unsigned threads) const {
+    if ( entry.dataOffset > archive.Size() || entry.compressedSize > archive.Size() - entry.dataOffset ) {
+        Logger::Error("  -> Compressed data exceeds the archive size: '{}'", entry.relativePath);
+        return false;
+    }
+    if ( Cmp::GetAlgorithm(entry.algorithmId) == Cmp::Algorithm::FRAMED ) {
+        return ExtractFramedEntry(archive, entry, outputFolder, threads);
+    }
+
+    // (a) マップ上の圧縮データをコピーせずに参照する
+    std::span<const char> compressedData(archive.Data() + entry.dataOffset, entry.compressedSize);
+
+    // (b) アルゴリズムに応じて解凍処理
+    std::vector<char> decompressedData;
+    if ( !DecodeData(entry.algorithmId, compressedData, decompressedData, entry.originalSize, threads) ) {
+        return false;
+    }
+
+    // (c) 元のサイズと CRC32C を確かめてから、出力ファイルを作成してマップし、書き出す
+    if ( decompressedData.size() != entry.originalSize ) {
+        Logger::Error("  -> Decompression size mismatch. Expected: {}, Actual: {}", entry.originalSize, decompressedData.size());
+        return false;
+    }
+    if ( entry.hasChecksum && Cmp::Crc32c::Compute(decompressedData) != entry.checksum ) {
+        Logger::Error("  -> Checksum mismatch in '{}'. The archive is corrupted.", entry.relativePath);
+        return false;
+    }
+
+    fs::path finalOutputPath = fs::path(outputFolder) / entry.relativePath;
+    if ( finalOutputPath.has_parent_path() ) {
+        fs::create_directories(finalOutputPath.parent_path());
+    }
+
+    Cmp::MappedFile outFile;
+    if ( !outFile.Create(finalOutputPath, entry.originalSize) ) {
+        Logger::Error("  -> Failed to create output file: {}", finalOutputPath.string());
+        return false;
+    }
+    std::copy(decompressedData.begin(), decompressedData.end(), outFile.MutableData());
+    outFile.Close();
+    Logger::Info("  -> File successfully restored: '{}'", entry.relativePath);
+    return true;
+}
+
+bool Decompressor::ExtractFramedEntry(const Cmp::MappedFile& archive, const ArchiveEntry& entry, const std::string& outputFolder, unsigned threads) const {
+    fs::path finalOutputPath = fs::path(outputFolder) / entry.relativePath;
+    if ( finalOutputPath.has_parent_path() ) {
+        fs::create_directories(finalOutputPath.parent_path());
+    }
+    Cmp::MappedFile outFile;
+    if ( !outFile.Create(finalOutputPath, entry.originalSize) ) {
+        Logger::Error("  -> Failed to create output file: {}", finalOutputPath.string());
+        return false;
+    }
+
+    // フレームを1つずつ解凍し、出力ファイルのマップ上の位置に書き込む (メモリに載るのは1フレーム分だけ)
+    const char* pos = archive.Data() + entry.dataOffset;
+    const char* end = pos + entry.compressedSize;
+    uint64_t restored = 0;
+    uint32_t checksum = 0;
+    bool success = true;
+    std::vector<char> decompressedData; // フレーム間で使い回す
+    while ( success && pos < end ) {
+        const uint8_t algorithmId = static_cast<uint8_t>( *pos++ );
+        uint64_t frameOriginalSize = 0;
+        uint64_t frameCompressedSize = 0;
+        uint32_t frameChecksum = 0;
+        if ( !Cmp::ReadVarint(pos, end, frameOriginalSize) || !Cmp::ReadVarint(pos, end, frameCompressedSize) ||
+            ( entry.hasChecksum && !Cmp::ReadUint32(pos, end, frameChecksum) ) ||
+            frameCompressedSize > static_cast<uint64_t>( end - pos ) || frameOriginalSize > entry.originalSize - restored ) {
+            Logger::Error("  -> Corrupted frame header in '{}'", entry.relativePath);
             success = false;
+            break;
         }
 
-        // (e) t@Cɏo
-        if ( success && decompressedData.size() != entryHeader.originalSize ) {
-            Logger::Error("  -> Decompression size mismatch. Expected: {}, Actual: {}", entryHeader.originalSize, decompressedData.size());
+        std::span<const char> compressedData(pos, frameCompressedSize);
+        pos += frameCompressedSize;
+        success = DecodeData(algorithmId, compressedData, decompressedData, frameOriginalSize, threads);
+        if ( success && decompressedData.size() != frameOriginalSize ) {
+            Logger::Error("  -> Frame size mismatch. Expected: {}, Actual: {}", frameOriginalSize, decompressedData.size());
             success = false;
         }
-
+        // 壊れたフレームはその場で見つけ、ファイル全体の CRC32C はフレームの順に続けて計算する
+        if ( success && entry.hasChecksum ) {
+            const uint32_t actual = Cmp::Crc32c::Compute(decompressedData);
+            checksum = Cmp::Crc32c::Update(checksum, decompressedData);
+            if ( actual != frameChecksum ) {
+                Logger::Error("  -> Checksum mismatch in frame at offset {} of '{}'. The archive is corrupted.", restored, entry.relativePath);
+                success = false;
+            }
+        }
         if ( success ) {
-            fs::path finalOutputPath = fs::path(outputFolder) / relativePath;
+            std::copy(decompressedData.begin(), decompressedData.end(), outFile.MutableData() + restored);
+            restored += decompressedData.size();
+        }
+    }
+    if ( success && restored != entry.originalSize ) {
+        Logger::Error("  -> Decompression size mismatch. Expected: {}, Actual: {}", entry.originalSize, restored);
+        success = false;
+    }
+    if ( success && entry.hasChecksum && checksum != entry.checksum ) {
+        Logger::Error("  -> Checksum mismatch in '{}'. The archive is corrupted.", entry.relativePath);
+        success = false;
+    }
 
-            if ( finalOutputPath.has_parent_path() ) {
-                fs::create_directories(finalOutputPath.parent_path());
-            }
+    outFile.Close();
+    if ( !success ) {
+        // 書きかけのファイルは残さない
+        std::error_code ec;
+        fs::remove(finalOutputPath, ec);
+        return false;
+    }
+    Logger::Info("  -> File successfully restored: '{}'", entry.relativePath);
+    return true;
+}
 
-            std::ofstream outFile(finalOutputPath, std::ios::binary);
-            if ( !outFile.is_open() ) {
-                Logger::Error("  -> Failed to create output file: {}", finalOutputPath.string());
-                continue; // ̃t@C̏𑱂
-            }
-            outFile.write(decompressedData.data(), decompressedData.size());
-            outFile.close();
-            Logger::Info("  -> File successfully restored.");
+bool Decompressor::DecodeData(uint8_t algorithmId, std::span<const char> compressedData, std::vector<char>& decompressedData, uint64_t maxSize, unsigned threads) const {
+    bool success = true;
+    // エントロピー復号の出力の上限。前段の形式で元の1バイトあたりが最大 bytesPerByte バイトになる
+    auto entropyLimit = [ maxSize ] (uint64_t bytesPerByte) {
+        return static_cast<size_t>( std::min<uint64_t>(maxSize, SIZE_MAX / bytesPerByte) * bytesPerByte );
+    };
+    // 各段の出力は work と decompressedData の2つのバッファを交互に使い回す
+    std::vector<char> work;
+
+    // ★ここから変更★
+    auto algorithm = Cmp::GetAlgorithm(algorithmId);
+    auto entropy = Cmp::GetEntropy(algorithmId);
+    const bool usesEntropy = ( algorithm != Cmp::Algorithm::STORE && algorithm != Cmp::Algorithm::CONTEXT_MIXING );
+    if ( usesEntropy && !Cmp::EntropyCoder::IsSupported(entropy) ) {
+        Logger::Error("  -> Unsupported entropy coder ID: {}", static_cast<int>( entropy ));
+        success = false;
+    }
+    else if ( algorithm == Cmp::Algorithm::STORE ) {
+        // STOREモードなので、読み込んだデータがそのまま元のデータ
+        decompressedData.assign(compressedData.begin(), compressedData.end());
+    }
+    else if ( algorithm == Cmp::Algorithm::LZ77_HUFFMAN ) {
+        // ★ここから変更★
+        // 1. Huffman解凍でLZ77のバイト列に戻す (4バイトのトークンは元の1バイト以上を表す)
+        Cmp::EntropyCoder::Decompress(compressedData, entropy, work, entropyLimit(sizeof(Cmp::Lz77Token)));
+
+        // 2. バイト列のトークンから直接元のデータを復元
+        if ( !Cmp::Lz77::DecompressSerialized(work, decompressedData) ) {
+            Logger::Error("  -> LZ77 Deserialization failed.");
+            success = false;
+        }
+    }
+    else if ( algorithm == Cmp::Algorithm::RLE_HUFFMAN ) { // ★ このブロックを追加
+        // RLE は元の1バイトを最大3バイト (マーカー + 長さ + 値) にする
+        Cmp::EntropyCoder::Decompress(compressedData, entropy, work, entropyLimit(3));
+        Cmp::Rle::Decompress(work, decompressedData);
+    }
+    else if ( algorithm == Cmp::Algorithm::DELTA_HUFFMAN ) {
+        // 1. Huffman解凍
+        Cmp::EntropyCoder::Decompress(compressedData, entropy, work, entropyLimit(sizeof(Cmp::Lz77Token)));
+        // 2. LZ77解凍
+        Cmp::Lz77::DecompressSerialized(work, decompressedData);
+        // 3. 最後にDelta逆変換 (その場で行う)
+        Cmp::Delta::DecompressInPlace(decompressedData);
+    }
+    else if ( algorithm == Cmp::Algorithm::BWT_HUFFMAN ) {
+        // 単一ブロック形式 (index + BWT データを MTF -> 算術符号化したもの)
+        Cmp::BwtBlock::DecompressBlock(compressedData, entropy, Cmp::BwtBlock::Stage::MTF, Cmp::BwtBlock::Header::PRIMARY_INDEX, decompressedData);
+    }
+    else if ( algorithm == Cmp::Algorithm::BWT_BLOCK_HUFFMAN ) {
+        // 各ブロックを並列に逆変換する
+        Cmp::BwtBlock::Decompress(compressedData, entropy, Cmp::BwtBlock::Stage::MTF, Cmp::BwtBlock::Header::PRIMARY_INDEX, decompressedData, threads);
+    }
+    else if ( algorithm == Cmp::Algorithm::BWT_BLOCK_ZERO_RUN ) {
+        Cmp::BwtBlock::Decompress(compressedData, entropy, Cmp::BwtBlock::Stage::MTF_ZERO_RUN, Cmp::BwtBlock::Header::PRIMARY_INDEX, decompressedData, threads);
+    }
+    else if ( algorithm == Cmp::Algorithm::BWT_BLOCK_SEGMENTED ) {
+        Cmp::BwtBlock::Decompress(compressedData, entropy, Cmp::BwtBlock::Stage::MTF_ZERO_RUN, Cmp::BwtBlock::Header::SEGMENT_STARTS, decompressedData, threads);
+    }
+    else if ( algorithm == Cmp::Algorithm::EXE_FILTER_LZ77_HUFFMAN ) { // ★ このブロックを追加
+        Cmp::EntropyCoder::Decompress(compressedData, entropy, work, entropyLimit(sizeof(Cmp::Lz77Token)));
+        Cmp::Lz77::DecompressSerialized(work, decompressedData);
+        Cmp::ExeFilter::InverseTransformInPlace(decompressedData);
+    }
+    else if ( algorithm == Cmp::Algorithm::LZ_OPTIMAL ) {
+        Cmp::LzOptimal::Decompress(compressedData, entropy, decompressedData, maxSize);
+    }
+    else if ( algorithm == Cmp::Algorithm::EXE_FILTER_LZ_OPTIMAL ) {
+        Cmp::LzOptimal::Decompress(compressedData, entropy, decompressedData, maxSize);
+        Cmp::ExeFilter::InverseTransformInPlace(decompressedData);
+    }
+    else if ( algorithm == Cmp::Algorithm::DELTA_LZ_OPTIMAL ) {
+        Cmp::LzOptimal::Decompress(compressedData, entropy, decompressedData, maxSize);
+        Cmp::Delta::DecompressInPlace(decompressedData);
+    }
+    else if ( algorithm == Cmp::Algorithm::DELTA_STRIDE_LZ_OPTIMAL ) {
+        const int stride = compressedData.empty() ? 0 : static_cast<uint8_t>( compressedData[0] );
+        if ( stride > 0 ) {
+            Cmp::LzOptimal::Decompress(compressedData.subspan(1), entropy, decompressedData, maxSize);
+            Cmp::Delta::DecompressInPlace(decompressedData, stride);
         }
         else {
-            // sꍇ͎̃t@C̏𑱂
-            continue;
+            decompressedData.clear();
         }
     }
-
-    Logger::Info("Decompression process successfully finished.");
-    return true;
-}
\ No newline at end of file
+    else if ( algorithm == Cmp::Algorithm::CONTEXT_MIXING ) {
+        Cmp::ContextMixing::Decompress(compressedData, decompressedData);
+    }
+    else {
+        Logger::Error("  -> Unsupported algorithm ID: {}", algorithmId);
+        success = false;
+    }
+    return success;
+}
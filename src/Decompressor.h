@@ -1,8 +1,54 @@
 #pragma once
 #include <string>
+#include <vector>
+#include <span>
+#include <fstream>
+#include <cstdint>
+#include "MappedFile.h"
 
 class Decompressor {
 public:
-    // 𓀏s
+    // 解凍処理を実行する
     bool DecompressArchive(const std::string& inputFile, const std::string& outputFolder);
+
+    // アーカイブ内のファイル一覧を表示する (データは解凍しない)
+    bool ListArchive(const std::string& inputFile);
+    // 指定したファイルだけを解凍する (インデックスからそのエントリへ直接シークする)
+    bool ExtractFile(const std::string& inputFile, const std::string& relativePath, const std::string& outputFolder);
+
+    // 並列に解凍するスレッド数を設定する (0 はハードウェアの並列数)
+    void SetThreadCount(unsigned count) { threadCount = count; }
+
+    // アルゴリズムIDに応じて圧縮データを元に戻す (スレッドセーフ)
+    // maxSize は元のデータの大きさの上限 (エントリやフレームの元サイズ)。壊れたヘッダで巨大な出力を確保しないよう、各段の復号をこれで制限する
+    // threads はBWTブロックを並列に逆変換するスレッド数 (呼び出し側が並列なら余った分だけを渡す)
+    bool DecodeData(uint8_t algorithmId, std::span<const char> compressedData, std::vector<char>& decompressedData, uint64_t maxSize, unsigned threads) const;
+    // 一覧表示用のアルゴリズム名
+    static const char* AlgorithmName(uint8_t algorithmId);
+
+private:
+    // アーカイブ内の1エントリの位置と属性
+    struct ArchiveEntry {
+        std::string relativePath;
+        uint8_t algorithmId = 0;
+        uint64_t originalSize = 0;
+        uint64_t compressedSize = 0;
+        uint64_t dataOffset = 0;
+        bool hasChecksum = false;       // バージョン3以降は元データの CRC32C を持つ (フレームごとにも持つ)
+        uint32_t checksum = 0;
+    };
+
+    // アーカイブを開いてヘッダを検証し、エントリ一覧を読む
+    bool OpenArchive(const std::string& inputFile, std::vector<ArchiveEntry>& entries) const;
+    // バージョン1: 末尾のインデックスからエントリ一覧を読む。インデックスが無い古いアーカイブはヘッダを順に走査する
+    bool ReadIndexV1(std::ifstream& inFile, uint32_t fileCount, std::vector<ArchiveEntry>& entries) const;
+    // バージョン2・3: 末尾のフッタが指す可変長整数のインデックスを読む (バージョン3は各エントリに CRC32C を持つ)
+    bool ReadIndexV2(std::ifstream& inFile, bool hasChecksum, std::vector<ArchiveEntry>& entries) const;
+    // マップしたアーカイブから1エントリを解凍し、出力先に書き出す (ワーカースレッドから呼ばれる)
+    // threads はエントリの中の並列処理に使うスレッド数
+    bool ExtractEntry(const Cmp::MappedFile& archive, const ArchiveEntry& entry, const std::string& outputFolder, unsigned threads) const;
+    // チャンク単位のフレーム列を1フレームずつ解凍して書き出す
+    bool ExtractFramedEntry(const Cmp::MappedFile& archive, const ArchiveEntry& entry, const std::string& outputFolder, unsigned threads) const;
+
+    unsigned threadCount = 0;
 };
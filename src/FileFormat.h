@@ -1,26 +1,66 @@
 #pragma once
 #include <cstdint>
+#include <istream>
+#include <ostream>
+#include <vector>
 
-// RpCɂ]vȃpfBO𖳌ɂAt@C\ƃ̍\v
+// コンパイラによる余計なパディングを無効にし、ファイル構造とメモリ上の構造を一致させる
 #pragma pack(push, 1)
 
 namespace Cmp {
-    // .cmpt@C̑S̃wb_
+    // フォーマットバージョン
+    // 1: 固定長ヘッダ (ファイル数255・ファイル名255バイト・サイズ4GBまで)
+    // 2: 可変長整数のヘッダ (件数・ファイル名長・サイズの上限なし)。件数は末尾のインデックスに持つ
+    // 3: バージョン2の各エントリとフレームに元データの CRC32C (4バイト、リトルエンディアン) を加えたもの
+    constexpr uint8_t FORMAT_VERSION_1 = 1;
+    constexpr uint8_t FORMAT_VERSION_2 = 2;
+    constexpr uint8_t FORMAT_VERSION_3 = 3;
+
+    // .cmpファイルの全体ヘッダ
     struct GlobalHeader {
-        char magic[4];      // }WbNio[ "CMPC"
-        uint8_t version;    // tH[}bgo[W
-        uint8_t fileCount;  // t@C
+        char magic[4];      // マジックナンバー "CMPC"
+        uint8_t version;    // フォーマットバージョン
+        uint8_t fileCount;  // ファイル数 (バージョン2以降は未使用で0)
     };
 
-    // et@CGg̃wb_
+    // 各ファイルエントリのヘッダ (バージョン1)
+    // バージョン2では algorithmId(1) + varint ファイル名長 + varint 元サイズ + varint 圧縮後サイズ
+    // バージョン3ではその後に CRC32C(4) が続く
     struct FileEntryHeader {
-        uint8_t algorithmId;        // ASYID
-        uint8_t fileNameLength;     // t@C̒
-        uint32_t originalSize;      // ̃t@CTCY
-        uint32_t compressedSize;    // k̃f[^TCY
+        uint8_t algorithmId;        // アルゴリズムID
+        uint8_t fileNameLength;     // ファイル名の長さ
+        uint32_t originalSize;      // 元のファイルサイズ
+        uint32_t compressedSize;    // 圧縮後のデータサイズ
+    };
+
+    // アーカイブ末尾のインデックスの1エントリ (バージョン1、直後にファイル名が続く)
+    // バージョン2では varint 位置 + algorithmId(1) + varint ファイル名長 + varint 元サイズ + varint 圧縮後サイズ
+    // (バージョン3ではその後に CRC32C(4))
+    // 各エントリの位置が分かるので、ヘッダを順に読まずに任意のエントリへシークできる
+    struct IndexEntry {
+        uint64_t dataOffset;        // 圧縮データの先頭位置 (ファイル先頭からのバイト数)
+        uint8_t algorithmId;        // アルゴリズムID
+        uint8_t fileNameLength;     // ファイル名の長さ
+        uint32_t originalSize;      // 元のファイルサイズ
+        uint32_t compressedSize;    // 圧縮後のデータサイズ
+    };
+
+    // ファイル末尾に置くインデックスのフッタ
+    // 従来のデコーダは fileCount 個のエントリだけを読むので、末尾のインデックスは無視される
+    struct IndexFooter {
+        uint64_t indexOffset;       // インデックス先頭の位置
+        uint32_t entryCount;        // インデックスのエントリ数
+        char magic[4];              // マジックナンバー "CIDX"
     };
 
-    // ASYID̒`
+    // バージョン2・3のインデックスのフッタ (件数を64ビットで持つ)
+    struct IndexFooterV2 {
+        uint64_t indexOffset;       // インデックス先頭の位置
+        uint64_t entryCount;        // インデックスのエントリ数
+        char magic[4];              // マジックナンバー "CID2"
+    };
+
+    // アルゴリズムIDの定義
     enum class Algorithm : uint8_t {
         STORE = 0,
         LZ77_HUFFMAN = 1,
@@ -28,7 +68,112 @@ namespace Cmp {
         DELTA_HUFFMAN = 3,
         BWT_HUFFMAN = 4,
         EXE_FILTER_LZ77_HUFFMAN = 5,
+        BWT_BLOCK_HUFFMAN = 6,      // ブロック分割したBWT (各ブロックが独立したインデックスを持つ)
+        FRAMED = 7,                 // チャンクごとに独立して圧縮したフレームの列 (大きなファイル用)
+                                    // 各フレーム: algorithmId(1) + varint 元サイズ + varint 圧縮後サイズ (+ バージョン3では CRC32C(4)) + データ
+        LZ_OPTIMAL = 8,             // 最適パースのLZ (リテラル・コマンド・長さ・オフセットを別ストリームで符号化)
+        EXE_FILTER_LZ_OPTIMAL = 9,  // EXEフィルタ -> 最適パースのLZ
+        DELTA_LZ_OPTIMAL = 10,      // Delta -> 最適パースのLZ
+        BWT_BLOCK_ZERO_RUN = 11,    // ブロック分割したBWT -> MTF+RLE0 (0の連続を全単射2進数で短くする)
+        BWT_BLOCK_SEGMENTED = 12,   // BWT_BLOCK_ZERO_RUN に各ブロックの区間ごとの開始行を加え、区間を並列に逆変換できるようにしたもの
+        DELTA_STRIDE_LZ_OPTIMAL = 13,   // [stride(1)] + 差分 -> 最適パースのLZ (DELTA_LZ_OPTIMAL は stride 4 固定)
+        CONTEXT_MIXING = 14,        // ビット単位のコンテキストミキシング (エントロピー符号化器は使わず、上位4ビットは無視する)
+    };
+
+    // エントロピー符号化器の定義 (algorithmId の上位4ビットに格納する)
+    // 0 は従来の静的オーダー1算術符号なので、既存のアーカイブはそのまま読める
+    enum class Entropy : uint8_t {
+        STATIC_ARITHMETIC = 0,
+        ADAPTIVE_ARITHMETIC = 1,
+        RANS = 2,                   // 4状態インターリーブrANS (高速復号向け)
+        HUFFMAN = 3,                // 長さ制限付き正準ハフマン (表引きで複数シンボルを復号する最速の符号化器)
     };
+
+    // algorithmId = 下位4ビット: 変換パイプライン (Algorithm), 上位4ビット: Entropy
+    constexpr uint8_t MakeAlgorithmId(Algorithm algorithm, Entropy entropy) {
+        return static_cast<uint8_t>( ( static_cast<uint8_t>( entropy ) << 4 ) | static_cast<uint8_t>( algorithm ) );
+    }
+    constexpr Algorithm GetAlgorithm(uint8_t algorithmId) {
+        return static_cast<Algorithm>( algorithmId & 0x0F );
+    }
+    constexpr Entropy GetEntropy(uint8_t algorithmId) {
+        return static_cast<Entropy>( algorithmId >> 4 );
+    }
+
+    // 64ビット値を表す可変長整数の最大バイト数
+    constexpr size_t MAX_VARINT_LENGTH = 10;
+
+    // 可変長整数 (LEB128: 下位から7ビットずつ、最上位ビットは継続フラグ) を書き込む
+    // minLength を指定すると冗長な継続バイトで長さを揃える (後から同じ位置に値を書き直すため)
+    inline void WriteVarint(std::ostream& out, uint64_t value, size_t minLength = 0) {
+        char buf[MAX_VARINT_LENGTH];
+        size_t len = 0;
+        do {
+            uint8_t byte = static_cast<uint8_t>( value & 0x7F );
+            value >>= 7;
+            if ( value != 0 || len + 1 < minLength ) byte |= 0x80;
+            buf[len++] = static_cast<char>( byte );
+        } while ( value != 0 || len < minLength );
+        out.write(buf, len);
+    }
+
+    // メモリ上のバッファの末尾に可変長整数を追加する
+    inline void WriteVarint(std::vector<char>& out, uint64_t value) {
+        do {
+            uint8_t byte = static_cast<uint8_t>( value & 0x7F );
+            value >>= 7;
+            if ( value != 0 ) byte |= 0x80;
+            out.push_back(static_cast<char>( byte ));
+        } while ( value != 0 );
+    }
+
+    // 可変長整数を読み込む。途中で終端に達したか10バイトを超えた場合は false
+    inline bool ReadVarint(std::istream& in, uint64_t& value) {
+        value = 0;
+        for ( int shift = 0; shift < 64; shift += 7 ) {
+            int c = in.get();
+            if ( c == std::istream::traits_type::eof() ) return false;
+            value |= static_cast<uint64_t>( c & 0x7F ) << shift;
+            if ( ( c & 0x80 ) == 0 ) return true;
+        }
+        return false;
+    }
+
+    // 32ビット値をリトルエンディアンの4バイトで書き込む
+    inline void WriteUint32(std::ostream& out, uint32_t value) {
+        char buf[4];
+        for ( int i = 0; i < 4; ++i ) buf[i] = static_cast<char>( value >> ( i * 8 ) );
+        out.write(buf, 4);
+    }
+
+    // リトルエンディアンの32ビット値を読み込む。途中で終端に達した場合は false
+    inline bool ReadUint32(std::istream& in, uint32_t& value) {
+        char buf[4];
+        if ( !in.read(buf, 4) ) return false;
+        value = 0;
+        for ( int i = 3; i >= 0; --i ) value = ( value << 8 ) | static_cast<uint8_t>( buf[i] );
+        return true;
+    }
+
+    // メモリ上のバッファからリトルエンディアンの32ビット値を読み込み、pos を進める
+    inline bool ReadUint32(const char*& pos, const char* end, uint32_t& value) {
+        if ( end - pos < 4 ) return false;
+        value = 0;
+        for ( int i = 3; i >= 0; --i ) value = ( value << 8 ) | static_cast<uint8_t>( pos[i] );
+        pos += 4;
+        return true;
+    }
+
+    // メモリ上のバッファから可変長整数を読み込み、pos を進める
+    inline bool ReadVarint(const char*& pos, const char* end, uint64_t& value) {
+        value = 0;
+        for ( int shift = 0; shift < 64 && pos < end; shift += 7 ) {
+            const uint8_t c = static_cast<uint8_t>( *pos++ );
+            value |= static_cast<uint64_t>( c & 0x7F ) << shift;
+            if ( ( c & 0x80 ) == 0 ) return true;
+        }
+        return false;
+    }
 }
 
 #pragma pack(pop)
\ No newline at end of file
@@ -3,11 +3,13 @@
 #include <fstream>
 #include <chrono>
 #include <format>
+#include <mutex>
 
 class Logger {
 public:
-    // Ot@C
+    // ログファイルを初期化
     static bool Init(const std::string& logFilePath) {
+        std::lock_guard<std::mutex> lock(logMutex);
         logFile.open(logFilePath, std::ios::out | std::ios::trunc);
         if ( !logFile.is_open() ) {
             return false;
@@ -15,26 +17,29 @@ public:
         return true;
     }
 
-    // ʏ̃OL^
+    // 通常のログを記録
     template<typename... Args>
     static void Info(const std::string_view format_str, Args&&... args) {
+        std::lock_guard<std::mutex> lock(logMutex);
         if ( logFile.is_open() ) {
             auto now = std::chrono::system_clock::now();
             logFile << std::format("{:%Y-%m-%d %H:%M:%S}", now) << " [INFO] " << std::vformat(format_str, std::make_format_args(args...)) << std::endl;
         }
     }
 
-    // G[OL^
+    // エラーログを記録
     template<typename... Args>
     static void Error(const std::string_view format_str, Args&&... args) {
+        std::lock_guard<std::mutex> lock(logMutex);
         if ( logFile.is_open() ) {
             auto now = std::chrono::system_clock::now();
             logFile << std::format("{:%Y-%m-%d %H:%M:%S}", now) << " [ERROR] " << std::vformat(format_str, std::make_format_args(args...)) << std::endl;
         }
     }
 
-    // Ot@C
+    // ログファイルを閉じる
     static void Close() {
+        std::lock_guard<std::mutex> lock(logMutex);
         if ( logFile.is_open() ) {
             logFile.close();
         }
@@ -42,4 +47,5 @@ public:
 
 private:
     inline static std::ofstream logFile;
+    inline static std::mutex logMutex; // 複数のワーカースレッドから書き込まれるため排他する
 };
\ No newline at end of file
@@ -0,0 +1,153 @@
+#include "MappedFile.h"
+#include <limits>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Cmp {
+    MappedFile::~MappedFile() {
+        Close();
+    }
+
+#ifdef _WIN32
+    bool MappedFile::OpenRead(const std::filesystem::path& path) {
+        Close();
+        HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if ( file == INVALID_HANDLE_VALUE ) return false;
+        fileHandle = file;
+
+        LARGE_INTEGER fileSize;
+        if ( !GetFileSizeEx(file, &fileSize) ||
+            static_cast<uint64_t>( fileSize.QuadPart ) > std::numeric_limits<size_t>::max() ) {
+            Close();
+            return false;
+        }
+        size = static_cast<size_t>( fileSize.QuadPart );
+
+        // 空のファイルはマップできないので、データ無しで開いた扱いにする
+        if ( size > 0 ) {
+            mappingHandle = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if ( mappingHandle == nullptr ) {
+                Close();
+                return false;
+            }
+            data = static_cast<char*>( MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0) );
+            if ( data == nullptr ) {
+                Close();
+                return false;
+            }
+        }
+        opened = true;
+        return true;
+    }
+
+    bool MappedFile::Create(const std::filesystem::path& path, uint64_t newSize) {
+        Close();
+        if ( newSize > std::numeric_limits<size_t>::max() ) return false;
+        HANDLE file = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr,
+            CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if ( file == INVALID_HANDLE_VALUE ) return false;
+        fileHandle = file;
+        size = static_cast<size_t>( newSize );
+
+        // マッピングの作成時にファイルが指定サイズまで拡張される
+        if ( size > 0 ) {
+            mappingHandle = CreateFileMappingW(file, nullptr, PAGE_READWRITE,
+                static_cast<DWORD>( newSize >> 32 ), static_cast<DWORD>( newSize & 0xFFFFFFFF ), nullptr);
+            if ( mappingHandle == nullptr ) {
+                Close();
+                return false;
+            }
+            data = static_cast<char*>( MapViewOfFile(mappingHandle, FILE_MAP_WRITE, 0, 0, 0) );
+            if ( data == nullptr ) {
+                Close();
+                return false;
+            }
+        }
+        writable = true;
+        opened = true;
+        return true;
+    }
+
+    void MappedFile::Close() {
+        if ( data != nullptr ) UnmapViewOfFile(data);
+        if ( mappingHandle != nullptr ) CloseHandle(mappingHandle);
+        if ( fileHandle != nullptr ) CloseHandle(fileHandle);
+        data = nullptr;
+        mappingHandle = nullptr;
+        fileHandle = nullptr;
+        size = 0;
+        opened = false;
+        writable = false;
+    }
+#else
+    bool MappedFile::OpenRead(const std::filesystem::path& path) {
+        Close();
+        fd = ::open(path.c_str(), O_RDONLY);
+        if ( fd < 0 ) return false;
+
+        struct stat st;
+        if ( fstat(fd, &st) != 0 ||
+            static_cast<uint64_t>( st.st_size ) > std::numeric_limits<size_t>::max() ) {
+            Close();
+            return false;
+        }
+        size = static_cast<size_t>( st.st_size );
+
+        // 空のファイルはマップできないので、データ無しで開いた扱いにする
+        if ( size > 0 ) {
+            void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if ( mapped == MAP_FAILED ) {
+                Close();
+                return false;
+            }
+            data = static_cast<char*>( mapped );
+        }
+        opened = true;
+        return true;
+    }
+
+    bool MappedFile::Create(const std::filesystem::path& path, uint64_t newSize) {
+        Close();
+        if ( newSize > std::numeric_limits<size_t>::max() ) return false;
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if ( fd < 0 ) return false;
+        size = static_cast<size_t>( newSize );
+
+        if ( size > 0 ) {
+            if ( ftruncate(fd, static_cast<off_t>( size )) != 0 ) {
+                Close();
+                return false;
+            }
+            void* mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if ( mapped == MAP_FAILED ) {
+                Close();
+                return false;
+            }
+            data = static_cast<char*>( mapped );
+        }
+        writable = true;
+        opened = true;
+        return true;
+    }
+
+    void MappedFile::Close() {
+        if ( data != nullptr ) munmap(data, size);
+        if ( fd >= 0 ) ::close(fd);
+        data = nullptr;
+        fd = -1;
+        size = 0;
+        opened = false;
+        writable = false;
+    }
+#endif
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+
+namespace Cmp {
+    // ファイル全体をメモリにマップする (Windows: CreateFileMapping / MapViewOfFile, それ以外: mmap)
+    // 読み込み専用で開くか、サイズを指定して新規作成し書き込み用にマップする
+    class MappedFile {
+    public:
+        MappedFile() = default;
+        ~MappedFile();
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        // 既存のファイルを読み込み専用でマップする
+        bool OpenRead(const std::filesystem::path& path);
+        // size バイトのファイルを作成 (既存なら上書き) し、書き込み用にマップする
+        bool Create(const std::filesystem::path& path, uint64_t size);
+        // マップを解除してファイルを閉じる
+        void Close();
+
+        const char* Data() const { return data; }
+        char* MutableData() { return writable ? data : nullptr; }
+        size_t Size() const { return size; }
+        bool IsOpen() const { return opened; }
+
+    private:
+        char* data = nullptr;
+        size_t size = 0;
+        bool opened = false;
+        bool writable = false;
+#ifdef _WIN32
+        void* fileHandle = nullptr;     // HANDLE
+        void* mappingHandle = nullptr;  // HANDLE
+#else
+        int fd = -1;
+#endif
+    };
+}
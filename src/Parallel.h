@@ -0,0 +1,52 @@
+#pragma once
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <algorithm>
+
+namespace Cmp {
+    // 利用するスレッド数を決める (0 はハードウェアの並列数)
+    inline unsigned ResolveThreadCount(unsigned requested) {
+        if ( requested > 0 ) return requested;
+        unsigned hw = std::thread::hardware_concurrency();
+        return hw > 0 ? hw : 1;
+    }
+
+    // [0, count) の各インデックスに対して func を並列に実行する
+    // ワーカー内で発生した最初の例外は、全スレッドの終了後に呼び出し元へ再送出する
+    template<typename Func>
+    void ParallelFor(size_t count, unsigned threads, Func&& func) {
+        if ( count == 0 ) return;
+        const size_t workerCount = std::min<size_t>(ResolveThreadCount(threads), count);
+        if ( workerCount <= 1 ) {
+            for ( size_t i = 0; i < count; ++i ) func(i);
+            return;
+        }
+
+        std::atomic<size_t> next{ 0 };
+        std::exception_ptr error;
+        std::mutex errorMutex;
+        auto worker = [ & ] () {
+            size_t i;
+            while ( ( i = next.fetch_add(1) ) < count ) {
+                try {
+                    func(i);
+                }
+                catch ( ... ) {
+                    std::lock_guard<std::mutex> lock(errorMutex);
+                    if ( !error ) error = std::current_exception();
+                }
+            }
+        };
+
+        std::vector<std::thread> pool;
+        pool.reserve(workerCount - 1);
+        for ( size_t t = 1; t < workerCount; ++t ) pool.emplace_back(worker);
+        worker();
+        for ( auto& th : pool ) th.join();
+
+        if ( error ) std::rethrow_exception(error);
+    }
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+
+namespace Cmp {
+    // 処理時間の計測に使う時計 (システム時刻の変更の影響を受けない)
+    using Clock = std::chrono::steady_clock;
+
+    // begin から end までの秒数
+    inline double Seconds(Clock::time_point begin, Clock::time_point end) {
+        return std::chrono::duration<double>(end - begin).count();
+    }
+
+    // 処理時間から MB/s を求める (時間が測れないほど短い場合は0)
+    inline double Throughput(uint64_t bytes, double seconds) {
+        return seconds > 0 ? bytes / seconds / 1e6 : 0;
+    }
+}
@@ -0,0 +1,183 @@
+#include "Verifier.h"
+#include "FileFormat.h"
+#include "Logger.h"
+#include <iostream>
+#include <iomanip>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+
+#include "Parallel.h"
+#include "MappedFile.h"
+#include "Timing.h"
+
+namespace fs = std::filesystem;
+
+bool Verifier::VerifyFolder(const std::string& sourceFolder) {
+    Logger::Info("Verification started for folder: {}", sourceFolder);
+
+    // 1. 対象のファイルを列挙し、アーカイブと同じ大きさのチャンクに分ける
+    std::vector<fs::path> files;
+    try {
+        for ( const auto& entry : fs::recursive_directory_iterator(sourceFolder) ) {
+            if ( entry.is_regular_file() ) {
+                files.push_back(entry.path());
+            }
+        }
+    }
+    catch ( const fs::filesystem_error& e ) {
+        Logger::Error("Failed to access source folder: {}", e.what());
+        std::cerr << "Error: Failed to access source folder " << sourceFolder << std::endl;
+        return false;
+    }
+
+    struct Chunk {
+        size_t file;
+        uint64_t offset;
+        size_t length;
+    };
+    const size_t chunkSize = compressor.ChunkSize();
+    std::vector<FileResult> results(files.size());
+    std::vector<Chunk> chunks;
+    for ( size_t i = 0; i < files.size(); ++i ) {
+        FileResult& result = results[i];
+        result.relativePath = fs::relative(files[i], sourceFolder).string();
+        std::error_code ec;
+        const uint64_t fileSize = fs::file_size(files[i], ec);
+        if ( ec ) {
+            result.error = "cannot read the file size";
+            continue;
+        }
+        result.originalSize = fileSize;
+        // チャンク以下のファイルは1エントリ、それより大きいファイルはチャンクごとのフレームとして圧縮される
+        uint64_t offset = 0;
+        do {
+            const size_t length = static_cast<size_t>( std::min<uint64_t>(chunkSize, fileSize - offset) );
+            chunks.push_back({ i, offset, length });
+            result.chunks++;
+            offset += length;
+        } while ( offset < fileSize );
+    }
+
+    // 2. 全チャンクを並列に検証する。作業メモリの見積もりの合計がメモリ上限を超えないように待つ
+    //    (何も処理していないときは上限を超えるチャンクでも進める)
+    const unsigned workerCount = Cmp::ResolveThreadCount(threadCount);
+    // チャンクの中の並列処理には、同時に処理するチャンクで分けた残りのスレッドだけを使う
+    const unsigned innerThreads = std::max<unsigned>(1, static_cast<unsigned>( workerCount / std::max<size_t>(1, std::min<size_t>(chunks.size(), workerCount)) ));
+    std::cout << "Verifying " << files.size() << " file(s) in " << chunks.size() << " chunk(s) with " << workerCount << " worker thread(s)...\n";
+    std::mutex resultMutex;
+    std::condition_variable memoryReleased;
+    size_t reservedMemory = 0;
+    const auto start = Cmp::Clock::now();
+    Cmp::ParallelFor(chunks.size(), workerCount, [ & ] (size_t k) {
+        const Chunk& chunk = chunks[k];
+        const size_t memoryCost = compressor.EstimateMemory(chunk.length);
+        {
+            std::unique_lock<std::mutex> lock(resultMutex);
+            memoryReleased.wait(lock, [ & ] () {
+                return reservedMemory == 0 || reservedMemory + memoryCost <= compressor.MemoryLimit();
+            });
+            reservedMemory += memoryCost;
+        }
+        const ChunkResult chunkResult = VerifyChunk(files[chunk.file], chunk.offset, chunk.length, innerThreads);
+        {
+            std::lock_guard<std::mutex> lock(resultMutex);
+            reservedMemory -= memoryCost;
+            FileResult& result = results[chunk.file];
+            result.compressedSize += chunkResult.compressedSize;
+            result.algorithmId = ( result.chunks == 1 ) ? chunkResult.algorithmId : static_cast<uint8_t>( Cmp::Algorithm::FRAMED );
+            result.compressSeconds += chunkResult.compressSeconds;
+            result.decompressSeconds += chunkResult.decompressSeconds;
+            if ( chunkResult.ok ) {
+                result.verifiedChunks++;
+            }
+            else if ( result.error.empty() ) {
+                result.error = chunkResult.error;
+            }
+        }
+        memoryReleased.notify_all();
+    });
+    const double elapsed = Cmp::Seconds(start, Cmp::Clock::now());
+
+    // 3. ファイルの順に結果を表示する (時間は各チャンクの処理時間の合計)
+    size_t failed = 0;
+    uint64_t totalOriginal = 0;
+    uint64_t totalCompressed = 0;
+    double totalCompress = 0;
+    double totalDecompress = 0;
+    std::cout << "Result    Original  Compressed  Algorithm  Compress(ms)  Decompress(ms)  Path\n";
+    for ( const auto& result : results ) {
+        const bool ok = result.error.empty() && result.verifiedChunks == result.chunks;
+        if ( !ok ) failed++;
+        totalOriginal += result.originalSize;
+        totalCompressed += result.compressedSize;
+        totalCompress += result.compressSeconds;
+        totalDecompress += result.decompressSeconds;
+        std::cout << std::left << std::setw(6) << ( ok ? "OK" : "FAIL" ) << std::right
+            << std::setw(10) << result.originalSize << "  "
+            << std::setw(10) << result.compressedSize << "  "
+            << std::left << std::setw(9) << Decompressor::AlgorithmName(result.algorithmId) << std::right << "  "
+            << std::fixed << std::setprecision(1)
+            << std::setw(12) << result.compressSeconds * 1000 << "  "
+            << std::setw(14) << result.decompressSeconds * 1000 << "  "
+            << result.relativePath << "\n";
+        if ( !ok ) {
+            std::cout << "      -> " << result.error << "\n";
+            Logger::Error("Verification failed: '{}' ({})", result.relativePath, result.error);
+        }
+    }
+
+    const double ratio = ( totalCompressed == 0 ) ? 0 : static_cast<double>( totalOriginal ) / totalCompressed;
+    std::cout << std::fixed << std::setprecision(2)
+        << "Verified " << files.size() << " file(s): " << ( files.size() - failed ) << " OK, " << failed << " failed. "
+        << totalOriginal << " -> " << totalCompressed << " bytes (" << ratio << ":1).\n"
+        << "Compress " << Cmp::Throughput(totalOriginal, totalCompress) << " MB/s, decompress " << Cmp::Throughput(totalOriginal, totalDecompress)
+        << " MB/s per thread; " << elapsed << " s elapsed.\n";
+    Logger::Info("Verification finished. Files: {}, Failed: {}", files.size(), failed);
+    return failed == 0;
+}
+
+Verifier::ChunkResult Verifier::VerifyChunk(const fs::path& path, uint64_t offset, size_t length, unsigned threads) const {
+    ChunkResult result;
+    try {
+        // アーカイブへの書き込みと同じく、マップ上のデータをそのまま圧縮する
+        Cmp::MappedFile source;
+        if ( !source.OpenRead(path) || source.Size() < offset + length ) {
+            result.error = "cannot read the file";
+            return result;
+        }
+        std::span<const char> original(source.Data() + offset, length);
+
+        std::vector<char> compressed;
+        std::vector<char> restored;
+        const auto begin = Cmp::Clock::now();
+        result.algorithmId = compressor.CompressBuffer(original, compressed, threads);
+        const auto compressedAt = Cmp::Clock::now();
+        const bool decoded = decompressor.DecodeData(result.algorithmId, compressed, restored, length, threads);
+        const auto end = Cmp::Clock::now();
+        result.compressedSize = compressed.size();
+        result.compressSeconds = Cmp::Seconds(begin, compressedAt);
+        result.decompressSeconds = Cmp::Seconds(compressedAt, end);
+
+        if ( !decoded ) {
+            result.error = "decoding failed";
+        }
+        else if ( restored.size() != length ) {
+            result.error = "size mismatch at offset " + std::to_string(offset) + " (expected " + std::to_string(length) +
+                ", actual " + std::to_string(restored.size()) + ")";
+        }
+        else {
+            const auto mismatch = std::mismatch(original.begin(), original.end(), restored.begin());
+            if ( mismatch.first != original.end() ) {
+                result.error = "content mismatch at offset " + std::to_string(offset + ( mismatch.first - original.begin() ));
+            }
+            else {
+                result.ok = true;
+            }
+        }
+    }
+    catch ( const std::exception& e ) {
+        result.error = e.what();
+    }
+    return result;
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <cstdint>
+#include "Compressor.h"
+#include "Decompressor.h"
+
+// アーカイブを書かずに、各ファイルをメモリ上で圧縮・解凍して元と一致するかを確かめる
+// 大きなファイルはアーカイブと同じチャンクに分け、全てのチャンクをワーカーで並列に処理する
+class Verifier {
+public:
+    // compressor の設定 (エントロピー符号化器・レベル・メモリ上限など) で圧縮する
+    explicit Verifier(const Compressor& compressor) : compressor(compressor) {}
+
+    // sourceFolder 以下の全ファイルを検証し、1ファイル1行の結果と合計を標準出力に表示する
+    // 全てのファイルが元と一致すれば true
+    bool VerifyFolder(const std::string& sourceFolder);
+
+    // 並列に処理するスレッド数を設定する (0 はハードウェアの並列数)
+    void SetThreadCount(unsigned count) { threadCount = count; }
+
+private:
+    // 1ファイル分の検証結果 (チャンクごとの結果を合計したもの)
+    struct FileResult {
+        std::string relativePath;
+        uint64_t originalSize = 0;
+        uint64_t compressedSize = 0;
+        uint8_t algorithmId = 0;
+        size_t chunks = 0;
+        size_t verifiedChunks = 0;      // 元と一致したチャンク数
+        double compressSeconds = 0;     // 各チャンクの処理時間の合計 (並列に処理した分も足す)
+        double decompressSeconds = 0;
+        std::string error;              // 最初に起きた失敗の理由
+    };
+
+    // 1チャンク分の検証結果
+    struct ChunkResult {
+        bool ok = false;
+        uint64_t compressedSize = 0;
+        uint8_t algorithmId = 0;
+        double compressSeconds = 0;
+        double decompressSeconds = 0;
+        std::string error;
+    };
+
+    // ファイルの [offset, offset + length) を圧縮・解凍して元と比べる (ワーカースレッドから呼ばれる)
+    // threads はチャンクの中の並列処理に使うスレッド数
+    ChunkResult VerifyChunk(const std::filesystem::path& path, uint64_t offset, size_t length, unsigned threads) const;
+
+    const Compressor& compressor;
+    Decompressor decompressor;
+    unsigned threadCount = 0;
+};
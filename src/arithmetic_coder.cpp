@@ -1,133 +1,195 @@
 #include "arithmetic_coder.h"
 #include <vector>
+#include <span>
+#include <array>
+#include <algorithm>
 #include <map>
 #include <stdexcept>
 #include <numeric>
 #include <cstdint>
+#include <bit>
 
 namespace Cmp {
-    // --- 萔 (ύXȂ) ---
+    // --- 定数 (変更なし) ---
     namespace {
         constexpr int PRECISION_BITS = 32;
         constexpr uint64_t MAX_VALUE = ( 1ULL << PRECISION_BITS );
         constexpr uint64_t ONE_QUARTER = MAX_VALUE / 4;
         constexpr uint64_t HALF = 2 * ONE_QUARTER;
         constexpr uint64_t THREE_QUARTERS = 3 * ONE_QUARTER;
+
+        // 適応型モデルの更新量と、再スケーリングを行う頻度合計の上限
+        constexpr uint32_t ADAPT_INCREMENT = 24;
+        constexpr uint64_t ADAPT_MAX_TOTAL = 1 << 16;
+        // 適応型モデルでは全シンボルの頻度が1以上、合計が ADAPT_MAX_TOTAL 以下なので、1シンボルの確率は
+        // 最大 (合計 - 255) / 合計 となり、符号は1シンボルあたり 255 / ADAPT_MAX_TOTAL ビット以上になる
+        // (-log2(1 - x) >= x)。したがって符号1バイトから復号できるのは高々この数のシンボル
+        constexpr uint64_t ADAPT_MAX_SYMBOLS_PER_BYTE = ADAPT_MAX_TOTAL * 8 / 255;
     }
 
-    // --- wp[NX (ύXȂ) ---
+    // --- ヘルパークラス ---
+    // 64ビットのバッファにまとめてビットを溜め、バイト単位 (MSBから) で stream の末尾に追加する
     class BitStreamWriter {
     public:
+        explicit BitStreamWriter(std::vector<char>& stream) : stream(stream) {}
         void WriteBit(bool bit) {
-            buffer |= ( bit << ( 7 - bitCount ) );
-            bitCount++;
-            if ( bitCount == 8 ) {
-                stream.push_back(buffer);
-                buffer = 0;
-                bitCount = 0;
+            WriteBits(bit ? 1 : 0, 1);
+        }
+        // value の下位 count ビット (count <= 32) を上位から順に書き込む
+        void WriteBits(uint32_t value, int count) {
+            buffer = ( buffer << count ) | value;
+            bitCount += count;
+            while ( bitCount >= 8 ) {
+                bitCount -= 8;
+                stream.push_back(static_cast<char>( buffer >> bitCount ));
+            }
+        }
+        // 同じビットを count 個書き込む (アンダーフロー分の保留ビット用)
+        void WriteRepeated(bool bit, int count) {
+            while ( count > 0 ) {
+                int chunk = std::min(count, 32);
+                WriteBits(bit ? static_cast<uint32_t>( ( 1ULL << chunk ) - 1 ) : 0, chunk);
+                count -= chunk;
             }
         }
         void Flush() {
             if ( bitCount > 0 ) {
-                stream.push_back(buffer);
+                stream.push_back(static_cast<char>( buffer << ( 8 - bitCount ) ));
+                bitCount = 0;
             }
         }
-        std::vector<char> GetStream() {
-            return stream;
-        }
     private:
-        std::vector<char> stream;
-        char buffer = 0;
+        std::vector<char>& stream;
+        uint64_t buffer = 0;
         int bitCount = 0;
     };
 
     class BitStreamReader {
     public:
-        BitStreamReader(const std::vector<char>& stream) : stream_ref(stream), buffer(0), count(8) {}
+        explicit BitStreamReader(std::span<const char> stream) : stream_ref(stream) {}
         bool ReadBit() {
-            if ( count == 8 ) {
-                if ( byte_index >= stream_ref.size() ) {
-                    return false;
-                }
-                buffer = static_cast<uint8_t>( stream_ref[byte_index++] );
-                count = 0;
+            return ReadBits(1) != 0;
+        }
+        // count ビット (count <= 32) を読み込む。終端以降は0を返す
+        uint32_t ReadBits(int count) {
+            while ( bitCount < count ) {
+                uint8_t next = ( byte_index < stream_ref.size() ) ? static_cast<uint8_t>( stream_ref[byte_index++] ) : 0;
+                buffer = ( buffer << 8 ) | next;
+                bitCount += 8;
             }
-            bool bit = ( buffer >> ( 7 - count ) ) & 1;
-            count++;
-            return bit;
+            bitCount -= count;
+            return static_cast<uint32_t>( ( buffer >> bitCount ) & ( ( 1ULL << count ) - 1 ) );
         }
     private:
-        const std::vector<char>& stream_ref;
+        std::span<const char> stream_ref;
         size_t byte_index = 0;
-        uint8_t buffer;
-        int count;
+        uint64_t buffer = 0;
+        int bitCount = 0;
     };
 
 
-    // --- mf̍Đ݌v ---
+    // --- 確率モデルの再設計 ---
 
-    // I[_[0f: ]ProbabilityModelɑBP̕ɂmzǗB
+    // オーダー0モデル: 従来のProbabilityModelに相当。単一の文脈における確率分布を管理する。
+    // 累積頻度はフェニック木 (Binary Indexed Tree) で保持し、更新・累積頻度の取得・
+    // シンボル検索をいずれも O(log 256) で行う。
     class Order0Model {
     public:
         Order0Model() {
-            // ŏ͑SV{1񂸂oԂƂďi[pxj
-            freqs.assign(256, 1);
-            UpdateCumulativeFreqs();
+            // 最初は全シンボルが1回ずつ出現した状態として初期化（ゼロ頻度回避）
+            freqs.fill(1);
+            RebuildTree();
         }
 
         void UpdateForSymbol(unsigned char symbol) {
-            freqs[symbol]++;
-            UpdateCumulativeFreqs();
+            Add(symbol, 1);
+        }
+
+        // 適応型モード用の更新: 頻度を大きめに加算し、合計が上限を超えたら半分に縮める
+        void Adapt(unsigned char symbol) {
+            Add(symbol, ADAPT_INCREMENT);
+            if ( totalFreq > ADAPT_MAX_TOTAL ) {
+                for ( auto& freq : freqs ) {
+                    freq = ( freq + 1 ) / 2;
+                }
+                RebuildTree();
+            }
         }
 
-        // VACŶ߂ɕpxf[^𒼐ڐݒ肷
+        // シリアライズのために頻度データを直接設定する
         void SetFreqs(const std::vector<uint32_t>& new_freqs) {
             if ( new_freqs.size() == 256 ) {
-                freqs = new_freqs;
-                UpdateCumulativeFreqs();
+                std::copy(new_freqs.begin(), new_freqs.end(), freqs.begin());
+                RebuildTree();
             }
         }
-        const std::vector<uint32_t>& GetFreqs() const { return freqs; }
+        const std::array<uint32_t, 256>& GetFreqs() const { return freqs; }
 
         uint64_t GetTotalFreq() const { return totalFreq; }
-        uint64_t GetLowFreq(unsigned char symbol) const { return cumulativeFreqs[symbol]; }
-        uint64_t GetHighFreq(unsigned char symbol) const { return cumulativeFreqs[symbol + 1]; }
-
-        unsigned char FindSymbol(uint64_t scaled_value) const {
-            for ( int i = 0; i < 256; ++i ) {
-                if ( scaled_value < cumulativeFreqs[i + 1] ) {
-                    return static_cast<unsigned char>( i );
+        uint64_t GetLowFreq(unsigned char symbol) const {
+            // symbol より前の頻度の合計
+            uint64_t sum = 0;
+            for ( int i = symbol; i > 0; i -= i & -i ) {
+                sum += tree[i];
+            }
+            return sum;
+        }
+        uint64_t GetHighFreq(unsigned char symbol) const { return GetLowFreq(symbol) + freqs[symbol]; }
+        uint64_t GetFreq(unsigned char symbol) const { return freqs[symbol]; }
+
+        // 累積頻度が scaled_value を超える最初のシンボルを木の上から二分探索で求める
+        // lowFreq にはそのシンボルの累積頻度の下端を返す
+        unsigned char FindSymbol(uint64_t scaled_value, uint64_t& lowFreq) const {
+            int pos = 0;
+            lowFreq = 0;
+            for ( int step = 128; step > 0; step >>= 1 ) {
+                if ( tree[pos + step] <= scaled_value - lowFreq ) {
+                    pos += step;
+                    lowFreq += tree[pos];
                 }
             }
-            return 255;
+            return static_cast<unsigned char>( pos );
         }
 
     private:
-        void UpdateCumulativeFreqs() {
-            cumulativeFreqs.assign(257, 0);
+        void Add(unsigned char symbol, uint32_t amount) {
+            freqs[symbol] += amount;
+            totalFreq += amount;
+            for ( int i = symbol + 1; i <= 256; i += i & -i ) {
+                tree[i] += amount;
+            }
+        }
+
+        // 頻度配列からフェニック木を O(256) で再構築する
+        void RebuildTree() {
             totalFreq = 0;
-            for ( int i = 0; i < 256; ++i ) {
-                cumulativeFreqs[i + 1] = cumulativeFreqs[i] + freqs[i];
+            for ( int i = 1; i <= 256; ++i ) {
+                tree[i] = freqs[i - 1];
+                totalFreq += freqs[i - 1];
+            }
+            for ( int i = 1; i <= 256; ++i ) {
+                int parent = i + ( i & -i );
+                if ( parent <= 256 ) tree[parent] += tree[i];
             }
-            totalFreq = cumulativeFreqs[256];
         }
-        std::vector<uint32_t> freqs;
-        std::vector<uint64_t> cumulativeFreqs;
+
+        std::array<uint32_t, 256> freqs;
+        std::array<uint64_t, 257> tree{}; // 1始まりのフェニック木
         uint64_t totalFreq = 0;
     };
 
-    // ReLXgf: 256̃I[_[0fǗB
+    // コンテキストモデル: 256個のオーダー0モデルを管理する。
     class ContextualModel {
     public:
-        ContextualModel() : models(256) {} // 256̃ReLXgp̃f𐶐
+        ContextualModel() : models(256) {} // 256個のコンテキスト用のモデルを生成
 
-        void Build(const std::vector<char>& data) {
+        void Build(std::span<const char> data) {
             if ( data.empty() ) return;
 
-            // ŏ̓̕ReLXgȂ̂ŁApfXV
+            // 最初の文字はコンテキストがないので、専用モデルを更新
             initial_model.UpdateForSymbol(static_cast<unsigned char>( data[0] ));
 
-            // 2ڈȍ~
+            // 2文字目以降
             for ( size_t i = 1; i < data.size(); ++i ) {
                 unsigned char context = static_cast<unsigned char>( data[i - 1] );
                 unsigned char symbol = static_cast<unsigned char>( data[i] );
@@ -135,16 +197,15 @@ namespace Cmp {
             }
         }
 
-        std::vector<char> Serialize() const {
-            std::vector<char> modelData;
-            // ŏinitial_modelVACY
+        void Serialize(std::vector<char>& modelData) const {
+            // 最初にinitial_modelをシリアライズ
             for ( uint32_t freq : initial_model.GetFreqs() ) {
                 modelData.push_back(( freq >> 24 ) & 0xFF);
                 modelData.push_back(( freq >> 16 ) & 0xFF);
                 modelData.push_back(( freq >> 8 ) & 0xFF);
                 modelData.push_back(freq & 0xFF);
             }
-            // 256̃ReLXgfVACY
+            // 次に256個のコンテキストモデルをシリアライズ
             for ( const auto& model : models ) {
                 for ( uint32_t freq : model.GetFreqs() ) {
                     modelData.push_back(( freq >> 24 ) & 0xFF);
@@ -153,10 +214,9 @@ namespace Cmp {
                     modelData.push_back(freq & 0xFF);
                 }
             }
-            return modelData;
         }
 
-        bool Deserialize(const std::vector<char>& modelData) {
+        bool Deserialize(std::span<const char> modelData) {
             if ( modelData.size() != ( 256 + 1 ) * 256 * 4 ) return false;
 
             size_t read_ptr = 0;
@@ -180,174 +240,274 @@ namespace Cmp {
             return true;
         }
 
-        // ReLXgɉfԂ
+        // コンテキストに応じたモデルを返す
         const Order0Model& GetModelForContext(unsigned char context) const {
             return models[context];
         }
-        // ŏ̕p̃fԂ
+        // 最初の文字用のモデルを返す
         const Order0Model& GetInitialModel() const {
             return initial_model;
         }
+        // 適応型モード用 (符号化しながらモデルを更新する)
+        Order0Model& GetModelForContext(unsigned char context) {
+            return models[context];
+        }
+        Order0Model& GetInitialModel() {
+            return initial_model;
+        }
 
     private:
         std::vector<Order0Model> models;
         Order0Model initial_model;
     };
 
-    // --- ArithmeticCoderNX̎ (ReLXgfg悤ɕύX) ---
+    // --- 符号化器・復号器 ---
 
-    std::vector<char> ArithmeticCoder::Compress(const std::vector<char>& data) {
-        if ( data.empty() ) return {};
+    // low と high の上位で一致しているビット数 (= 確定したビット数)
+    inline int CountSharedBits(uint64_t low, uint64_t high) {
+        const uint32_t diff = static_cast<uint32_t>( low ^ high );
+        return diff == 0 ? PRECISION_BITS : std::countl_zero(diff);
+    }
 
-        ContextualModel model;
-        model.Build(data);
-        std::vector<char> output = model.Serialize();
+    // 区間 [low, high] を確率に応じて狭め、確定したビットを output の末尾に出力する
+    class ArithmeticEncoder {
+    public:
+        explicit ArithmeticEncoder(std::vector<char>& output) : writer(output) {}
 
-        uint32_t originalSize = data.size();
-        output.push_back(( originalSize >> 24 ) & 0xFF);
-        output.push_back(( originalSize >> 16 ) & 0xFF);
-        output.push_back(( originalSize >> 8 ) & 0xFF);
-        output.push_back(originalSize & 0xFF);
+        void Encode(uint64_t lowFreq, uint64_t highFreq, uint64_t total) {
+            const uint64_t range = high - low + 1;
+            uint64_t new_high = low + ( range * highFreq / total ) - 1;
+            uint64_t new_low = low + ( range * lowFreq / total );
+            high = new_high;
+            low = new_low;
+
+            // 正規化処理
+            while ( true ) {
+                const int shared = CountSharedBits(low, high);
+                if ( shared > 0 ) {
+                    // low と high の上位で一致しているビットはまとめて確定させる
+                    WriteBitWithFollow(( low & HALF ) != 0);
+                    if ( shared > 1 ) {
+                        writer.WriteBits(static_cast<uint32_t>( ( low >> ( PRECISION_BITS - shared ) ) & ( ( 1ULL << ( shared - 1 ) ) - 1 ) ), shared - 1);
+                    }
+                    low = ( low << shared ) & ( MAX_VALUE - 1 );
+                    high = ( ( high << shared ) & ( MAX_VALUE - 1 ) ) | ( ( 1ULL << shared ) - 1 );
+                }
+                else if ( low >= ONE_QUARTER && high < THREE_QUARTERS ) {
+                    underflow_bits++;
+                    low = ( low - ONE_QUARTER ) << 1;
+                    high = ( ( high - ONE_QUARTER ) << 1 ) | 1;
+                }
+                else {
+                    break;
+                }
+            }
+        }
+
+        // 終端処理: 最終区間内の値を一意に決めるビットを出力する
+        void Finish() {
+            underflow_bits++;
+            WriteBitWithFollow(low >= ONE_QUARTER);
+            writer.Flush();
+        }
+
+    private:
+        void WriteBitWithFollow(bool bit) {
+            writer.WriteBit(bit);
+            writer.WriteRepeated(!bit, underflow_bits);
+            underflow_bits = 0;
+        }
 
         BitStreamWriter writer;
         uint64_t low = 0;
         uint64_t high = MAX_VALUE - 1;
         int underflow_bits = 0;
+    };
 
-        unsigned char context = 0; // ReLXgϐ
-
-        for ( size_t i = 0; i < data.size(); ++i ) {
-            unsigned char symbol = static_cast<unsigned char>( data[i] );
-
-            // ReLXgɉēK؂ȃfI
-            const Order0Model& current_model = ( i == 0 ) ? model.GetInitialModel() : model.GetModelForContext(context);
+    class ArithmeticDecoder {
+    public:
+        explicit ArithmeticDecoder(std::span<const char> payload) : reader(payload) {
+            for ( int i = 0; i < PRECISION_BITS; ++i ) {
+                value = ( value << 1 ) | reader.ReadBit();
+            }
+        }
 
+        // 現在の値をモデルの累積頻度の尺度に変換する
+        uint64_t GetScaledValue(uint64_t total) const {
             const uint64_t range = high - low + 1;
-            const uint64_t total = current_model.GetTotalFreq();
+            return ( ( value - low + 1 ) * total - 1 ) / range;
+        }
 
-            uint64_t new_high = low + ( range * current_model.GetHighFreq(symbol) / total ) - 1;
-            uint64_t new_low = low + ( range * current_model.GetLowFreq(symbol) / total );
+        void Decode(uint64_t lowFreq, uint64_t highFreq, uint64_t total) {
+            const uint64_t range = high - low + 1;
+            uint64_t new_high = low + ( range * highFreq / total ) - 1;
+            uint64_t new_low = low + ( range * lowFreq / total );
             high = new_high;
             low = new_low;
 
-            // K (ύXȂ)
+            // 正規化処理
             while ( true ) {
-                if ( high < HALF ) {
-                    writer.WriteBit(false);
-                    for ( int j = 0; j < underflow_bits; ++j ) writer.WriteBit(true);
-                    underflow_bits = 0;
-                    low <<= 1;
-                    high = ( high << 1 ) | 1;
-                }
-                else if ( low >= HALF ) {
-                    writer.WriteBit(true);
-                    for ( int j = 0; j < underflow_bits; ++j ) writer.WriteBit(false);
-                    underflow_bits = 0;
-                    low = ( low - HALF ) << 1;
-                    high = ( ( high - HALF ) << 1 ) | 1;
+                const int shared = CountSharedBits(low, high);
+                if ( shared > 0 ) {
+                    low = ( low << shared ) & ( MAX_VALUE - 1 );
+                    high = ( ( high << shared ) & ( MAX_VALUE - 1 ) ) | ( ( 1ULL << shared ) - 1 );
+                    value = ( ( value << shared ) & ( MAX_VALUE - 1 ) ) | reader.ReadBits(shared);
                 }
                 else if ( low >= ONE_QUARTER && high < THREE_QUARTERS ) {
-                    underflow_bits++;
                     low = ( low - ONE_QUARTER ) << 1;
                     high = ( ( high - ONE_QUARTER ) << 1 ) | 1;
+                    value = ( value - ONE_QUARTER ) << 1 | reader.ReadBit();
                 }
                 else {
                     break;
                 }
             }
+        }
 
-            // ̃[v̂߂ɃReLXgXV
-            context = symbol;
+    private:
+        BitStreamReader reader;
+        uint64_t low = 0;
+        uint64_t high = MAX_VALUE - 1;
+        uint64_t value = 0;
+    };
+
+    namespace {
+        void WriteOriginalSize(std::vector<char>& output, uint32_t originalSize) {
+            output.push_back(( originalSize >> 24 ) & 0xFF);
+            output.push_back(( originalSize >> 16 ) & 0xFF);
+            output.push_back(( originalSize >> 8 ) & 0xFF);
+            output.push_back(originalSize & 0xFF);
         }
 
-        // I[ (ύXȂ)
-        writer.WriteBit(low >= ONE_QUARTER);
-        underflow_bits++;
-        for ( int i = 0; i < underflow_bits; ++i ) {
-            writer.WriteBit(low < HALF);
+        uint32_t ReadOriginalSize(std::span<const char> data, size_t offset) {
+            uint32_t originalSize = 0;
+            originalSize |= static_cast<uint32_t>( static_cast<uint8_t>( data[offset++] ) ) << 24;
+            originalSize |= static_cast<uint32_t>( static_cast<uint8_t>( data[offset++] ) ) << 16;
+            originalSize |= static_cast<uint32_t>( static_cast<uint8_t>( data[offset++] ) ) << 8;
+            originalSize |= static_cast<uint32_t>( static_cast<uint8_t>( data[offset++] ) );
+            return originalSize;
+        }
+    }
+
+    // --- ArithmeticCoderクラスの実装 (コンテキストモデルを使うように変更) ---
+
+    void ArithmeticCoder::Compress(std::span<const char> data, std::vector<char>& output) {
+        output.clear();
+        if ( data.empty() ) return;
+
+        ContextualModel model;
+        model.Build(data);
+        model.Serialize(output);
+        WriteOriginalSize(output, static_cast<uint32_t>( data.size() ));
+
+        ArithmeticEncoder encoder(output);
+        unsigned char context = 0; // コンテキスト変数を初期化
+
+        for ( size_t i = 0; i < data.size(); ++i ) {
+            unsigned char symbol = static_cast<unsigned char>( data[i] );
+
+            // コンテキストに応じて適切なモデルを選択
+            const Order0Model& current_model = ( i == 0 ) ? model.GetInitialModel() : model.GetModelForContext(context);
+            const uint64_t lowFreq = current_model.GetLowFreq(symbol);
+            encoder.Encode(lowFreq, lowFreq + current_model.GetFreq(symbol), current_model.GetTotalFreq());
+
+            // 次のループのためにコンテキストを更新
+            context = symbol;
         }
-        writer.Flush();
 
-        std::vector<char> stream = writer.GetStream();
-        output.insert(output.end(), stream.begin(), stream.end());
-        return output;
+        encoder.Finish();
     }
 
-    std::vector<char> ArithmeticCoder::Decompress(const std::vector<char>& data) {
+    void ArithmeticCoder::Decompress(std::span<const char> data, std::vector<char>& decompressedData, size_t maxSize) {
+        decompressedData.clear();
         const size_t model_size = ( 256 + 1 ) * 256 * 4;
         const size_t header_size = model_size + 4;
-        if ( data.size() < header_size ) return {};
+        if ( data.size() < header_size ) return;
 
+        // モデルとペイロードはコピーせず、入力の部分スパンとして参照する
         ContextualModel model;
-        const std::vector<char> modelData(data.begin(), data.begin() + model_size);
-        if ( !model.Deserialize(modelData) ) {
-            return {};
+        if ( !model.Deserialize(data.first(model_size)) ) {
+            return;
         }
 
-        uint32_t originalSize = 0;
-        size_t size_offset = model_size;
-        originalSize |= static_cast<uint32_t>( static_cast<uint8_t>( data[size_offset++] ) ) << 24;
-        originalSize |= static_cast<uint32_t>( static_cast<uint8_t>( data[size_offset++] ) ) << 16;
-        originalSize |= static_cast<uint32_t>( static_cast<uint8_t>( data[size_offset++] ) ) << 8;
-        originalSize |= static_cast<uint32_t>( static_cast<uint8_t>( data[size_offset++] ) );
+        uint32_t originalSize = ReadOriginalSize(data, model_size);
+        // 静的モデルでは確率1のシンボルが0ビットになるので、ペイロードの大きさからは上限が決まらない
+        if ( originalSize == 0 || originalSize > maxSize ) return;
 
-        if ( originalSize == 0 ) return {};
+        ArithmeticDecoder decoder(data.subspan(header_size));
+        decompressedData.reserve(originalSize);
 
-        const std::vector<char> payload(data.begin() + header_size, data.end());
-        BitStreamReader reader(payload);
+        unsigned char context = 0; // コンテキスト変数を初期化
 
-        uint64_t value = 0;
-        for ( int i = 0; i < PRECISION_BITS; ++i ) {
-            value = ( value << 1 ) | reader.ReadBit();
+        for ( uint32_t i = 0; i < originalSize; ++i ) {
+            // コンテキストに応じて適切なモデルを選択
+            const Order0Model& current_model = ( i == 0 ) ? model.GetInitialModel() : model.GetModelForContext(context);
+
+            const uint64_t total = current_model.GetTotalFreq();
+            uint64_t lowFreq = 0;
+            unsigned char symbol = current_model.FindSymbol(decoder.GetScaledValue(total), lowFreq);
+            decompressedData.push_back(symbol);
+            decoder.Decode(lowFreq, lowFreq + current_model.GetFreq(symbol), total);
+
+            // 次のループのためにコンテキストを更新
+            context = symbol;
         }
+    }
+
+    // --- 適応型モード ---
+    // 符号化器と復号器が同じ順序で同じモデル更新を行うため、頻度表をヘッダに持たない。
+    // 形式: [元サイズ(4)] [ビットストリーム]
 
-        std::vector<char> decompressedData;
+    void ArithmeticCoder::CompressAdaptive(std::span<const char> data, std::vector<char>& output) {
+        output.clear();
+        if ( data.empty() ) return;
+
+        WriteOriginalSize(output, static_cast<uint32_t>( data.size() ));
+
+        ContextualModel model;
+        ArithmeticEncoder encoder(output);
+        unsigned char context = 0;
+
+        for ( size_t i = 0; i < data.size(); ++i ) {
+            unsigned char symbol = static_cast<unsigned char>( data[i] );
+            Order0Model& current_model = ( i == 0 ) ? model.GetInitialModel() : model.GetModelForContext(context);
+            const uint64_t lowFreq = current_model.GetLowFreq(symbol);
+            encoder.Encode(lowFreq, lowFreq + current_model.GetFreq(symbol), current_model.GetTotalFreq());
+            current_model.Adapt(symbol);
+            context = symbol;
+        }
+
+        encoder.Finish();
+    }
+
+    void ArithmeticCoder::DecompressAdaptive(std::span<const char> data, std::vector<char>& decompressedData, size_t maxSize) {
+        decompressedData.clear();
+        if ( data.size() < 4 ) return;
+
+        uint32_t originalSize = ReadOriginalSize(data, 0);
+        if ( originalSize == 0 || originalSize > maxSize ) return;
+        // 壊れたヘッダで巨大な出力を確保・復号しないよう、ペイロードで表せない大きさは弾く
+        // (終端処理で加わる分として数バイトの余裕を持たせる)
+        const std::span<const char> payload = data.subspan(4);
+        if ( originalSize / ADAPT_MAX_SYMBOLS_PER_BYTE > payload.size() + 4 ) return;
+
+        ArithmeticDecoder decoder(payload);
         decompressedData.reserve(originalSize);
-        uint64_t low = 0, high = MAX_VALUE - 1;
 
-        unsigned char context = 0; // ReLXgϐ
+        ContextualModel model;
+        unsigned char context = 0;
 
         for ( uint32_t i = 0; i < originalSize; ++i ) {
-            // ReLXgɉēK؂ȃfI
-            const Order0Model& current_model = ( i == 0 ) ? model.GetInitialModel() : model.GetModelForContext(context);
+            Order0Model& current_model = ( i == 0 ) ? model.GetInitialModel() : model.GetModelForContext(context);
 
-            const uint64_t range = high - low + 1;
             const uint64_t total = current_model.GetTotalFreq();
-            const uint64_t scaled_value = ( ( value - low + 1 ) * total - 1 ) / range;
-
-            unsigned char symbol = current_model.FindSymbol(scaled_value);
+            uint64_t lowFreq = 0;
+            unsigned char symbol = current_model.FindSymbol(decoder.GetScaledValue(total), lowFreq);
             decompressedData.push_back(symbol);
+            decoder.Decode(lowFreq, lowFreq + current_model.GetFreq(symbol), total);
+            current_model.Adapt(symbol);
 
-            uint64_t new_high = low + ( range * current_model.GetHighFreq(symbol) / total ) - 1;
-            uint64_t new_low = low + ( range * current_model.GetLowFreq(symbol) / total );
-            high = new_high;
-            low = new_low;
-
-            // K (ύXȂ)
-            while ( true ) {
-                if ( high < HALF ) {
-                    low <<= 1;
-                    high = ( high << 1 ) | 1;
-                    value = ( value << 1 ) | reader.ReadBit();
-                }
-                else if ( low >= HALF ) {
-                    low = ( low - HALF ) << 1;
-                    high = ( ( high - HALF ) << 1 ) | 1;
-                    value = ( value - HALF ) << 1 | reader.ReadBit();
-                }
-                else if ( low >= ONE_QUARTER && high < THREE_QUARTERS ) {
-                    low = ( low - ONE_QUARTER ) << 1;
-                    high = ( ( high - ONE_QUARTER ) << 1 ) | 1;
-                    value = ( value - ONE_QUARTER ) << 1 | reader.ReadBit();
-                }
-                else {
-                    break;
-                }
-            }
-
-            // ̃[v̂߂ɃReLXgXV
             context = symbol;
         }
-        return decompressedData;
     }
 }
\ No newline at end of file
@@ -1,10 +1,95 @@
 #pragma once
 #include <vector>
+#include <span>
+#include <cstdint>
 
 namespace Cmp {
     class ArithmeticCoder {
     public:
-        static std::vector<char> Compress(const std::vector<char>& data);
-        static std::vector<char> Decompress(const std::vector<char>& data);
+        // 出力は output の中身を置き換える (output は入力と別のバッファであること)
+        static void Compress(std::span<const char> data, std::vector<char>& output);
+        // 元サイズのヘッダが maxSize を超える場合は、壊れたデータとして確保する前に output を空にする
+        static void Decompress(std::span<const char> data, std::vector<char>& output, size_t maxSize = SIZE_MAX);
+
+        // 適応型オーダー1モード (頻度表ヘッダなし)
+        static void CompressAdaptive(std::span<const char> data, std::vector<char>& output);
+        static void DecompressAdaptive(std::span<const char> data, std::vector<char>& output, size_t maxSize = SIZE_MAX);
+
+        // 新しいバッファを返す版
+        static std::vector<char> Compress(std::span<const char> data) { std::vector<char> out; Compress(data, out); return out; }
+        static std::vector<char> Decompress(std::span<const char> data) { std::vector<char> out; Decompress(data, out); return out; }
+        static std::vector<char> CompressAdaptive(std::span<const char> data) { std::vector<char> out; CompressAdaptive(data, out); return out; }
+        static std::vector<char> DecompressAdaptive(std::span<const char> data) { std::vector<char> out; DecompressAdaptive(data, out); return out; }
+
+        // 1ビットごとに外部のモデルが確率を与える二値算術符号 (コンテキストミキシング用)
+        // probability は次のビットが1である確率を 1..PROBABILITY_ONE-1 の12ビットで表したもの
+        static constexpr uint32_t PROBABILITY_BITS = 12;
+        static constexpr uint32_t PROBABILITY_ONE = 1u << PROBABILITY_BITS;
+
+        // 32ビットの区間 [low, high] を上位バイトが確定するたびに出力する (桁上がりなし)
+        class BinaryEncoder {
+        public:
+            explicit BinaryEncoder(std::vector<char>& output) : output(output) {}
+
+            void Encode(int bit, uint32_t probability) {
+                const uint32_t mid = low + static_cast<uint32_t>( ( static_cast<uint64_t>( high - low ) * probability ) >> PROBABILITY_BITS );
+                if ( bit ) high = mid;
+                else low = mid + 1;
+                while ( ( ( low ^ high ) & 0xFF000000u ) == 0 ) {
+                    output.push_back(static_cast<char>( high >> 24 ));
+                    low <<= 8;
+                    high = ( high << 8 ) | 0xFF;
+                }
+            }
+
+            // 区間内の値を確定させる4バイトを書き出す
+            void Flush() {
+                for ( int i = 0; i < 4; ++i ) {
+                    output.push_back(static_cast<char>( low >> 24 ));
+                    low <<= 8;
+                }
+            }
+
+        private:
+            std::vector<char>& output;
+            uint32_t low = 0;
+            uint32_t high = 0xFFFFFFFFu;
+        };
+
+        class BinaryDecoder {
+        public:
+            explicit BinaryDecoder(std::span<const char> input) : input(input) {
+                for ( int i = 0; i < 4; ++i ) value = ( value << 8 ) | NextByte();
+            }
+
+            int Decode(uint32_t probability) {
+                const uint32_t mid = low + static_cast<uint32_t>( ( static_cast<uint64_t>( high - low ) * probability ) >> PROBABILITY_BITS );
+                const int bit = ( value <= mid ) ? 1 : 0;
+                if ( bit ) high = mid;
+                else low = mid + 1;
+                while ( ( ( low ^ high ) & 0xFF000000u ) == 0 ) {
+                    low <<= 8;
+                    high = ( high << 8 ) | 0xFF;
+                    value = ( value << 8 ) | NextByte();
+                }
+                return bit;
+            }
+
+            // 入力の終端を超えて読んだか (データが壊れている)
+            bool Overrun() const { return position > input.size() + 4; }
+
+        private:
+            uint32_t NextByte() {
+                const uint32_t byte = position < input.size() ? static_cast<uint8_t>( input[position] ) : 0;
+                position++;
+                return byte;
+            }
+
+            std::span<const char> input;
+            size_t position = 0;
+            uint32_t low = 0;
+            uint32_t high = 0xFFFFFFFFu;
+            uint32_t value = 0;
+        };
     };
-}
\ No newline at end of file
+}
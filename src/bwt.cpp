@@ -1,59 +1,333 @@
 #include "bwt.h"
 #include <vector>
+#include <span>
 #include <string>
 #include <numeric>
 #include <algorithm>
+#include "Parallel.h"
 
 namespace Cmp {
-    Bwt::BwtResult Bwt::Transform(const std::vector<char>& data) {
-        if ( data.empty() ) return { {}, 0 };
-        const size_t n = data.size();
-        std::vector<int> suffix_array(n);
-        std::iota(suffix_array.begin(), suffix_array.end(), 0);
-        std::sort(suffix_array.begin(), suffix_array.end(),
-            [ & ] (int a, int b) {
-                for ( size_t i = 0; i < n; ++i ) {
-                    if ( data[( a + i ) % n] != data[( b + i ) % n] ) {
-                        return static_cast<unsigned char>( data[( a + i ) % n] ) < static_cast<unsigned char>( data[( b + i ) % n] );
+    // --- SA-IS による接尾辞配列の構築 ---
+    namespace {
+        // L/S型を1ビットずつ保持する (n/8 バイト)
+        class TypeBits {
+        public:
+            explicit TypeBits(size_t n) : bits(( n + 7 ) / 8, 0) {}
+            void SetS(size_t i) { bits[i >> 3] |= static_cast<unsigned char>( 1u << ( i & 7 ) ); }
+            bool IsS(size_t i) const { return ( bits[i >> 3] >> ( i & 7 ) ) & 1; }
+        private:
+            std::vector<unsigned char> bits;
+        };
+
+        // 各バケットの開始位置 (end=false) または終了位置 (end=true) を求める
+        template<typename CharT>
+        void GetBuckets(const CharT* s, int32_t n, std::span<int32_t> bkt, bool end) {
+            std::fill(bkt.begin(), bkt.end(), 0);
+            for ( int32_t i = 0; i < n; ++i ) bkt[static_cast<size_t>( s[i] )]++;
+            int32_t sum = 0;
+            for ( size_t i = 0; i < bkt.size(); ++i ) {
+                sum += bkt[i];
+                bkt[i] = end ? sum : sum - bkt[i];
+            }
+        }
+
+        // ソート済みLMSからL型・S型の接尾辞を誘導ソートする
+        // 末尾には仮想的な番兵 (全ての文字より小さい) があるものとして扱う
+        template<typename CharT>
+        void InduceSort(const CharT* s, int32_t* sa, int32_t n, const TypeBits& t, std::span<int32_t> bkt) {
+            // L型: 番兵の直前 (n-1) は常にL型なので最初に置く
+            GetBuckets(s, n, bkt, false);
+            sa[bkt[static_cast<size_t>( s[n - 1] )]++] = n - 1;
+            for ( int32_t i = 0; i < n; ++i ) {
+                int32_t j = sa[i] - 1;
+                if ( sa[i] > 0 && !t.IsS(j) ) {
+                    sa[bkt[static_cast<size_t>( s[j] )]++] = j;
+                }
+            }
+            // S型
+            GetBuckets(s, n, bkt, true);
+            for ( int32_t i = n - 1; i >= 0; --i ) {
+                int32_t j = sa[i] - 1;
+                if ( sa[i] > 0 && t.IsS(j) ) {
+                    sa[--bkt[static_cast<size_t>( s[j] )]] = j;
+                }
+            }
+        }
+
+        // s[0..n) の接尾辞配列を sa に構築する。文字は [0, k) の範囲。
+        // 縮約文字列は sa の後半に置いて再帰するため、追加メモリは型ビットとバケットのみ。
+        // バケット (k 要素) は bucketSpace に収まればそこに置き、収まらない場合だけ確保する。
+        // 再帰では親の sa の使っていない中央部分 (n - 2*n1 要素) を渡すので、通常の入力では
+        // 作業メモリは回転したコピー (n) と接尾辞配列 (4n) と型ビットで済む。名前の数が多く
+        // 空きに収まらない入力では、各レベルで名前の数*4 バイト (合計で最大およそ 2n) が加わる
+        template<typename CharT>
+        void SaIs(const CharT* s, int32_t* sa, int32_t n, int32_t k, std::span<int32_t> bucketSpace = {}) {
+            if ( n == 1 ) {
+                sa[0] = 0;
+                return;
+            }
+
+            // 1. 各位置の型を決定 (末尾は番兵より大きいのでL型)
+            TypeBits t(n);
+            for ( int32_t i = n - 2; i >= 0; --i ) {
+                if ( s[i] < s[i + 1] || ( s[i] == s[i + 1] && t.IsS(i + 1) ) ) {
+                    t.SetS(i);
+                }
+            }
+            auto isLms = [ & ] (int32_t i) { return i > 0 && i < n && t.IsS(i) && !t.IsS(i - 1); };
+
+            // 2. LMS位置をバケット末尾に置いて誘導ソートし、LMS部分文字列を整列する
+            std::vector<int32_t> ownBuckets;
+            std::span<int32_t> bkt;
+            if ( bucketSpace.size() >= static_cast<size_t>( k ) ) {
+                bkt = bucketSpace.first(static_cast<size_t>( k ));
+            }
+            else {
+                ownBuckets.resize(static_cast<size_t>( k ));
+                bkt = ownBuckets;
+            }
+            GetBuckets(s, n, bkt, true);
+            std::fill(sa, sa + n, -1);
+            for ( int32_t i = 1; i < n; ++i ) {
+                if ( isLms(i) ) sa[--bkt[static_cast<size_t>( s[i] )]] = i;
+            }
+            InduceSort(s, sa, n, t, bkt);
+
+            // 3. 整列済みLMSを先頭に詰める
+            int32_t n1 = 0;
+            for ( int32_t i = 0; i < n; ++i ) {
+                if ( isLms(sa[i]) ) sa[n1++] = sa[i];
+            }
+
+            // 4. LMS部分文字列に名前を付ける (名前は sa[n1 + pos/2] に一時保存)
+            std::fill(sa + n1, sa + n, -1);
+            int32_t name = 0;
+            int32_t prev = -1;
+            for ( int32_t i = 0; i < n1; ++i ) {
+                int32_t pos = sa[i];
+                bool diff = ( prev == -1 );
+                for ( int32_t d = 0; !diff; ++d ) {
+                    // 番兵に到達した部分文字列は他と一致しない
+                    if ( pos + d == n || prev + d == n ||
+                        s[pos + d] != s[prev + d] || t.IsS(pos + d) != t.IsS(prev + d) ) {
+                        diff = true;
+                    }
+                    else if ( d > 0 && ( isLms(pos + d) || isLms(prev + d) ) ) {
+                        break;
                     }
                 }
-                return false;
-            });
-        std::vector<char> transformed(n);
+                if ( diff ) {
+                    name++;
+                    prev = pos;
+                }
+                sa[n1 + pos / 2] = name - 1;
+            }
+
+            // 5. 縮約文字列を sa の末尾に集める
+            for ( int32_t i = n - 1, j = n - 1; i >= n1; --i ) {
+                if ( sa[i] >= 0 ) sa[j--] = sa[i];
+            }
+            int32_t* s1 = sa + n - n1;
+            int32_t* sa1 = sa;
+
+            // 6. 名前が重複していれば再帰、そうでなければ直接求める
+            //    sa[n1, n - n1) は再帰の間は使わないので、再帰先のバケットに貸す
+            if ( name < n1 ) {
+                SaIs(s1, sa1, n1, name, std::span<int32_t>(sa + n1, static_cast<size_t>( n - 2 * n1 )));
+            }
+            else {
+                for ( int32_t i = 0; i < n1; ++i ) sa1[s1[i]] = i;
+            }
+
+            // 7. 縮約接尾辞配列から元の位置に戻し、最終的な誘導ソートを行う
+            for ( int32_t i = 1, j = 0; i < n; ++i ) {
+                if ( isLms(i) ) s1[j++] = i;
+            }
+            for ( int32_t i = 0; i < n1; ++i ) sa1[i] = s1[sa1[i]];
+            std::fill(sa + n1, sa + n, -1);
+            GetBuckets(s, n, bkt, true);
+            for ( int32_t i = n1 - 1; i >= 0; --i ) {
+                int32_t j = sa[i];
+                sa[i] = -1;
+                sa[--bkt[static_cast<size_t>( s[j] )]] = j;
+            }
+            InduceSort(s, sa, n, t, bkt);
+        }
+
+        // 最小回転の開始位置と、巡回文字列としての最小周期を求める
+        void FindLeastRotation(std::span<const char> data, size_t& rotation, size_t& period) {
+            const size_t n = data.size();
+            auto at = [ & ] (size_t i) { return static_cast<unsigned char>( data[i % n] ); };
+
+            size_t i = 0, j = 1, k = 0;
+            while ( i < n && j < n && k < n ) {
+                unsigned char a = at(i + k);
+                unsigned char b = at(j + k);
+                if ( a == b ) {
+                    k++;
+                    continue;
+                }
+                if ( a > b ) i += k + 1;
+                else j += k + 1;
+                if ( i == j ) j++;
+                k = 0;
+            }
+            rotation = std::min(i, j);
+            period = n;
+            if ( k < n ) return;
+
+            // 回転iとjが一致した = 周期は gcd(n, |i-j|) の約数
+            size_t g = std::gcd(n, ( i > j ) ? i - j : j - i);
+            for ( size_t p = 1; p <= g; ++p ) {
+                if ( g % p != 0 ) continue;
+                bool periodic = true;
+                for ( size_t q = p; q < n && periodic; ++q ) {
+                    periodic = ( at(q) == at(q - p) );
+                }
+                if ( periodic ) {
+                    period = p;
+                    return;
+                }
+            }
+        }
+    }
+
+    size_t Bwt::Transform(std::span<const char> data, std::vector<char>& transformed) {
         size_t primary_index = 0;
-        for ( size_t i = 0; i < n; ++i ) {
-            transformed[i] = data[( suffix_array[i] + n - 1 ) % n];
-            if ( suffix_array[i] == 0 ) {
-                primary_index = i;
+        Transform(data, transformed, std::span<size_t>(&primary_index, 1));
+        return primary_index;
+    }
+
+    void Bwt::Transform(std::span<const char> data, std::vector<char>& transformed, std::span<size_t> startRows) {
+        transformed.clear();
+        std::fill(startRows.begin(), startRows.end(), 0);
+        if ( data.empty() ) return;
+        const size_t n = data.size();
+
+        // 最小回転 (リンドン語) から始めると、巡回回転の順序と接尾辞の順序が一致する。
+        // 周期的な入力は1周期分だけを整列し、各行を周期の繰り返し回数だけ並べる。
+        size_t rotation = 0;
+        size_t period = n;
+        FindLeastRotation(data, rotation, period);
+        const size_t repeat = n / period;
+
+        std::vector<int32_t> suffix_array(period);
+        {
+            std::vector<unsigned char> lyndon(period);
+            for ( size_t i = 0; i < period; ++i ) {
+                lyndon[i] = static_cast<unsigned char>( data[( rotation + i ) % n] );
+            }
+            SaIs(lyndon.data(), suffix_array.data(), static_cast<int32_t>( period ), 256);
+        }
+
+        // 各区間の先頭位置 (周期内の位置) から始まる回転の行を記録する
+        // 同じ周期位置から始まる回転は同一の文字列なので、どの行から復元しても結果は同じ
+        // 周期内の各位置はちょうど1つの行に現れる。区間の先頭の位置にビットを立てておき、
+        // ビットが立っている行だけ、位置で整列した区間の表を二分探索する (行ごとの処理は O(1))
+        std::vector<std::pair<size_t, size_t>> wanted(startRows.size());    // (周期内の位置, 区間番号)
+        std::vector<uint64_t> wantedBits(( period + 63 ) / 64, 0);
+        for ( size_t k = 0; k < startRows.size(); ++k ) {
+            const size_t phase = SegmentStart(n, startRows.size(), k) % period;
+            wanted[k] = { phase, k };
+            wantedBits[phase >> 6] |= uint64_t(1) << ( phase & 63 );
+        }
+        std::sort(wanted.begin(), wanted.end());
+
+        transformed.resize(n);
+        const size_t rotationPhase = rotation % period;
+        for ( size_t i = 0; i < period; ++i ) {
+            const size_t start = ( suffix_array[i] + rotation ) % n;
+            const char last = data[( start + n - 1 ) % n];
+            for ( size_t r = 0; r < repeat; ++r ) {
+                transformed[i * repeat + r] = last;
+            }
+            // start % period を割り算なしで求める (suffix_array[i] < period)
+            size_t phase = suffix_array[i] + rotationPhase;
+            if ( phase >= period ) phase -= period;
+            if ( !( ( wantedBits[phase >> 6] >> ( phase & 63 ) ) & 1 ) ) continue;
+            auto it = std::lower_bound(wanted.begin(), wanted.end(), std::make_pair(phase, size_t(0)));
+            for ( ; it != wanted.end() && it->first == phase; ++it ) {
+                startRows[it->second] = i * repeat;
             }
         }
-        return { transformed, primary_index };
     }
 
-    std::vector<char> Bwt::InverseTransform(const BwtResult& bwtResult) {
-        const auto& L = bwtResult.first;
-        const size_t primary_index = bwtResult.second;
-        const size_t n = L.size();
-        if ( n == 0 ) return {};
+    namespace {
+        // 計数で求めた逆LF写像 (F の行 -> 同じ文字の L の行) と L の文字を1語に詰めた表で復元する
+        // Entry の下位8ビットが L[i]、残りが次に読む行。1回の読み込みで文字と次の位置が得られる
+        template<typename Entry>
+        void InverseTransformWithTable(std::span<const char> L, std::span<const size_t> startRows, std::vector<char>& original, unsigned threads) {
+            const size_t n = L.size();
+            size_t count[256] = {};
+            for ( char c : L ) count[static_cast<unsigned char>( c )]++;
+            size_t sum = 0;
+            for ( size_t c = 0; c < 256; ++c ) {
+                const size_t k = count[c];
+                count[c] = sum;
+                sum += k;
+            }
 
-        //  C_ 
-        std::vector<std::pair<unsigned char, int>> pairs(n);
-        for ( size_t i = 0; i < n; ++i ) {
-            pairs[i] = { static_cast<unsigned char>( L[i] ), static_cast<int>( i ) };
+            std::vector<Entry> table(n);
+            for ( size_t i = 0; i < n; ++i ) table[i] = static_cast<unsigned char>( L[i] );
+            for ( size_t i = 0; i < n; ++i ) {
+                table[count[static_cast<unsigned char>( L[i] )]++] |= static_cast<Entry>( i ) << 8;
+            }
+
+            // 各区間を独立にたどる。区間 k は startRows[k] の行から始まる回転を先頭から復元したもの
+            // 1スレッドが INTERLEAVE 個の区間を交互に1文字ずつ進め、表の読み込みの待ち時間を重ねる
+            constexpr size_t INTERLEAVE = 4;
+            original.resize(n);
+            const size_t segments = startRows.size();
+            const size_t groups = ( segments + INTERLEAVE - 1 ) / INTERLEAVE;
+            ParallelFor(groups, threads, [ & ] (size_t g) {
+                const size_t first = g * INTERLEAVE;
+                const size_t ways = std::min(INTERLEAVE, segments - first);
+                size_t pos[INTERLEAVE];
+                size_t out[INTERLEAVE];
+                size_t end[INTERLEAVE];
+                size_t common = SIZE_MAX;
+                for ( size_t w = 0; w < ways; ++w ) {
+                    pos[w] = static_cast<size_t>( table[startRows[first + w]] >> 8 );
+                    out[w] = Bwt::SegmentStart(n, segments, first + w);
+                    end[w] = Bwt::SegmentStart(n, segments, first + w + 1);
+                    common = std::min(common, end[w] - out[w]);
+                }
+                for ( size_t i = 0; i < common; ++i ) {
+                    for ( size_t w = 0; w < ways; ++w ) {
+                        const Entry entry = table[pos[w]];
+                        original[out[w]++] = static_cast<char>( entry & 0xFF );
+                        pos[w] = static_cast<size_t>( entry >> 8 );
+                    }
+                }
+                for ( size_t w = 0; w < ways; ++w ) {
+                    for ( ; out[w] < end[w]; ++out[w] ) {
+                        const Entry entry = table[pos[w]];
+                        original[out[w]] = static_cast<char>( entry & 0xFF );
+                        pos[w] = static_cast<size_t>( entry >> 8 );
+                    }
+                }
+            });
         }
-        std::sort(pairs.begin(), pairs.end());
+    }
 
-        std::vector<int> T(n);
-        for ( size_t i = 0; i < n; ++i ) {
-            T[pairs[i].second] = i;
+    void Bwt::InverseTransform(std::span<const char> L, size_t primary_index, std::vector<char>& original) {
+        InverseTransform(L, std::span<const size_t>(&primary_index, 1), original, 1);
+    }
+
+    void Bwt::InverseTransform(std::span<const char> L, std::span<const size_t> startRows, std::vector<char>& original, unsigned threads) {
+        const size_t n = L.size();
+        original.clear();
+        if ( n == 0 || startRows.empty() ) return;
+        for ( size_t row : startRows ) {
+            if ( row >= n ) return;
         }
 
-        std::vector<char> original(n);
-        size_t current_index = primary_index;
-        for ( int i = n - 1; i >= 0; --i ) {
-            original[i] = L[current_index];
-            current_index = T[current_index];
+        // 行番号が24ビットに収まれば4バイト、そうでなければ8バイトの表を使う
+        if ( n <= ( size_t(1) << 24 ) ) {
+            InverseTransformWithTable<uint32_t>(L, startRows, original, threads);
+        }
+        else {
+            InverseTransformWithTable<uint64_t>(L, startRows, original, threads);
         }
-        return original;
     }
-}
\ No newline at end of file
+}
@@ -1,5 +1,6 @@
 #pragma once
 #include <vector>
+#include <span>
 #include <cstdint>
 
 namespace Cmp {
@@ -8,7 +9,31 @@ namespace Cmp {
         // first is the transformed data, second is the original index
         using BwtResult = std::pair<std::vector<char>, size_t>;
 
-        static BwtResult Transform(const std::vector<char>& data);
-        static std::vector<char> InverseTransform(const BwtResult& bwtResult);
+        // 変換結果を out に書き込み、元の文字列の行番号 (primary index) を返す
+        static size_t Transform(std::span<const char> data, std::vector<char>& out);
+        static void InverseTransform(std::span<const char> lastColumn, size_t primaryIndex, std::vector<char>& out);
+
+        // 入力を startRows.size() 個の区間に分け、各区間の先頭から始まる回転の行番号を startRows に書き込む
+        // startRows[0] は primary index と同じ。区間ごとに独立して (並列に) 逆変換できる
+        static void Transform(std::span<const char> data, std::vector<char>& out, std::span<size_t> startRows);
+        // 行番号が範囲外の場合 out は空になる。threads が 0 の場合はハードウェアの並列数を使う
+        static void InverseTransform(std::span<const char> lastColumn, std::span<const size_t> startRows, std::vector<char>& out, unsigned threads = 1);
+
+        // 長さ n を count 個に分けたときの区間 k の先頭位置 (k == count は n)
+        static size_t SegmentStart(size_t n, size_t count, size_t k) {
+            return static_cast<size_t>( static_cast<uint64_t>( n ) * k / count );
+        }
+
+        // 新しいバッファを返す版
+        static BwtResult Transform(std::span<const char> data) {
+            BwtResult result;
+            result.second = Transform(data, result.first);
+            return result;
+        }
+        static std::vector<char> InverseTransform(const BwtResult& bwtResult) {
+            std::vector<char> out;
+            InverseTransform(bwtResult.first, bwtResult.second, out);
+            return out;
+        }
     };
-}
\ No newline at end of file
+}
@@ -0,0 +1,159 @@
+#include "bwt_block.h"
+#include "bwt.h"
+#include "mtf.h"
+#include "entropy_coder.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <atomic>
+
+namespace Cmp {
+    namespace {
+        void WriteUint32(std::vector<char>& out, uint32_t value) {
+            out.push_back(( value >> 24 ) & 0xFF);
+            out.push_back(( value >> 16 ) & 0xFF);
+            out.push_back(( value >> 8 ) & 0xFF);
+            out.push_back(value & 0xFF);
+        }
+
+        uint32_t ReadUint32(std::span<const char> in, size_t offset) {
+            uint32_t value = 0;
+            value |= static_cast<uint32_t>( static_cast<uint8_t>( in[offset] ) ) << 24;
+            value |= static_cast<uint32_t>( static_cast<uint8_t>( in[offset + 1] ) ) << 16;
+            value |= static_cast<uint32_t>( static_cast<uint8_t>( in[offset + 2] ) ) << 8;
+            value |= static_cast<uint32_t>( static_cast<uint8_t>( in[offset + 3] ) );
+            return value;
+        }
+    }
+
+    // BWTの出力を output に一時的に置き、開始位置 + L を work にまとめて MTF (+RLE0) -> エントロピー符号化
+    void BwtBlock::CompressBlock(std::span<const char> block, Entropy entropy, Stage stage, Header header, std::vector<char>& output) {
+        std::vector<size_t> startRows(1);
+        if ( header == Header::SEGMENT_STARTS ) {
+            startRows.resize(std::clamp<size_t>(block.size() / MIN_SEGMENT_SIZE, 1, MAX_SEGMENTS));
+        }
+        Bwt::Transform(block, output, startRows);
+
+        std::vector<char> work;
+        work.reserve(output.size() + 1 + startRows.size() * 4);
+        if ( header == Header::SEGMENT_STARTS ) work.push_back(static_cast<char>( startRows.size() ));
+        for ( size_t row : startRows ) WriteUint32(work, static_cast<uint32_t>( row ));
+        work.insert(work.end(), output.begin(), output.end());
+        if ( stage == Stage::MTF_ZERO_RUN ) {
+            Mtf::TransformZeroRun(work, output);
+            work.swap(output);
+        }
+        else {
+            Mtf::TransformInPlace(work);
+        }
+        EntropyCoder::Compress(work, entropy, output);
+    }
+
+    void BwtBlock::DecompressBlock(std::span<const char> data, Entropy entropy, Stage stage, Header header, std::vector<char>& output, unsigned threads) {
+        // 逆変換前の work は [区間の数(1)] [開始位置(4) * 区間数] [L] を超えない
+        // RLE0 は1バイトを最大2バイト (ESCAPE + 番号) にするので、エントロピー復号の出力はその2倍まで
+        constexpr size_t maxWorkSize = MAX_BLOCK_SIZE + 1 + MAX_SEGMENTS * 4;
+        std::vector<char> work;
+        EntropyCoder::Decompress(data, entropy, work, stage == Stage::MTF_ZERO_RUN ? maxWorkSize * 2 : maxWorkSize);
+        if ( stage == Stage::MTF_ZERO_RUN ) {
+            // output を一時的に使い、逆変換の結果を work に戻す
+            const bool ok = Mtf::InverseTransformZeroRun(work, output, maxWorkSize);
+            work.swap(output);
+            if ( !ok ) work.clear();
+        }
+        else {
+            Mtf::InverseTransformInPlace(work);
+        }
+        output.clear();
+
+        size_t readPtr = 0;
+        size_t segments = 1;
+        if ( header == Header::SEGMENT_STARTS ) {
+            if ( work.empty() ) return;
+            segments = static_cast<uint8_t>( work[readPtr++] );
+            if ( segments == 0 || segments > MAX_SEGMENTS ) return;
+        }
+        if ( work.size() < readPtr + segments * 4 ) return;
+        std::vector<size_t> startRows(segments);
+        for ( size_t k = 0; k < segments; ++k, readPtr += 4 ) startRows[k] = ReadUint32(work, readPtr);
+
+        std::span<const char> bwt_data = std::span<const char>(work).subspan(readPtr);
+        Bwt::InverseTransform(bwt_data, startRows, output, threads);
+    }
+
+    // 形式: [ブロック数(4)] { [元サイズ(4)] [圧縮サイズ(4)] [CompressBlockの出力] } * ブロック数
+    void BwtBlock::Compress(std::span<const char> data, Entropy entropy, Stage stage, Header header, std::vector<char>& output, size_t blockSize, unsigned threads) {
+        blockSize = std::clamp(blockSize, MIN_BLOCK_SIZE, MAX_BLOCK_SIZE);
+        const size_t blockCount = ( data.size() + blockSize - 1 ) / blockSize;
+
+        std::vector<std::vector<char>> compressedBlocks(blockCount);
+        ParallelFor(blockCount, threads, [ & ] (size_t i) {
+            const size_t begin = i * blockSize;
+            const size_t end = std::min(begin + blockSize, data.size());
+            CompressBlock(data.subspan(begin, end - begin), entropy, stage, header, compressedBlocks[i]);
+        });
+
+        size_t totalSize = 4;
+        for ( const auto& block : compressedBlocks ) totalSize += 8 + block.size();
+
+        output.clear();
+        output.reserve(totalSize);
+        WriteUint32(output, static_cast<uint32_t>( blockCount ));
+        for ( size_t i = 0; i < blockCount; ++i ) {
+            const size_t begin = i * blockSize;
+            const size_t end = std::min(begin + blockSize, data.size());
+            WriteUint32(output, static_cast<uint32_t>( end - begin ));
+            WriteUint32(output, static_cast<uint32_t>( compressedBlocks[i].size() ));
+            output.insert(output.end(), compressedBlocks[i].begin(), compressedBlocks[i].end());
+        }
+    }
+
+    void BwtBlock::Decompress(std::span<const char> data, Entropy entropy, Stage stage, Header header, std::vector<char>& output, unsigned threads) {
+        output.clear();
+        if ( data.size() < 4 ) return;
+        const uint32_t blockCount = ReadUint32(data, 0);
+
+        // 1. ブロック表を読み、各ブロックの位置を求める
+        struct BlockInfo {
+            size_t offset;
+            uint32_t originalSize;
+            uint32_t compressedSize;
+            size_t outputOffset;
+        };
+        std::vector<BlockInfo> blocks;
+        blocks.reserve(std::min<size_t>(blockCount, data.size() / 8));
+        size_t readPtr = 4;
+        size_t totalSize = 0;
+        for ( uint32_t i = 0; i < blockCount; ++i ) {
+            if ( readPtr + 8 > data.size() ) return;
+            BlockInfo info;
+            info.originalSize = ReadUint32(data, readPtr);
+            info.compressedSize = ReadUint32(data, readPtr + 4);
+            info.offset = readPtr + 8;
+            info.outputOffset = totalSize;
+            // 圧縮時のブロックは 1..MAX_BLOCK_SIZE バイト。壊れたサイズで巨大な出力を確保しないよう、確保の前に弾く
+            if ( info.originalSize == 0 || info.originalSize > MAX_BLOCK_SIZE ) return;
+            if ( info.offset + info.compressedSize > data.size() ) return;
+            readPtr = info.offset + info.compressedSize;
+            totalSize += info.originalSize;
+            blocks.push_back(info);
+        }
+
+        // 2. 各ブロックを並列に逆変換し、出力バッファの該当位置へ書き込む
+        //    ブロック数がスレッド数より少なければ、余ったスレッドをブロック内の区間に割り当てる
+        const unsigned threadCount = ResolveThreadCount(threads);
+        const unsigned innerThreads = std::max<unsigned>(1, static_cast<unsigned>( threadCount / std::max<size_t>(1, blocks.size()) ));
+        output.resize(totalSize);
+        std::atomic<bool> failed{ false };
+        ParallelFor(blocks.size(), threadCount, [ & ] (size_t i) {
+            const BlockInfo& info = blocks[i];
+            std::vector<char> block;
+            DecompressBlock(data.subspan(info.offset, info.compressedSize), entropy, stage, header, block, innerThreads);
+            if ( block.size() != info.originalSize ) {
+                failed = true;
+                return;
+            }
+            std::copy(block.begin(), block.end(), output.begin() + info.outputOffset);
+        });
+        if ( failed ) output.clear();
+    }
+}
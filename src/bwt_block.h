@@ -0,0 +1,41 @@
+#pragma once
+#include <vector>
+#include <span>
+#include <cstdint>
+#include "FileFormat.h"
+
+namespace Cmp {
+    // BWT -> MTF -> エントロピー符号化 をブロック単位で行うパイプライン
+    class BwtBlock {
+    public:
+        static constexpr size_t DEFAULT_BLOCK_SIZE = 1 << 20;
+        static constexpr size_t MIN_BLOCK_SIZE = 64 * 1024;
+        static constexpr size_t MAX_BLOCK_SIZE = 64 * 1024 * 1024;
+
+        // BWTとエントロピー符号化の間に挟む段
+        enum class Stage : uint8_t {
+            MTF,            // MTFのみ (BWT_HUFFMAN / BWT_BLOCK_HUFFMAN)
+            MTF_ZERO_RUN,   // MTF + 0の連続の短縮 (BWT_BLOCK_ZERO_RUN)
+        };
+
+        // BWTの出力の前に置く、逆変換の開始位置
+        enum class Header : uint8_t {
+            PRIMARY_INDEX,  // [primary index(4)] (BWT_HUFFMAN / BWT_BLOCK_HUFFMAN / BWT_BLOCK_ZERO_RUN)
+            SEGMENT_STARTS, // [区間数(1)] [各区間の開始行(4)] * 区間数 (BWT_BLOCK_SEGMENTED)
+        };
+
+        // SEGMENT_STARTS で1区間あたりの最小サイズと最大区間数
+        static constexpr size_t MIN_SEGMENT_SIZE = 128 * 1024;
+        static constexpr size_t MAX_SEGMENTS = 64;
+
+        // データを blockSize ごとに分割し、各ブロックを独立して並列に圧縮する
+        // threads が 0 の場合はハードウェアの並列数を使う。出力は output の中身を置き換える
+        static void Compress(std::span<const char> data, Entropy entropy, Stage stage, Header header, std::vector<char>& output, size_t blockSize = DEFAULT_BLOCK_SIZE, unsigned threads = 0);
+        static void Decompress(std::span<const char> data, Entropy entropy, Stage stage, Header header, std::vector<char>& output, unsigned threads = 0);
+
+        // 単一ブロックの圧縮・解凍 (PRIMARY_INDEX は従来のBWT_HUFFMAN形式)
+        // threads はブロック内の区間を並列に逆変換するときのスレッド数
+        static void CompressBlock(std::span<const char> block, Entropy entropy, Stage stage, Header header, std::vector<char>& output);
+        static void DecompressBlock(std::span<const char> data, Entropy entropy, Stage stage, Header header, std::vector<char>& output, unsigned threads = 1);
+    };
+}
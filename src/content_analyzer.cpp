@@ -0,0 +1,154 @@
+#include "content_analyzer.h"
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <string_view>
+
+namespace Cmp {
+    namespace {
+        // テキストと判定する、標本に占めるテキストのバイトの割合
+        constexpr double TEXT_RATIO = 0.98;
+        // これ以上のエントロピー (bits/byte) で、差分でも下がらないデータは圧縮できないものとする
+        // 一様乱数でも 256KB の標本では 7.999 程度になる。zip・png・mp3 などは 7.95 を超える
+        constexpr double INCOMPRESSIBLE_ENTROPY = 7.95;
+        // ヘッダのない数値データで差分を試し圧縮の候補にするのに必要なエントロピーの減少 (bits/byte)
+        constexpr double DELTA_GAIN = 0.5;
+
+        uint16_t ReadLe16(std::span<const char> data, size_t offset) {
+            return static_cast<uint16_t>( static_cast<uint8_t>( data[offset] ) | ( static_cast<uint8_t>( data[offset + 1] ) << 8 ) );
+        }
+
+        uint32_t ReadLe32(std::span<const char> data, size_t offset) {
+            return static_cast<uint32_t>( ReadLe16(data, offset) ) | ( static_cast<uint32_t>( ReadLe16(data, offset + 2) ) << 16 );
+        }
+
+        // magic に '\0' を含む場合は長さ付きで渡す ("PE\0\0"sv など)
+        bool StartsWith(std::span<const char> data, size_t offset, std::string_view magic) {
+            return data.size() >= offset + magic.size() && std::memcmp(data.data() + offset, magic.data(), magic.size()) == 0;
+        }
+
+        double Entropy(const std::array<size_t, 256>& counts, size_t total) {
+            if ( total == 0 ) return 0;
+            double bits = 0;
+            for ( size_t count : counts ) {
+                if ( count == 0 ) continue;
+                const double p = static_cast<double>( count ) / total;
+                bits -= p * std::log2(p);
+            }
+            return bits;
+        }
+
+        // x86 の PE / ELF ならEXEフィルタを使う。WAV・16ビット以上のBMPは差分を優先する
+        void DetectFormat(std::span<const char> data, ContentProfile& profile) {
+            using namespace std::string_view_literals;
+            if ( StartsWith(data, 0, "MZ") && data.size() >= 0x40 ) {
+                const uint32_t peOffset = ReadLe32(data, 0x3C);
+                if ( peOffset <= data.size() - 6 && StartsWith(data, peOffset, "PE\0\0"sv) ) {
+                    const uint16_t machine = ReadLe16(data, peOffset + 4);
+                    if ( machine == 0x014C || machine == 0x8664 ) profile.format = "PE";
+                }
+            }
+            else if ( StartsWith(data, 0, "\x7F" "ELF") && data.size() >= 20 ) {
+                const uint16_t machine = ReadLe16(data, 18);
+                if ( machine == 3 || machine == 62 ) profile.format = "ELF";
+            }
+            else if ( StartsWith(data, 0, "RIFF") && StartsWith(data, 8, "WAVE") ) {
+                profile.format = "WAV";
+            }
+            else if ( StartsWith(data, 0, "BM") && data.size() >= 30 && ReadLe16(data, 28) >= 16 ) {
+                profile.format = "BMP";
+            }
+        }
+
+        template<typename Func>
+        void ForEachWindow(std::span<const char> data, Func&& func) {
+            const size_t total = ContentAnalyzer::SAMPLE_WINDOW * ContentAnalyzer::SAMPLE_WINDOWS;
+            if ( data.size() <= total ) {
+                func(data);
+                return;
+            }
+            const size_t step = ( data.size() - ContentAnalyzer::SAMPLE_WINDOW ) / ( ContentAnalyzer::SAMPLE_WINDOWS - 1 );
+            for ( size_t w = 0; w < ContentAnalyzer::SAMPLE_WINDOWS; ++w ) {
+                func(data.subspan(w * step, ContentAnalyzer::SAMPLE_WINDOW));
+            }
+        }
+    }
+
+    void ContentAnalyzer::Sample(std::span<const char> data, std::vector<char>& out) {
+        out.clear();
+        ForEachWindow(data, [ & ] (std::span<const char> window) {
+            out.insert(out.end(), window.begin(), window.end());
+        });
+    }
+
+    ContentProfile ContentAnalyzer::Analyze(std::span<const char> data) {
+        ContentProfile profile;
+        DetectFormat(data, profile);
+
+        // 1. 標本の度数・テキストらしさ・連続・stride ごとの差分の度数を1回の走査で数える
+        std::array<size_t, 256> counts{};
+        std::array<std::array<size_t, 256>, MAX_STRIDE> deltaCounts{};
+        std::array<size_t, MAX_STRIDE> deltaTotals{};
+        size_t textBytes = 0;
+        size_t runBytes = 0;
+        ForEachWindow(data, [ & ] (std::span<const char> window) {
+            const auto* p = reinterpret_cast<const uint8_t*>( window.data() );
+            size_t run = 1;
+            for ( size_t i = 0; i < window.size(); ++i ) {
+                const uint8_t c = p[i];
+                counts[c]++;
+                if ( c >= 0x20 ? c != 0x7F : ( c == '\t' || c == '\n' || c == '\r' ) ) textBytes++;
+                if ( i > 0 && c == p[i - 1] ) {
+                    run++;
+                }
+                else {
+                    if ( run >= 3 ) runBytes += run;
+                    run = 1;
+                }
+                for ( int s = 1; s <= MAX_STRIDE && s <= static_cast<int>( i ); ++s ) {
+                    deltaCounts[s - 1][static_cast<uint8_t>( c - p[i - s] )]++;
+                }
+            }
+            if ( run >= 3 ) runBytes += run;
+            for ( int s = 1; s <= MAX_STRIDE; ++s ) {
+                deltaTotals[s - 1] += window.size() > static_cast<size_t>( s ) ? window.size() - s : 0;
+            }
+            profile.sampleSize += window.size();
+        });
+        if ( profile.sampleSize == 0 ) return profile;
+
+        profile.entropy = Entropy(counts, profile.sampleSize);
+        profile.textRatio = static_cast<double>( textBytes ) / profile.sampleSize;
+        profile.runRatio = static_cast<double>( runBytes ) / profile.sampleSize;
+        profile.strideEntropy = profile.entropy;
+        for ( int s = 1; s <= MAX_STRIDE; ++s ) {
+            const double bits = Entropy(deltaCounts[s - 1], deltaTotals[s - 1]);
+            if ( deltaTotals[s - 1] > 0 && bits < profile.strideEntropy ) {
+                profile.strideEntropy = bits;
+                profile.bestStride = s;
+            }
+        }
+
+        // 2. ヘッダ -> 圧縮不能 -> テキスト -> 差分 の順に決める。どれにも当てはまらなければ試し圧縮に任せる
+        const std::string_view format = profile.format;
+        if ( format == "PE" || format == "ELF" ) {
+            profile.pipeline = Pipeline::EXECUTABLE;
+        }
+        else if ( ( format == "WAV" || format == "BMP" ) && profile.bestStride > 0 ) {
+            profile.pipeline = Pipeline::DELTA;
+            profile.stride = profile.bestStride;
+        }
+        else if ( profile.entropy >= INCOMPRESSIBLE_ENTROPY && profile.strideEntropy >= INCOMPRESSIBLE_ENTROPY ) {
+            profile.pipeline = Pipeline::INCOMPRESSIBLE;
+        }
+        else if ( profile.textRatio >= TEXT_RATIO ) {
+            profile.pipeline = Pipeline::TEXT;
+        }
+        else if ( profile.bestStride > 0 && profile.strideEntropy + DELTA_GAIN < profile.entropy ) {
+            // 連続の多いデータは差分でエントロピーが下がってもLZの方が縮むことがあるので、試し圧縮の候補に留める
+            profile.stride = profile.bestStride;
+        }
+        return profile;
+    }
+}
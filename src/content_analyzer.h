@@ -0,0 +1,44 @@
+#pragma once
+#include <vector>
+#include <span>
+#include <cstdint>
+
+namespace Cmp {
+    // 内容から予測した圧縮パイプライン
+    enum class Pipeline : uint8_t {
+        TEXT,           // BWT (テキスト)
+        EXECUTABLE,     // EXEフィルタ -> LZ (x86の実行ファイル)
+        DELTA,          // stride ごとの差分 -> LZ (音声・画像などの数値の並び)
+        INCOMPRESSIBLE, // 圧縮済み・暗号化済みのようにバイトがほぼ一様に分布する。そのまま格納する
+        UNKNOWN,        // 統計から決められない。小さな標本で RLE と LZ を試して選ぶ
+    };
+
+    // ファイルの先頭 (ヘッダ) と、全体から均等に取った標本の統計
+    struct ContentProfile {
+        Pipeline pipeline = Pipeline::UNKNOWN;
+        int stride = 0;                 // DELTA の差分間隔 (1..MAX_STRIDE)。UNKNOWN では差分を試す場合だけ設定する
+        const char* format = "";        // ヘッダから分かった形式 ("PE", "ELF", "WAV", "BMP" または空)
+
+        size_t sampleSize = 0;
+        double entropy = 0;             // 標本のオーダー0エントロピー (bits/byte)
+        double strideEntropy = 0;       // 最良の stride で差分を取った後のエントロピー
+        int bestStride = 0;
+        double textRatio = 0;           // テキストとして現れるバイトの割合
+        double runRatio = 0;            // 3バイト以上の同じ値の連続に含まれるバイトの割合
+    };
+
+    // 圧縮する前にデータの種類を推定する
+    // 全体を圧縮して比べる代わりに、ヘッダと数百KBの標本だけを見る
+    class ContentAnalyzer {
+    public:
+        static constexpr int MAX_STRIDE = 8;
+        // 標本は SAMPLE_WINDOWS 個の区間 (各 SAMPLE_WINDOW バイト) をデータ全体から均等に取る
+        static constexpr size_t SAMPLE_WINDOW = 64 * 1024;
+        static constexpr size_t SAMPLE_WINDOWS = 4;
+
+        static ContentProfile Analyze(std::span<const char> data);
+
+        // Analyze と同じ区間から標本を作る (UNKNOWN のときの試し圧縮用)
+        static void Sample(std::span<const char> data, std::vector<char>& out);
+    };
+}
@@ -0,0 +1,417 @@
+#include "context_mixing.h"
+#include "arithmetic_coder.h"
+#include "FileFormat.h"
+#include <array>
+#include <algorithm>
+#include <bit>
+
+namespace Cmp {
+    namespace {
+        constexpr int HASHED_CONTEXTS = 5;                  // オーダー2, 3, 4, 6 と単語
+        constexpr int INPUTS = 2 + HASHED_CONTEXTS + 2;     // + オーダー0, 1, 一致, バイアス
+        constexpr int MATCH_MIN = 6;                        // 一致モデルが探す最短の長さ
+        constexpr int MATCH_VERIFY = 32;                    // 見つけた一致を後ろ向きに確かめる最大の長さ
+        constexpr uint32_t MAX_MATCH_LENGTH = 0xFFFF;
+        constexpr int CONTEXT_LIMIT = 60;                  // コンテキストの計数器が学習率を下げる上限の回数
+        constexpr int MATCH_LIMIT = 1023;
+        constexpr int MIXER_SHIFT = 11;                     // ミキサの学習率 (大きいほど遅い)
+        constexpr uint32_t BUCKET_SIZE = 16;                // 確認用の値 + ニブル内の15ビット位置
+
+        // 計数器: 上位22ビットが1の確率、下位10ビットが学習した回数
+        constexpr uint32_t INITIAL_COUNTER = 1u << 31;
+
+        // ロジスティック関数 squash(x) = 4096 / (1 + e^-x/256) とその逆関数 stretch
+        // 復号する環境で浮動小数点の結果が変わらないよう、整数の折れ線で近似する
+        int Squash(int x) {
+            static constexpr int TABLE[33] = {
+                1, 2, 3, 6, 10, 16, 27, 45, 73, 120, 194, 310, 488, 747, 1101, 1546,
+                2047, 2549, 2994, 3348, 3607, 3785, 3901, 3975, 4024, 4050, 4068, 4079, 4085, 4089, 4092, 4093, 4094 };
+            if ( x > 2047 ) return 4095;
+            if ( x < -2047 ) return 1;
+            const int w = x & 127;
+            const int i = ( x >> 7 ) + 16;
+            return ( TABLE[i] * ( 128 - w ) + TABLE[i + 1] * w + 64 ) >> 7;
+        }
+
+        struct Tables {
+            std::array<int16_t, 4096> stretch;
+            std::array<int32_t, 1024> reciprocal;   // 回数 n の計数器の学習率 (65536 / (n + 1.5))
+
+            Tables() {
+                int next = 0;
+                for ( int x = -2047; x <= 2047; ++x ) {
+                    const int p = Squash(x);
+                    for ( int j = next; j <= p; ++j ) stretch[j] = static_cast<int16_t>( x );
+                    next = p + 1;
+                }
+                for ( int j = next; j < 4096; ++j ) stretch[j] = 2047;
+                for ( int n = 0; n < 1024; ++n ) reciprocal[n] = 131072 / ( 2 * n + 3 );
+            }
+        };
+        const Tables TABLES;
+
+        int Stretch(int p) { return TABLES.stretch[p]; }
+
+        int CounterP(uint32_t counter) { return static_cast<int>( counter >> 20 ); }
+
+        void UpdateCounter(uint32_t& counter, int bit, uint32_t limit) {
+            const uint32_t n = counter & 1023;
+            const int64_t p = counter >> 10;
+            const int64_t target = bit ? ( 1 << 22 ) - 1 : 0;
+            const int64_t updated = p + ( ( ( target - p ) * TABLES.reciprocal[n] ) >> 16 );
+            counter = ( static_cast<uint32_t>( updated ) << 10 ) | ( n < limit ? n + 1 : n );
+        }
+
+        uint64_t Hash(uint64_t x) {
+            x ^= x >> 31;
+            x *= 0x9E3779B97F4A7C15ull;
+            x ^= x >> 29;
+            x *= 0xBF58476D1CE4E5B9ull;
+            return x ^ ( x >> 32 );
+        }
+
+        // ハッシュしたコンテキストの表。1つのコンテキストとニブルの組に16要素 (64バイト) を割り当て、
+        // 先頭に衝突を見分ける確認用の値、残りにニブル内のビット位置ごとの計数器を置く。
+        // 隣り合う2組のどちらにも無ければ、学習した回数の少ない方を置き換える
+        class ContextTable {
+        public:
+            explicit ContextTable(int bits) : slots(size_t(1) << bits, 0), bucketMask(( ( size_t(1) << bits ) / BUCKET_SIZE ) - 1) {}
+
+            uint32_t* Bucket(uint64_t context) {
+                const uint64_t hash = Hash(context);
+                const uint32_t check = static_cast<uint32_t>( hash ) | 1;
+                const size_t index = static_cast<size_t>( hash >> 32 ) & bucketMask;
+                uint32_t* a = &slots[index * BUCKET_SIZE];
+                uint32_t* b = &slots[( index ^ 1 ) * BUCKET_SIZE];
+                if ( a[0] == check ) return a;
+                if ( b[0] == check ) return b;
+                uint32_t* victim = ( a[1] & 1023 ) <= ( b[1] & 1023 ) ? a : b;
+                victim[0] = check;
+                std::fill(victim + 1, victim + BUCKET_SIZE, INITIAL_COUNTER);
+                return victim;
+            }
+
+        private:
+            std::vector<uint32_t> slots;
+            size_t bucketMask;
+        };
+
+        // 入力の stretch 値を重み付きで足し、squash して確率にする。重みは 65536 が 1.0
+        // 重みの組は2通りのコンテキストでそれぞれ選び、2つの出力を stretch 値の平均で合わせる
+        class Mixer {
+        public:
+            static constexpr int SELECTORS = 2;
+
+            Mixer(size_t sets0, size_t sets1) {
+                weights[0].assign(sets0 * INPUTS, 1 << 14);
+                weights[1].assign(sets1 * INPUTS, 1 << 14);
+            }
+
+            void Set(int i, int value) { inputs[i] = value; }
+
+            int Mix(size_t set0, size_t set1) {
+                const size_t sets[SELECTORS] = { set0, set1 };
+                int total = 0;
+                for ( int k = 0; k < SELECTORS; ++k ) {
+                    selected[k] = &weights[k][sets[k] * INPUTS];
+                    int64_t dot = 0;
+                    for ( int i = 0; i < INPUTS; ++i ) dot += static_cast<int64_t>( inputs[i] ) * selected[k][i];
+                    const int x = static_cast<int>( std::clamp<int64_t>( dot >> 16, -2047, 2047 ) );
+                    probabilities[k] = Squash(x);
+                    total += x;
+                }
+                return Squash(total / SELECTORS);
+            }
+
+            void Update(int bit) {
+                for ( int k = 0; k < SELECTORS; ++k ) {
+                    const int error = ( bit << 12 ) - probabilities[k];
+                    for ( int i = 0; i < INPUTS; ++i ) selected[k][i] += ( inputs[i] * error ) >> MIXER_SHIFT;
+                }
+            }
+
+        private:
+            std::vector<int32_t> weights[SELECTORS];
+            std::array<int, INPUTS> inputs{};
+            int32_t* selected[SELECTORS] = {};
+            int probabilities[SELECTORS] = { 2048, 2048 };
+        };
+
+        // SSE (二次推定): コンテキストごとに、入力の確率を24区間の折れ線で補正する
+        class Apm {
+        public:
+            explicit Apm(size_t contexts) : table(contexts * 24) {
+                for ( size_t i = 0; i < table.size(); ++i ) {
+                    table[i] = static_cast<uint16_t>( Squash(static_cast<int>( ( i % 24 * 2 + 1 ) * 4096 / 48 ) - 2048) * 16 );
+                }
+            }
+
+            int Refine(int p, size_t context) {
+                const int s = ( Stretch(p) + 2048 ) * 23;
+                const int w = s & 0xFFF;
+                const size_t base = context * 24 + ( s >> 12 );
+                index = base + ( w >> 11 );
+                return ( table[base] * ( 4096 - w ) + table[base + 1] * w ) >> 16;
+            }
+
+            void Update(int bit) {
+                const int target = ( bit << 16 ) + ( bit << RATE ) - bit - bit;
+                table[index] = static_cast<uint16_t>( table[index] + ( ( target - table[index] ) >> RATE ) );
+            }
+
+        private:
+            static constexpr int RATE = 7;
+            std::vector<uint16_t> table;
+            size_t index = 0;
+        };
+
+        // 直前の MATCH_MIN バイトと同じ並びを過去から探し、その続きのバイトを予測する
+        class MatchModel {
+        public:
+            MatchModel(int bits, const uint8_t* history) : table(size_t(1) << bits, 0), mask(( size_t(1) << bits ) - 1), history(history) {
+                counters.fill(INITIAL_COUNTER);
+            }
+
+            // 1バイト確定するたびに呼ぶ。position は確定したバイト数、c は最後のバイト、recent は直近8バイト
+            void UpdateByte(size_t position, uint8_t c, uint64_t recent) {
+                if ( length > 0 && history[pointer] == c ) {
+                    length = std::min(length + 1, MAX_MATCH_LENGTH);
+                    pointer++;
+                }
+                else {
+                    length = 0;
+                }
+                if ( position < MATCH_MIN ) return;
+
+                uint32_t& slot = table[Hash(recent & 0xFFFFFFFFFFFFull) & mask];
+                if ( length == 0 && slot > 0 ) {
+                    // ハッシュの衝突を除くため、一致を後ろ向きに確かめる
+                    const size_t candidate = slot;
+                    if ( history[candidate - 1] == c ) {
+                        uint32_t verified = 1;
+                        while ( verified < MATCH_VERIFY && verified < candidate &&
+                            history[candidate - 1 - verified] == history[position - 1 - verified] ) verified++;
+                        if ( verified >= MATCH_MIN ) {
+                            length = verified;
+                            pointer = candidate;
+                        }
+                    }
+                }
+                slot = static_cast<uint32_t>( position );
+            }
+
+            // 予測する次のバイトの、これまでのビット (c0) に続くビットの stretch 値
+            int Predict(uint32_t c0, int bitPosition) {
+                active = nullptr;
+                if ( length == 0 ) return 0;
+                const uint32_t expected = history[pointer];
+                if ( ( ( expected | 256 ) >> ( 8 - bitPosition ) ) != c0 ) {
+                    length = 0;
+                    return 0;
+                }
+                expectedBit = static_cast<int>( ( expected >> ( 7 - bitPosition ) ) & 1 );
+                const uint32_t bucket = length < 16 ? length : std::min<uint32_t>(16 + std::bit_width(length) - 5, 31);
+                active = &counters[bucket * 2 + expectedBit];
+                return Stretch(CounterP(*active));
+            }
+
+            void Update(int bit) {
+                if ( !active ) return;
+                UpdateCounter(*active, bit, MATCH_LIMIT);
+                if ( bit != expectedBit ) length = 0;
+            }
+
+            uint32_t Length() const { return length; }
+
+        private:
+            std::vector<uint32_t> table;
+            size_t mask;
+            const uint8_t* history;
+            size_t pointer = 0;
+            uint32_t length = 0;
+            std::array<uint32_t, 64> counters;
+            uint32_t* active = nullptr;
+            int expectedBit = 0;
+        };
+
+        bool IsWordByte(uint8_t c) {
+            return ( c >= 'a' && c <= 'z' ) || ( c >= 'A' && c <= 'Z' );
+        }
+
+        // 全モデルをまとめた予測器。P() で次のビットが1である確率を返し、Update(bit) で学習して次のビットへ進む
+        // history は確定したバイトの列 (各バイトは8ビット目の Update より前に書き込まれていること)
+        class Predictor {
+        public:
+            Predictor(int bits, const uint8_t* history)
+                : order1(65536, INITIAL_COUNTER), match(bits - 2, history), mixer(256 * 4, 256), apm1(256), apm2(65536) {
+                order0.fill(INITIAL_COUNTER);
+                for ( int i = 0; i < HASHED_CONTEXTS; ++i ) tables.emplace_back(bits);
+                UpdateContexts();
+                Predict();
+            }
+
+            int P() const { return probability; }
+
+            void Update(int bit) {
+                // 1. 各モデルを学習する
+                UpdateCounter(order0[c0], bit, CONTEXT_LIMIT);
+                UpdateCounter(order1[( c4 & 0xFF ) << 8 | c0], bit, CONTEXT_LIMIT);
+                for ( int i = 0; i < HASHED_CONTEXTS; ++i ) UpdateCounter(buckets[i][nibble], bit, CONTEXT_LIMIT);
+                match.Update(bit);
+                mixer.Update(bit);
+                apm1.Update(bit);
+                apm2.Update(bit);
+
+                // 2. 次のビットのコンテキストへ進む
+                c0 = ( c0 << 1 ) | bit;
+                nibble = ( nibble << 1 ) | bit;
+                bitPosition++;
+                if ( bitPosition == 8 ) {
+                    const uint8_t c = static_cast<uint8_t>( c0 );
+                    position++;
+                    c8 = ( ( c8 << 8 ) | ( c4 >> 24 ) ) & 0xFFFFFFFF;
+                    c4 = ( ( c4 << 8 ) | c ) & 0xFFFFFFFF;
+                    if ( IsWordByte(c) ) {
+                        word = ( word + ( c | 0x20 ) + 1 ) * 0x2F0B3A49u;
+                    }
+                    else if ( word != 0 ) {
+                        previousWord = word;
+                        word = 0;
+                    }
+                    match.UpdateByte(position, c, ( c8 << 32 ) | c4);
+                    c0 = 1;
+                    bitPosition = 0;
+                    UpdateContexts();
+                }
+                else if ( bitPosition == 4 ) {
+                    UpdateContexts();
+                }
+                Predict();
+            }
+
+        private:
+            // バイトとニブルの境界で、各ハッシュ表の組を引き直す
+            void UpdateContexts() {
+                const uint64_t salt = static_cast<uint64_t>( c0 ) << 48;
+                const uint64_t contexts[HASHED_CONTEXTS] = {
+                    c4 & 0xFFFF,
+                    c4 & 0xFFFFFF,
+                    c4,
+                    ( ( c8 & 0xFFFF ) << 32 ) | c4,
+                    ( static_cast<uint64_t>( word ) << 16 ) ^ previousWord,
+                };
+                for ( int i = 0; i < HASHED_CONTEXTS; ++i ) {
+                    buckets[i] = tables[i].Bucket(( contexts[i] & 0xFFFFFFFFFFFFull ) ^ salt ^ ( static_cast<uint64_t>( i + 1 ) << 56 ));
+                }
+                nibble = 1;
+            }
+
+            void Predict() {
+                mixer.Set(0, Stretch(CounterP(order0[c0])));
+                mixer.Set(1, Stretch(CounterP(order1[( c4 & 0xFF ) << 8 | c0])));
+                for ( int i = 0; i < HASHED_CONTEXTS; ++i ) {
+                    const uint32_t counter = buckets[i][nibble];
+                    // まだ一度も現れていないコンテキストは何も予測しない
+                    mixer.Set(2 + i, ( counter & 1023 ) ? Stretch(CounterP(counter)) : 0);
+                }
+                mixer.Set(2 + HASHED_CONTEXTS, match.Predict(c0, bitPosition));
+                mixer.Set(3 + HASHED_CONTEXTS, 256);
+
+                const uint32_t length = match.Length();
+                const uint32_t lengthClass = length == 0 ? 0 : length < 16 ? 1 : length < 32 ? 2 : 3;
+                int p = mixer.Mix(lengthClass << 8 | c0, c4 & 0xFF);
+                p = ( p + 3 * apm1.Refine(p, c0) ) >> 2;
+                p = ( p + 3 * apm2.Refine(p, c0 | ( c4 & 0xFF ) << 8) ) >> 2;
+                probability = std::clamp(p, 1, static_cast<int>( ArithmeticCoder::PROBABILITY_ONE ) - 1);
+            }
+
+            std::array<uint32_t, 256> order0;
+            std::vector<uint32_t> order1;
+            std::vector<ContextTable> tables;
+            std::array<uint32_t*, HASHED_CONTEXTS> buckets{};
+            MatchModel match;
+            Mixer mixer;
+            Apm apm1;
+            Apm apm2;
+
+            uint32_t c0 = 1;            // 今のバイトのこれまでのビット (先頭に1を置く)
+            uint32_t nibble = 1;        // 今のニブルのこれまでのビット (先頭に1を置く)
+            int bitPosition = 0;
+            uint64_t c4 = 0;            // 直近4バイト
+            uint64_t c8 = 0;            // その前の4バイト
+            uint32_t word = 0;          // 今の単語のハッシュ
+            uint32_t previousWord = 0;
+            size_t position = 0;
+            int probability = 2048;
+        };
+
+        int TableBits(size_t memoryBudget) {
+            // ハッシュ表5つ (4バイト x 2^bits) と一致モデルの表 (4バイト x 2^(bits-2))
+            const size_t units = std::max<size_t>(1, memoryBudget / ( HASHED_CONTEXTS * 4 + 1 ));
+            return std::clamp(static_cast<int>( std::bit_width(units) ) - 1, ContextMixing::MIN_TABLE_BITS, ContextMixing::MAX_TABLE_BITS);
+        }
+
+        size_t FixedMemory() {
+            return 65536 * sizeof(uint32_t) + 65536 * 24 * sizeof(uint16_t) + 256 * INPUTS * sizeof(int32_t);
+        }
+    }
+
+    // 形式: [varint 元サイズ] [表の大きさ bits(1)] [二値算術符号]
+    void ContextMixing::Compress(std::span<const char> data, std::vector<char>& output, size_t memoryBudget) {
+        output.clear();
+        WriteVarint(output, data.size());
+        if ( data.empty() ) return;
+        const int bits = TableBits(memoryBudget);
+        output.push_back(static_cast<char>( bits ));
+
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>( data.data() );
+        Predictor predictor(bits, bytes);
+        ArithmeticCoder::BinaryEncoder encoder(output);
+        for ( size_t i = 0; i < data.size(); ++i ) {
+            const uint32_t c = bytes[i];
+            for ( int k = 7; k >= 0; --k ) {
+                const int bit = ( c >> k ) & 1;
+                encoder.Encode(bit, predictor.P());
+                predictor.Update(bit);
+            }
+        }
+        encoder.Flush();
+    }
+
+    void ContextMixing::Decompress(std::span<const char> data, std::vector<char>& output) {
+        output.clear();
+        const char* pos = data.data();
+        const char* end = data.data() + data.size();
+        uint64_t originalSize = 0;
+        if ( !ReadVarint(pos, end, originalSize) ) return;
+        if ( originalSize == 0 ) return;
+        if ( pos == end ) return;
+        const int bits = static_cast<uint8_t>( *pos++ );
+        if ( bits < MIN_TABLE_BITS || bits > MAX_TABLE_BITS ) return;
+
+        // 1ビットの確率は最大 4095/4096 なので、1バイトの符号からは約2840バイトまでしか復号できない
+        const std::span<const char> coded(pos, end);
+        if ( originalSize / 4096 > coded.size() + 4 ) return;
+
+        output.resize(static_cast<size_t>( originalSize ));
+        uint8_t* out = reinterpret_cast<uint8_t*>( output.data() );
+        Predictor predictor(bits, out);
+        ArithmeticCoder::BinaryDecoder decoder(coded);
+        for ( size_t i = 0; i < output.size(); ++i ) {
+            uint32_t c = 0;
+            for ( int k = 0; k < 8; ++k ) {
+                const int bit = decoder.Decode(predictor.P());
+                c = ( c << 1 ) | bit;
+                // 8ビット目の学習で一致モデルが history の最後のバイトを読むので、先に書き込む
+                if ( k == 7 ) out[i] = static_cast<uint8_t>( c );
+                predictor.Update(bit);
+            }
+        }
+        if ( decoder.Overrun() ) output.clear();
+    }
+
+    size_t ContextMixing::MemoryUsage(size_t memoryBudget) {
+        const size_t entries = size_t(1) << TableBits(memoryBudget);
+        return ( HASHED_CONTEXTS * entries + entries / 4 ) * sizeof(uint32_t) + FixedMemory();
+    }
+}
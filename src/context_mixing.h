@@ -0,0 +1,27 @@
+#pragma once
+#include <vector>
+#include <span>
+#include <cstdint>
+
+namespace Cmp {
+    // ビット単位のコンテキストミキシングによる圧縮 (テキスト向けの最高圧縮率モード)
+    // オーダー0～4・6と単語のコンテキスト、過去の一致の続きを予測するモデルの確率を
+    // ロジスティックミキサで合成し、2段のSSEで補正して二値算術符号で符号化する。
+    // 圧縮と復号は同じ予測を繰り返すので、どちらも1MB/s程度と遅い
+    class ContextMixing {
+    public:
+        // ハッシュ表の大きさ (要素数の2のべき乗) の範囲
+        static constexpr int MIN_TABLE_BITS = 16;
+        static constexpr int MAX_TABLE_BITS = 26;
+        static constexpr size_t DEFAULT_MEMORY = size_t(128) << 20;
+
+        // memoryBudget に収まる最大のハッシュ表で圧縮する。表の大きさは出力に記録する
+        // 出力は output の中身を置き換える (output は入力と別のバッファであること)
+        static void Compress(std::span<const char> data, std::vector<char>& output, size_t memoryBudget = DEFAULT_MEMORY);
+        // データが壊れている場合 output は空になる
+        static void Decompress(std::span<const char> data, std::vector<char>& output);
+
+        // memoryBudget で圧縮・復号したときに確保する作業メモリ
+        static size_t MemoryUsage(size_t memoryBudget);
+    };
+}
@@ -0,0 +1,93 @@
+#include "crc32c.h"
+#include <array>
+#include <cstring>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define CMP_CRC32C_X86
+#include <nmmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define CMP_TARGET_SSE42
+#else
+#define CMP_TARGET_SSE42 __attribute__(( target("sse4.2") ))
+#endif
+#endif
+
+namespace Cmp {
+    namespace {
+        constexpr uint32_t POLYNOMIAL = 0x82F63B78;     // 0x1EDC6F41 をビット反転したもの
+
+        // 8バイトずつ処理するための表 (table[k][b] は b の後に k バイトの0が続くときの値)
+        struct Tables {
+            std::array<std::array<uint32_t, 256>, 8> table;
+
+            Tables() {
+                for ( uint32_t b = 0; b < 256; ++b ) {
+                    uint32_t crc = b;
+                    for ( int i = 0; i < 8; ++i ) crc = ( crc >> 1 ) ^ ( ( crc & 1 ) ? POLYNOMIAL : 0 );
+                    table[0][b] = crc;
+                }
+                for ( uint32_t b = 0; b < 256; ++b ) {
+                    for ( int k = 1; k < 8; ++k ) table[k][b] = ( table[k - 1][b] >> 8 ) ^ table[0][table[k - 1][b] & 0xFF];
+                }
+            }
+        };
+        const Tables TABLES;
+
+        uint32_t UpdateSoftware(uint32_t crc, const uint8_t* p, size_t size) {
+            const auto& t = TABLES.table;
+            for ( ; size >= 8; size -= 8, p += 8 ) {
+                uint32_t low, high;
+                std::memcpy(&low, p, 4);
+                std::memcpy(&high, p + 4, 4);
+                low ^= crc;     // リトルエンディアンを前提とする
+                crc = t[7][low & 0xFF] ^ t[6][( low >> 8 ) & 0xFF] ^ t[5][( low >> 16 ) & 0xFF] ^ t[4][low >> 24] ^
+                    t[3][high & 0xFF] ^ t[2][( high >> 8 ) & 0xFF] ^ t[1][( high >> 16 ) & 0xFF] ^ t[0][high >> 24];
+            }
+            for ( ; size > 0; --size, ++p ) crc = ( crc >> 8 ) ^ t[0][( crc ^ *p ) & 0xFF];
+            return crc;
+        }
+
+#ifdef CMP_CRC32C_X86
+        bool DetectSse42() {
+#ifdef _MSC_VER
+            int info[4];
+            __cpuid(info, 1);
+            return ( info[2] & ( 1 << 20 ) ) != 0;
+#else
+            return __builtin_cpu_supports("sse4.2");
+#endif
+        }
+        const bool HAS_SSE42 = DetectSse42();
+
+        CMP_TARGET_SSE42 uint32_t UpdateHardware(uint32_t crc, const uint8_t* p, size_t size) {
+            uint64_t value = crc;
+            for ( ; size >= 8; size -= 8, p += 8 ) {
+                uint64_t word;
+                std::memcpy(&word, p, 8);
+                value = _mm_crc32_u64(value, word);
+            }
+            crc = static_cast<uint32_t>( value );
+            for ( ; size > 0; --size, ++p ) crc = _mm_crc32_u8(crc, *p);
+            return crc;
+        }
+#endif
+    }
+
+    uint32_t Crc32c::Update(uint32_t crc, std::span<const char> data) {
+        const uint8_t* p = reinterpret_cast<const uint8_t*>( data.data() );
+        crc = ~crc;
+#ifdef CMP_CRC32C_X86
+        if ( HAS_SSE42 ) return ~UpdateHardware(crc, p, data.size());
+#endif
+        return ~UpdateSoftware(crc, p, data.size());
+    }
+
+    bool Crc32c::IsHardwareAccelerated() {
+#ifdef CMP_CRC32C_X86
+        return HAS_SSE42;
+#else
+        return false;
+#endif
+    }
+}
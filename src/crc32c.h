@@ -0,0 +1,18 @@
+#pragma once
+#include <span>
+#include <cstdint>
+
+namespace Cmp {
+    // CRC32C (Castagnoli多項式、iSCSI/ext4 と同じ値) による整合性チェック
+    // SSE4.2 の crc32 命令が使えるCPUでは命令で、それ以外は8バイトずつの表引きで計算する
+    class Crc32c {
+    public:
+        // data の CRC32C を返す
+        static uint32_t Compute(std::span<const char> data) { return Update(0, data); }
+        // 直前までの値 crc に data を続けた CRC32C を返す (Update(Update(0, a), b) == Compute(a + b))
+        static uint32_t Update(uint32_t crc, std::span<const char> data);
+
+        // crc32 命令を使っているか
+        static bool IsHardwareAccelerated();
+    };
+}
@@ -1,23 +1,34 @@
 #include "delta.h"
 
 namespace Cmp {
-    std::vector<char> Delta::Compress(const std::vector<char>& data, int stride) {
-        if ( data.size() < stride ) return data;
+    void Delta::Compress(std::span<const char> data, std::vector<char>& out, int stride) {
+        out.assign(data.begin(), data.end());
+        CompressInPlace(out, stride);
+    }
+
+    void Delta::Decompress(std::span<const char> data, std::vector<char>& out, int stride) {
+        out.assign(data.begin(), data.end());
+        DecompressInPlace(out, stride);
+    }
+
+    void Delta::CompressInPlace(std::span<char> data, int stride) {
+        if ( stride <= 0 ) return;
+        const size_t step = static_cast<size_t>( stride );
+        if ( data.size() < step ) return;
 
-        std::vector<char> compressedData = data;
-        for ( size_t i = data.size() - 1; i >= stride; --i ) {
-            compressedData[i] = data[i] - data[i - stride];
+        // 後ろから処理すれば、参照する data[i - step] はまだ元の値のまま
+        for ( size_t i = data.size() - 1; i >= step; --i ) {
+            data[i] = data[i] - data[i - step];
         }
-        return compressedData;
     }
 
-    std::vector<char> Delta::Decompress(const std::vector<char>& data, int stride) {
-        if ( data.size() < stride ) return data;
+    void Delta::DecompressInPlace(std::span<char> data, int stride) {
+        if ( stride <= 0 ) return;
+        const size_t step = static_cast<size_t>( stride );
+        if ( data.size() < step ) return;
 
-        std::vector<char> decompressedData = data;
-        for ( size_t i = stride; i < data.size(); ++i ) {
-            decompressedData[i] = decompressedData[i] + decompressedData[i - stride];
+        for ( size_t i = step; i < data.size(); ++i ) {
+            data[i] = data[i] + data[i - step];
         }
-        return decompressedData;
     }
-}
\ No newline at end of file
+}
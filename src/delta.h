@@ -1,11 +1,21 @@
 #pragma once
 #include <vector>
+#include <span>
 
 namespace Cmp {
     class Delta {
     public:
-        // stride͍ԊuB`llB
-        static std::vector<char> Compress(const std::vector<char>& data, int stride = 4);
-        static std::vector<char> Decompress(const std::vector<char>& data, int stride = 4);
+        // strideは差分を取る間隔。音声チャンネルを考慮する。
+        // 出力は out の中身を置き換える (out は入力と別のバッファであること)
+        static void Compress(std::span<const char> data, std::vector<char>& out, int stride = 4);
+        static void Decompress(std::span<const char> data, std::vector<char>& out, int stride = 4);
+
+        // バッファをその場で変換する版
+        static void CompressInPlace(std::span<char> data, int stride = 4);
+        static void DecompressInPlace(std::span<char> data, int stride = 4);
+
+        // 新しいバッファを返す版
+        static std::vector<char> Compress(std::span<const char> data, int stride = 4) { std::vector<char> out; Compress(data, out, stride); return out; }
+        static std::vector<char> Decompress(std::span<const char> data, int stride = 4) { std::vector<char> out; Decompress(data, out, stride); return out; }
     };
-}
\ No newline at end of file
+}
@@ -0,0 +1,53 @@
+#include "entropy_coder.h"
+#include "arithmetic_coder.h"
+#include "rans.h"
+#include "huffman.h"
+
+namespace Cmp {
+    void EntropyCoder::Compress(std::span<const char> data, Entropy entropy, std::vector<char>& output) {
+        switch ( entropy ) {
+        case Entropy::STATIC_ARITHMETIC:
+            ArithmeticCoder::Compress(data, output);
+            return;
+        case Entropy::ADAPTIVE_ARITHMETIC:
+            ArithmeticCoder::CompressAdaptive(data, output);
+            return;
+        case Entropy::RANS:
+            Rans::Compress(data, output);
+            return;
+        case Entropy::HUFFMAN:
+            Huffman::Compress(data, output);
+            return;
+        }
+        output.clear();
+    }
+
+    void EntropyCoder::Decompress(std::span<const char> data, Entropy entropy, std::vector<char>& output, size_t maxSize) {
+        switch ( entropy ) {
+        case Entropy::STATIC_ARITHMETIC:
+            ArithmeticCoder::Decompress(data, output, maxSize);
+            return;
+        case Entropy::ADAPTIVE_ARITHMETIC:
+            ArithmeticCoder::DecompressAdaptive(data, output, maxSize);
+            return;
+        case Entropy::RANS:
+            Rans::Decompress(data, output, maxSize);
+            return;
+        case Entropy::HUFFMAN:
+            Huffman::Decompress(data, output, maxSize);
+            return;
+        }
+        output.clear();
+    }
+
+    bool EntropyCoder::IsSupported(Entropy entropy) {
+        switch ( entropy ) {
+        case Entropy::STATIC_ARITHMETIC:
+        case Entropy::ADAPTIVE_ARITHMETIC:
+        case Entropy::RANS:
+        case Entropy::HUFFMAN:
+            return true;
+        }
+        return false;
+    }
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include <vector>
+#include <span>
+#include <cstdint>
+#include "FileFormat.h"
+
+namespace Cmp {
+    // Entropy IDに応じて各エントロピー符号化器へ振り分ける
+    class EntropyCoder {
+    public:
+        // 出力は output の中身を置き換える (output は入力と別のバッファであること)
+        static void Compress(std::span<const char> data, Entropy entropy, std::vector<char>& output);
+        // 復号後のサイズが maxSize を超えるデータは壊れているとみなし、output を空にする
+        // (呼び出し側が知っている元サイズから上限を与え、壊れたヘッダで巨大な出力を確保しないようにする)
+        static void Decompress(std::span<const char> data, Entropy entropy, std::vector<char>& output, size_t maxSize = SIZE_MAX);
+        // 対応しているEntropy IDかどうか
+        static bool IsSupported(Entropy entropy);
+
+        // 新しいバッファを返す版
+        static std::vector<char> Compress(std::span<const char> data, Entropy entropy) { std::vector<char> out; Compress(data, entropy, out); return out; }
+        static std::vector<char> Decompress(std::span<const char> data, Entropy entropy) { std::vector<char> out; Decompress(data, entropy, out); return out; }
+    };
+}
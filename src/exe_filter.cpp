@@ -1,34 +1,58 @@
 #include "exe_filter.h"
+#include <cstdint>
+#include <cstring>
 
 namespace Cmp {
-    // x86̑CALL߂̃IyR[h
+    // x86の相対CALL命令のオペコード
     constexpr unsigned char X86_OPCODE_CALL = 0xE8;
 
-    std::vector<char> ExeFilter::Transform(const std::vector<char>& data) {
-        std::vector<char> result = data;
-        for ( size_t i = 0; i + 4 < result.size(); ++i ) {
-            if ( static_cast<unsigned char>( result[i] ) == X86_OPCODE_CALL ) {
-                // CALL߂ɑ4oCg̑΃AhX擾
-                uint32_t addr = *reinterpret_cast<uint32_t*>( &result[i + 1] );
-                // sAhXvZ
-                uint32_t dest = ( i + 5 ) + addr;
-                // Kił͒PɌ̒lƕϊ̒lXORȂǂ̊ȒPȕϊj
-                *reinterpret_cast<uint32_t*>( &result[i + 1] ) = dest;
+    namespace {
+        uint32_t LoadUint32(const char* p) {
+            uint32_t value;
+            std::memcpy(&value, p, sizeof(value));
+            return value;
+        }
+
+        void StoreUint32(char* p, uint32_t value) {
+            std::memcpy(p, &value, sizeof(value));
+        }
+    }
+
+    void ExeFilter::Transform(std::span<const char> data, std::vector<char>& out) {
+        out.assign(data.begin(), data.end());
+        TransformInPlace(out);
+    }
+
+    void ExeFilter::InverseTransform(std::span<const char> data, std::vector<char>& out) {
+        out.assign(data.begin(), data.end());
+        InverseTransformInPlace(out);
+    }
+
+    void ExeFilter::TransformInPlace(std::span<char> data) {
+        for ( size_t i = 0; i + 4 < data.size(); ++i ) {
+            if ( static_cast<unsigned char>( data[i] ) == X86_OPCODE_CALL ) {
+                // CALL命令に続く4バイトの相対アドレスを取得
+                uint32_t addr = LoadUint32(&data[i + 1]);
+                // 行き先アドレスを計算
+                uint32_t dest = static_cast<uint32_t>( i + 5 ) + addr;
+                // 正規化（ここでは単純に元の値と変換後の値をXORするなどの簡単な変換）
+                StoreUint32(&data[i + 1], dest);
             }
         }
-        return result;
     }
 
-    std::vector<char> ExeFilter::InverseTransform(const std::vector<char>& data) {
-        std::vector<char> result = data;
-        for ( size_t i = 0; i + 4 < result.size(); ++i ) {
-            if ( static_cast<unsigned char>( result[i] ) == X86_OPCODE_CALL ) {
-                // TransformƑSWbNKpƌɖ߂
-                uint32_t dest = *reinterpret_cast<uint32_t*>( &result[i + 1] );
-                uint32_t addr = dest - ( i + 5 );
-                *reinterpret_cast<uint32_t*>( &result[i + 1] ) = addr;
+    void ExeFilter::InverseTransformInPlace(std::span<char> data) {
+        // 変換は前から順に行い、位置iの判定には i-4..i-1 の変換で書き換わった後の値を使う。
+        // 位置iのバイトは i より後ろの変換では書き換わらないので、後ろから順に戻せば
+        // 各位置で変換時と同じ判定になり、正確に元に戻る。
+        if ( data.size() < 5 ) return;
+        for ( size_t i = data.size() - 5; ; --i ) {
+            if ( static_cast<unsigned char>( data[i] ) == X86_OPCODE_CALL ) {
+                uint32_t dest = LoadUint32(&data[i + 1]);
+                uint32_t addr = dest - static_cast<uint32_t>( i + 5 );
+                StoreUint32(&data[i + 1], addr);
             }
+            if ( i == 0 ) break;
         }
-        return result;
     }
-}
\ No newline at end of file
+}
@@ -1,11 +1,20 @@
 #pragma once
 #include <vector>
+#include <span>
 
 namespace Cmp {
     class ExeFilter {
     public:
-        // is_compresstrueȂϊAfalseȂtϊ
-        static std::vector<char> Transform(const std::vector<char>& data);
-        static std::vector<char> InverseTransform(const std::vector<char>& data);
+        // 出力は out の中身を置き換える (out は入力と別のバッファであること)
+        static void Transform(std::span<const char> data, std::vector<char>& out);
+        static void InverseTransform(std::span<const char> data, std::vector<char>& out);
+
+        // バッファをその場で変換する版
+        static void TransformInPlace(std::span<char> data);
+        static void InverseTransformInPlace(std::span<char> data);
+
+        // 新しいバッファを返す版
+        static std::vector<char> Transform(std::span<const char> data) { std::vector<char> out; Transform(data, out); return out; }
+        static std::vector<char> InverseTransform(std::span<const char> data) { std::vector<char> out; InverseTransform(data, out); return out; }
     };
-}
\ No newline at end of file
+}
@@ -1,216 +1,242 @@
 #include "huffman.h"
-#include <map>
+#include "FileFormat.h"
+#include <array>
 #include <queue>
-#include <vector>
-#include <functional>
-#include <string>
-#include <stdexcept>
+#include <cstdint>
+#include <algorithm>
 
 namespace Cmp {
-    // --- wp[ ---
-    struct NodeComparer {
-        bool operator()(const std::unique_ptr<HuffmanNode>& a, const std::unique_ptr<HuffmanNode>& b) const {
-            return a->freq > b->freq;
-        }
-    };
-
-    // rbgPʂ݂̏⏕NX
-    class BitStreamWriter {
-    public:
-        void WriteBit(bool bit) {
-            buffer |= ( bit << ( 7 - bitCount ) );
-            bitCount++;
-            if ( bitCount == 8 ) {
-                stream.push_back(buffer);
-                buffer = 0;
-                bitCount = 0;
-            }
-        }
-        void WriteByte(char byte) {
-            for ( int i = 7; i >= 0; --i ) {
-                WriteBit(( byte >> i ) & 1);
-            }
-        }
-        std::vector<char> GetStream() {
-            if ( bitCount > 0 ) {
-                stream.push_back(buffer);
+    namespace {
+        constexpr int TABLE_BITS = Huffman::MAX_CODE_LENGTH;
+        constexpr uint32_t TABLE_SIZE = 1u << TABLE_BITS;
+        constexpr size_t LENGTHS_SIZE = 128;    // 256シンボル x 4ビット
+
+        using Counts = std::array<uint64_t, 256>;
+        using Lengths = std::array<uint8_t, 256>;
+
+        // 頻度からハフマン符号の長さを求める
+        // 最長が MAX_CODE_LENGTH を超えたら頻度を半分にして (偏りを弱めて) 作り直す
+        void BuildLengths(const Counts& counts, Lengths& lengths) {
+            Counts freq = counts;
+            for ( ;; ) {
+                lengths.fill(0);
+                // 葉 0..255 と内部ノード 256.. を parent でつなぐ
+                std::array<int, 512> parent{};
+                using Node = std::pair<uint64_t, int>;
+                std::priority_queue<Node, std::vector<Node>, std::greater<Node>> queue;
+                for ( int s = 0; s < 256; ++s ) {
+                    if ( freq[s] > 0 ) queue.push({ freq[s], s });
+                }
+                if ( queue.size() == 1 ) {
+                    lengths[queue.top().second] = 1;
+                    return;
+                }
+                int next = 256;
+                while ( queue.size() > 1 ) {
+                    const Node a = queue.top(); queue.pop();
+                    const Node b = queue.top(); queue.pop();
+                    parent[a.second] = next;
+                    parent[b.second] = next;
+                    queue.push({ a.first + b.first, next++ });
+                }
+                const int root = next - 1;
+
+                int longest = 0;
+                for ( int s = 0; s < 256; ++s ) {
+                    if ( freq[s] == 0 ) continue;
+                    int depth = 0;
+                    for ( int node = s; node != root; node = parent[node] ) depth++;
+                    lengths[s] = static_cast<uint8_t>( depth );
+                    longest = std::max(longest, depth);
+                }
+                if ( longest <= Huffman::MAX_CODE_LENGTH ) return;
+                for ( auto& f : freq ) {
+                    if ( f > 0 ) f = ( f >> 1 ) | 1;
+                }
             }
-            return stream;
         }
-    private:
-        std::vector<char> stream;
-        char buffer = 0;
-        int bitCount = 0;
-    };
-
-    // rbgPʂ̓ǂݍ݂⏕NX
-    class BitStreamReader {
-    public:
-        BitStreamReader(const std::vector<char>& stream) : stream(stream) {}
-
-        bool ReadBit() {
-            if ( byteIndex >= stream.size() ) {
-                throw std::out_of_range("Reading past end of stream");
+
+        // 正準符号を割り当てる。符号は長さの短い順、同じ長さならシンボル順に連番で、
+        // ビット列は下位ビットから詰めるので、ここではビットを反転した値を返す
+        bool AssignCodes(const Lengths& lengths, std::array<uint16_t, 256>& codes) {
+            std::array<uint32_t, Huffman::MAX_CODE_LENGTH + 1> lengthCount{};
+            uint32_t kraft = 0;
+            for ( uint8_t length : lengths ) {
+                if ( length == 0 ) continue;
+                if ( length > Huffman::MAX_CODE_LENGTH ) return false;
+                lengthCount[length]++;
+                kraft += TABLE_SIZE >> length;
             }
-            bool bit = ( stream[byteIndex] >> ( 7 - bitIndex ) ) & 1;
-            bitIndex++;
-            if ( bitIndex == 8 ) {
-                bitIndex = 0;
-                byteIndex++;
+            // 符号空間を超える長さの組は復号できない (不足は使われない符号があるだけなので許す)
+            if ( kraft > TABLE_SIZE ) return false;
+
+            std::array<uint32_t, Huffman::MAX_CODE_LENGTH + 2> nextCode{};
+            uint32_t code = 0;
+            for ( int length = 1; length <= Huffman::MAX_CODE_LENGTH; ++length ) {
+                code = ( code + lengthCount[length - 1] ) << 1;
+                nextCode[length] = code;
             }
-            return bit;
-        }
-
-        char ReadByte() {
-            char byte = 0;
-            for ( int i = 7; i >= 0; --i ) {
-                if ( ReadBit() ) {
-                    byte |= ( 1 << i );
-                }
+            for ( int s = 0; s < 256; ++s ) {
+                const int length = lengths[s];
+                if ( length == 0 ) continue;
+                const uint32_t value = nextCode[length]++;
+                uint32_t reversed = 0;
+                for ( int i = 0; i < length; ++i ) reversed |= ( ( value >> i ) & 1 ) << ( length - 1 - i );
+                codes[s] = static_cast<uint16_t>( reversed );
             }
-            return byte;
+            return true;
         }
-    private:
-        const std::vector<char>& stream;
-        size_t byteIndex = 0;
-        int bitIndex = 0;
-    };
-
-    void GenerateCodes(const HuffmanNode* node, const std::string& code, std::map<char, std::string>& codeTable) {
-        if ( !node ) return;
-        if ( !node->left && !node->right ) codeTable[node->data] = code.empty() ? "0" : code;
-        GenerateCodes(node->left.get(), code + "0", codeTable);
-        GenerateCodes(node->right.get(), code + "1", codeTable);
-    }
 
-    // ؂̍\VACY
-    void SerializeTree(const HuffmanNode* node, BitStreamWriter& writer) {
-        if ( !node ) return;
-        if ( !node->left && !node->right ) {
-            writer.WriteBit(true); // tm[h'1'
-            writer.WriteByte(node->data);
+        // 復号表の1項目: 下位から シンボル1(8) シンボル2(8) 消費ビット数(8) シンボル数(8)
+        // シンボル数 0 は使われていない符号 (壊れたデータ)
+        uint32_t MakeEntry(uint32_t first, uint32_t second, uint32_t bits, uint32_t count) {
+            return first | ( second << 8 ) | ( bits << 16 ) | ( count << 24 );
         }
-        else {
-            writer.WriteBit(false); // m[h'0'
-            SerializeTree(node->left.get(), writer);
-            SerializeTree(node->right.get(), writer);
-        }
-    }
 
-    // VACYꂽf[^؂𕜌
-    std::unique_ptr<HuffmanNode> DeserializeTree(BitStreamReader& reader) {
-        if ( reader.ReadBit() ) { // '1'Ȃtm[h
-            return std::make_unique<HuffmanNode>(HuffmanNode{ reader.ReadByte() });
-        }
-        else { // '0'Ȃm[h
-            auto left = DeserializeTree(reader);
-            auto right = DeserializeTree(reader);
-            return std::make_unique<HuffmanNode>(HuffmanNode{ '\0', 0, std::move(left), std::move(right) });
+        // 8バイトをリトルエンディアンとして読む
+        uint64_t Load64(const uint8_t* p) {
+            uint64_t value = 0;
+            for ( int i = 7; i >= 0; --i ) value = ( value << 8 ) | p[i];
+            return value;
         }
     }
 
-    // --- HuffmanNX̎ ---
-    std::vector<char> Huffman::Compress(const std::vector<char>& data) {
-        if ( data.empty() ) return {};
-
-        // 1. pxvZ & 2. L[\z & 3. ؂̍\z (ύXȂ)
-        std::map<char, int> freqMap;
-        for ( char c : data ) freqMap[c]++;
-
-        std::priority_queue<std::unique_ptr<HuffmanNode>, std::vector<std::unique_ptr<HuffmanNode>>, NodeComparer> pq;
-        for ( auto const& [key, val] : freqMap ) {
-            pq.push(std::make_unique<HuffmanNode>(HuffmanNode{ key, val }));
-        }
-
-        // f[^1ނȂꍇ̑Ώ
-        if ( pq.size() == 1 ) {
-            auto single_node = std::move(const_cast<std::unique_ptr<HuffmanNode>&>( pq.top() ));
-            pq.pop();
-            auto internalNode = std::make_unique<HuffmanNode>();
-            internalNode->freq = single_node->freq;
-            internalNode->left = std::move(single_node);
-            pq.push(std::move(internalNode));
-        }
-
-        while ( pq.size() > 1 ) {
-            auto left = std::move(const_cast<std::unique_ptr<HuffmanNode>&>( pq.top() )); pq.pop();
-            auto right = std::move(const_cast<std::unique_ptr<HuffmanNode>&>( pq.top() )); pq.pop();
-            auto internalNode = std::make_unique<HuffmanNode>(HuffmanNode{ '\0', left->freq + right->freq, std::move(left), std::move(right) });
-            pq.push(std::move(internalNode));
-        }
-
-        std::unique_ptr<HuffmanNode> root = std::move(const_cast<std::unique_ptr<HuffmanNode>&>( pq.top() ));
-        pq.pop();
-
-        // 4. \̍쐬 (ύXȂ)
-        std::map<char, std::string> codeTable;
-        GenerateCodes(root.get(), "", codeTable);
-
-        // 5. ؂̍\ƕꂽf[^oCgɂ܂Ƃ߂
-        BitStreamWriter writer;
-
-        // (a) ؂̍\
-        SerializeTree(root.get(), writer);
-
-        // (b) f[^̃TCY(uint32_t)
-        uint32_t originalSize = static_cast<uint32_t>( data.size() );
-        writer.WriteByte(( originalSize >> 24 ) & 0xFF);
-        writer.WriteByte(( originalSize >> 16 ) & 0xFF);
-        writer.WriteByte(( originalSize >> 8 ) & 0xFF);
-        writer.WriteByte(originalSize & 0xFF);
-
-        // (c) f[^
+    // 形式: [varint 元サイズ] [符号長 128バイト (偶数シンボルが下位4ビット)] [ビット列 (下位ビットから)]
+    void Huffman::Compress(std::span<const char> data, std::vector<char>& output) {
+        output.clear();
+        WriteVarint(output, data.size());
+        if ( data.empty() ) return;
+
+        Counts counts{};
+        for ( char c : data ) counts[static_cast<uint8_t>( c )]++;
+        Lengths lengths;
+        BuildLengths(counts, lengths);
+        std::array<uint16_t, 256> codes{};
+        AssignCodes(lengths, codes);
+
+        for ( size_t i = 0; i < LENGTHS_SIZE; ++i ) {
+            output.push_back(static_cast<char>( lengths[i * 2] | ( lengths[i * 2 + 1] << 4 ) ));
+        }
+
+        // 出力サイズは符号長から正確に分かるので、先に確保してポインタで書く
+        uint64_t totalBits = 0;
+        for ( int s = 0; s < 256; ++s ) totalBits += counts[s] * lengths[s];
+        const size_t headerSize = output.size();
+        const size_t bodySize = static_cast<size_t>( ( totalBits + 7 ) / 8 );
+        output.resize(headerSize + bodySize + 8);
+
+        uint8_t* out = reinterpret_cast<uint8_t*>( output.data() + headerSize );
+        uint64_t bits = 0;
+        int count = 0;
         for ( char c : data ) {
-            for ( char bit : codeTable[c] ) {
-                writer.WriteBit(bit == '1');
+            const uint8_t s = static_cast<uint8_t>( c );
+            bits |= static_cast<uint64_t>( codes[s] ) << count;
+            count += lengths[s];
+            if ( count >= 32 ) {
+                for ( int i = 0; i < 4; ++i ) *out++ = static_cast<uint8_t>( bits >> ( i * 8 ) );
+                bits >>= 32;
+                count -= 32;
             }
         }
-
-        return writer.GetStream();
+        for ( ; count > 0; count -= 8, bits >>= 8 ) *out++ = static_cast<uint8_t>( bits );
+        output.resize(headerSize + bodySize);
     }
 
-    std::vector<char> Huffman::Decompress(const std::vector<char>& data) {
-        if ( data.empty() ) return {};
-
-        try {
-            BitStreamReader reader(data);
-
-            // 1. oCg񂩂؂̍\𕜌
-            auto root = DeserializeTree(reader);
-            if ( !root ) return {};
-
-            // 2. ̃f[^TCY(uint32_t)ǂݍ
-            uint32_t originalSize = 0;
-            originalSize |= static_cast<uint32_t>( static_cast<uint8_t>( reader.ReadByte() ) ) << 24;
-            originalSize |= static_cast<uint32_t>( static_cast<uint8_t>( reader.ReadByte() ) ) << 16;
-            originalSize |= static_cast<uint32_t>( static_cast<uint8_t>( reader.ReadByte() ) ) << 8;
-            originalSize |= static_cast<uint32_t>( static_cast<uint8_t>( reader.ReadByte() ) );
-
-            // 3. ؂gAf[^fR[h
-            std::vector<char> decompressedData;
-            decompressedData.reserve(originalSize);
-
-            HuffmanNode* currentNode = root.get();
-            for ( uint32_t i = 0; i < originalSize; ++i ) {
-                currentNode = root.get();
-                // tm[hɓB܂Ŗ؂ǂ
-                while ( currentNode->left || currentNode->right ) {
-                    if ( reader.ReadBit() ) { // '1'ȂE
-                        currentNode = currentNode->right.get();
-                    }
-                    else { // '0'Ȃ獶
-                        currentNode = currentNode->left.get();
-                    }
-                }
-                decompressedData.push_back(currentNode->data);
+    void Huffman::Decompress(std::span<const char> data, std::vector<char>& output, size_t maxSize) {
+        output.clear();
+        const char* pos = data.data();
+        const char* end = data.data() + data.size();
+        uint64_t originalSize = 0;
+        if ( !ReadVarint(pos, end, originalSize) ) return;
+        if ( originalSize == 0 || originalSize > maxSize ) return;
+        if ( static_cast<size_t>( end - pos ) < LENGTHS_SIZE ) return;
+
+        Lengths lengths;
+        for ( size_t i = 0; i < LENGTHS_SIZE; ++i ) {
+            const uint8_t packed = static_cast<uint8_t>( pos[i] );
+            lengths[i * 2] = packed & 0x0F;
+            lengths[i * 2 + 1] = packed >> 4;
+        }
+        pos += LENGTHS_SIZE;
+        std::array<uint16_t, 256> codes{};
+        if ( !AssignCodes(lengths, codes) ) return;
+
+        // どのシンボルも1ビット以上なので、ビット列より多くのシンボルは復号できない
+        const uint8_t* in = reinterpret_cast<const uint8_t*>( pos );
+        const size_t inSize = static_cast<size_t>( end - pos );
+        if ( originalSize > static_cast<uint64_t>( inSize ) * 8 ) return;
+
+        // 1. 1シンボルの表を作り、それを2回引いて2シンボルの表を作る
+        std::vector<uint32_t> single(TABLE_SIZE, 0);
+        for ( int s = 0; s < 256; ++s ) {
+            const uint32_t length = lengths[s];
+            if ( length == 0 ) continue;
+            for ( uint32_t i = codes[s]; i < TABLE_SIZE; i += 1u << length ) single[i] = MakeEntry(s, 0, length, 1);
+        }
+        std::vector<uint32_t> table(TABLE_SIZE);
+        for ( uint32_t i = 0; i < TABLE_SIZE; ++i ) {
+            const uint32_t first = single[i];
+            const uint32_t firstBits = ( first >> 16 ) & 0xFF;
+            table[i] = first;
+            if ( firstBits == 0 ) continue;
+            // 2つ目の符号が表のビット数に収まる場合だけ、続けて確定できる
+            const uint32_t second = single[i >> firstBits];
+            const uint32_t secondBits = ( second >> 16 ) & 0xFF;
+            if ( secondBits != 0 && firstBits + secondBits <= TABLE_BITS ) {
+                table[i] = MakeEntry(first & 0xFF, second & 0xFF, firstBits + secondBits, 2);
             }
+        }
 
-            return decompressedData;
-
+        // 2. ビット列を64ビットのバッファに補充しながら表を引く
+        //    入力の末尾より先は0として読み、最後に実際のビット数を超えていないかを確かめる
+        output.resize(static_cast<size_t>( originalSize ) + 1);
+        char* out = output.data();
+        char* const outEnd = out + originalSize;
+        uint64_t bits = 0;
+        int count = 0;
+        size_t inPos = 0;
+        auto refill = [ & ] () {
+            if ( inPos + 8 <= inSize ) {
+                bits |= Load64(in + inPos) << count;
+                inPos += ( 63 - count ) >> 3;
+                count |= 56;
+                return;
+            }
+            for ( ; count <= 56; count += 8, ++inPos ) {
+                bits |= static_cast<uint64_t>( inPos < inSize ? in[inPos] : 0 ) << count;
+            }
+        };
+
+        constexpr uint32_t MASK = TABLE_SIZE - 1;
+        bool corrupt = false;
+        // 補充1回で56ビット以上あり、4回の表引きは最大48ビットしか消費しない。出力は最大8シンボル
+        while ( outEnd - out >= 8 && !corrupt ) {
+            refill();
+            for ( int k = 0; k < 4; ++k ) {
+                const uint32_t entry = table[bits & MASK];
+                const uint32_t symbols = entry >> 24;
+                corrupt |= ( symbols == 0 );
+                out[0] = static_cast<char>( entry );
+                out[1] = static_cast<char>( entry >> 8 );
+                out += symbols;
+                bits >>= ( entry >> 16 ) & 0xFF;
+                count -= ( entry >> 16 ) & 0xFF;
+            }
         }
-        catch ( const std::out_of_range& e ) {
-            // f[^sŔ͈͊OANZXꍇ
-            return {};
+        while ( out < outEnd && !corrupt ) {
+            refill();
+            const uint32_t entry = single[bits & MASK];
+            corrupt |= ( entry >> 24 ) == 0;
+            *out++ = static_cast<char>( entry );
+            bits >>= ( entry >> 16 ) & 0xFF;
+            count -= ( entry >> 16 ) & 0xFF;
+        }
+
+        const uint64_t consumedBits = static_cast<uint64_t>( inPos ) * 8 - count;
+        if ( corrupt || out != outEnd || consumedBits > static_cast<uint64_t>( inSize ) * 8 ) {
+            output.clear();
+            return;
         }
+        output.resize(static_cast<size_t>( originalSize ));
     }
-}
\ No newline at end of file
+}
@@ -1,27 +1,23 @@
 #pragma once
 #include <vector>
-#include <string>
-#include <memory> // for std::unique_ptr
+#include <span>
+#include <cstdint>
 
 namespace Cmp {
-    // Huffman؂\m[h
-    struct HuffmanNode {
-        char data; // tm[h̏ꍇ̕
-        int freq;  // opx
-        std::unique_ptr<HuffmanNode> left = nullptr;
-        std::unique_ptr<HuffmanNode> right = nullptr;
-
-        // DxtL[Ŕr邽߂̉Zq
-        bool operator>(const HuffmanNode& other) const {
-            return freq > other.freq;
-        }
-    };
-
+    // 長さ制限付きの正準ハフマン符号による静的エントロピー符号化
+    // ヘッダは各バイトの符号長 (4ビット) だけを持ち、符号は長さとシンボルの順から復元する。
+    // 復号は MAX_CODE_LENGTH ビットの表引き1回で1つか2つのシンボルを得る (算術符号より速いが圧縮率は劣る)
     class Huffman {
     public:
-        // f[^Huffmanňk
-        static std::vector<char> Compress(const std::vector<char>& data);
-        // f[^Huffman𓀂
-        static std::vector<char> Decompress(const std::vector<char>& data);
+        static constexpr int MAX_CODE_LENGTH = 12;
+
+        // 出力は output の中身を置き換える (output は入力と別のバッファであること)
+        // データが壊れている場合や元サイズが maxSize を超える場合 output は空になる
+        static void Compress(std::span<const char> data, std::vector<char>& output);
+        static void Decompress(std::span<const char> data, std::vector<char>& output, size_t maxSize = SIZE_MAX);
+
+        // 新しいバッファを返す版
+        static std::vector<char> Compress(std::span<const char> data) { std::vector<char> out; Compress(data, out); return out; }
+        static std::vector<char> Decompress(std::span<const char> data) { std::vector<char> out; Decompress(data, out); return out; }
     };
-}
\ No newline at end of file
+}
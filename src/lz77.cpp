@@ -1,129 +1,128 @@
 #include "lz77.h"
+#include "match_finder.h"
+#include "lz_copy.h"
 #include <algorithm> // for std::min
 
 namespace Cmp {
-    // --- LZ77p[^ ---
+    // --- LZ77パラメータ ---
+    // 距離は16ビット、長さは8ビットで持つ形式なので、ウィンドウと一致長はそれに収まる範囲に限る
     namespace {
-        constexpr int WINDOW_SIZE = 65536;
-        constexpr int LOOKAHEAD_SIZE = 255;
-        constexpr int MIN_MATCH_LENGTH = 3;
-        constexpr int HASH_TABLE_SIZE = 32768;
+        constexpr size_t WINDOW_SIZE = 65536;
+        constexpr size_t LOOKAHEAD_SIZE = 255;
         constexpr int MAX_PROBES = 256;
     }
 
-    // 3oCg̃nbVvZ
-    inline int CalculateHash(const std::vector<char>& data, int pos) {
-        if ( pos + 2 >= data.size() ) return 0;
-        unsigned int h = static_cast<unsigned char>( data[pos] );
-        h = ( h << 5 ) ^ static_cast<unsigned char>( data[pos + 1] );
-        h = ( h << 5 ) ^ static_cast<unsigned char>( data[pos + 2] );
-        return h % HASH_TABLE_SIZE;
-    }
-
-    std::vector<Lz77Token> Lz77::Compress(const std::vector<char>& data) {
-        std::vector<Lz77Token> tokens;
-        if ( data.empty() ) return tokens;
+    void Lz77::Compress(std::span<const char> data, std::vector<Lz77Token>& tokens) {
+        tokens.clear();
+        if ( data.empty() ) return;
 
-        std::vector<int> head(HASH_TABLE_SIZE, -1);
-        std::vector<int> prev(data.size(), -1);
+        const std::span<const uint8_t> bytes(reinterpret_cast<const uint8_t*>( data.data() ), data.size());
+        MatchFinderParams params;
+        params.type = MatchFinderType::HASH_CHAIN;
+        params.windowSize = WINDOW_SIZE;
+        params.depth = MAX_PROBES;
+        params.niceLength = LOOKAHEAD_SIZE;
+        auto finder = MatchFinder::Create(bytes, params);
+        std::vector<Match> matches;
 
-        int cursor = 0;
+        size_t cursor = 0;
         while ( cursor < data.size() ) {
-            // 1. ܂݂̈ʒuōŒvT
-            int best_match_length = 0;
-            int best_match_distance = 0;
-            if ( cursor + MIN_MATCH_LENGTH <= data.size() ) {
-                int hash = CalculateHash(data, cursor);
-                int current_pos = head[hash];
-                int probes = 0;
-                while ( current_pos != -1 && cursor - current_pos < WINDOW_SIZE && probes < MAX_PROBES ) {
-                    int current_match_length = 0;
-                    while ( current_match_length < LOOKAHEAD_SIZE &&
-                        cursor + current_match_length < data.size() &&
-                        current_pos + current_match_length < data.size() &&
-                        data[current_pos + current_match_length] == data[cursor + current_match_length] ) {
-                        current_match_length++;
-                    }
-                    if ( current_match_length > best_match_length ) {
-                        best_match_length = current_match_length;
-                        best_match_distance = cursor - current_pos;
-                    }
-                    current_pos = prev[current_pos];
-                    probes++;
-                }
+            // 1. 現在の位置で最長一致を探す (一致の後ろに nextChar が必ず残るように長さを制限する)
+            const size_t maxLength = std::min(LOOKAHEAD_SIZE, data.size() - cursor - 1);
+            matches.clear();
+            if ( maxLength >= finder->MinLength() ) {
+                finder->Find(cursor, maxLength, matches);
             }
 
-            if ( best_match_length < MIN_MATCH_LENGTH ) best_match_length = 0;
-            if ( cursor + best_match_length >= data.size() ) best_match_length = 0;
-
-            // 2. g[N𐶐
-            if ( best_match_length > 0 ) {
-                tokens.push_back({ (uint16_t)best_match_distance, (uint8_t)best_match_length, data[cursor + best_match_length] });
+            // 2. トークンを生成
+            if ( !matches.empty() ) {
+                const Match& best = matches.back();
+                tokens.push_back({ static_cast<uint16_t>( best.distance ), static_cast<uint8_t>( best.length ), data[cursor + best.length] });
+                cursor += best.length + 1;
             }
             else {
                 tokens.push_back({ 0, 0, data[cursor] });
-            }
-
-            // 3. nbV}AJ[\i߂
-            int advance = ( best_match_length > 0 ) ? ( best_match_length + 1 ) : 1;
-            for ( int i = 0; i < advance; ++i ) {
-                if ( cursor + MIN_MATCH_LENGTH <= data.size() ) {
-                    int hash = CalculateHash(data, cursor);
-                    prev[cursor] = head[hash];
-                    head[hash] = cursor;
-                }
                 cursor++;
-                if ( cursor >= data.size() ) break;
             }
         }
-        return tokens;
     }
 
-    std::vector<char> Lz77::Decompress(const std::vector<Lz77Token>& tokens) {
-        std::vector<char> decompressedData;
+    void Lz77::Decompress(std::span<const Lz77Token> tokens, std::vector<char>& decompressedData) {
+        // 出力サイズはトークンから決まるので、先に確保してから書き込む
+        size_t total = 0;
+        for ( const auto& token : tokens ) total += token.length + 1;
+        decompressedData.resize(total + WILD_COPY_SLACK);
 
+        char* const base = decompressedData.data();
+        char* dst = base;
         for ( const auto& token : tokens ) {
             if ( token.length > 0 ) {
-                // vꍇ̃g[N (distance, length, nextChar)
-                // ɏo͂f[^̒A(distance)kʒu(length)Rs[
-                int startIndex = decompressedData.size() - token.distance;
-                for ( int i = 0; i < token.length; ++i ) {
-                    decompressedData.push_back(decompressedData[startIndex + i]);
+                // 既に出力したデータの中から、(distance)だけ遡った位置から(length)文字をコピーする
+                if ( token.distance == 0 || token.distance > static_cast<size_t>( dst - base ) ) {
+                    decompressedData.clear();
+                    return;
                 }
-                // ŌnextCharǉ
-                decompressedData.push_back(token.nextChar);
+                CopyMatch(dst, token.distance, token.length);
+                dst += token.length;
             }
-            else {
-                // vȂꍇ̃g[N (0, 0, nextChar)
-                // nextCharieĵ܂ܒǉ
-                decompressedData.push_back(token.nextChar);
+            // 最後にnextChar（一致がなければリテラル）を追加
+            *dst++ = token.nextChar;
+        }
+        decompressedData.resize(total);
+    }
+
+    bool Lz77::DecompressSerialized(std::span<const char> data, std::vector<char>& decompressedData) {
+        decompressedData.clear();
+        if ( data.size() % sizeof(Lz77Token) != 0 ) return false;
+        const uint8_t* const begin = reinterpret_cast<const uint8_t*>( data.data() );
+        const uint8_t* const end = begin + data.size();
+
+        // 1周目: 各トークンの長さだけを読んで出力サイズを求める
+        size_t total = 0;
+        for ( const uint8_t* p = begin; p < end; p += sizeof(Lz77Token) ) total += p[2] + 1;
+        decompressedData.resize(total + WILD_COPY_SLACK);
+
+        // 2周目: トークン構造体を作らずにバイト列から直接復元する
+        char* const base = decompressedData.data();
+        char* dst = base;
+        for ( const uint8_t* p = begin; p < end; p += sizeof(Lz77Token) ) {
+            const size_t distance = ( static_cast<size_t>( p[0] ) << 8 ) | p[1];
+            const size_t length = p[2];
+            if ( length > 0 ) {
+                if ( distance == 0 || distance > static_cast<size_t>( dst - base ) ) {
+                    decompressedData.clear();
+                    return false;
+                }
+                CopyMatch(dst, distance, length);
+                dst += length;
             }
+            *dst++ = static_cast<char>( p[3] );
         }
-        return decompressedData;
+        decompressedData.resize(total);
+        return true;
     }
 
-    std::vector<char> Lz77::SerializeTokens(const std::vector<Lz77Token>& tokens) {
-        std::vector<char> serializedData;
-        // eg[N4oCgɂȂƉ肵ăm
+    void Lz77::SerializeTokens(std::span<const Lz77Token> tokens, std::vector<char>& serializedData) {
+        serializedData.clear();
+        // 各トークンが4バイトになると仮定してメモリを確保
         serializedData.reserve(tokens.size() * sizeof(Lz77Token));
 
         for ( const auto& token : tokens ) {
             // distance (uint16_t -> 2 bytes)
-            serializedData.push_back(static_cast<char>( ( token.distance >> 8 ) & 0xFF )); // ʃoCg
-            serializedData.push_back(static_cast<char>( token.distance & 0xFF ));      // ʃoCg
+            serializedData.push_back(static_cast<char>( ( token.distance >> 8 ) & 0xFF )); // 上位バイト
+            serializedData.push_back(static_cast<char>( token.distance & 0xFF ));      // 下位バイト
             // length (uint8_t -> 1 byte)
             serializedData.push_back(static_cast<char>( token.length ));
             // nextChar (char -> 1 byte)
             serializedData.push_back(token.nextChar);
         }
-        return serializedData;
     }
 
-    std::vector<Lz77Token> Lz77::DeserializeTokens(const std::vector<char>& data) {
-        std::vector<Lz77Token> tokens;
+    void Lz77::DeserializeTokens(std::span<const char> data, std::vector<Lz77Token>& tokens) {
+        tokens.clear();
         if ( data.size() % sizeof(Lz77Token) != 0 ) {
-            // f[^TCYs
-            return tokens;
+            // データサイズが不正
+            return;
         }
         tokens.reserve(data.size() / sizeof(Lz77Token));
 
@@ -133,6 +132,5 @@ namespace Cmp {
             char nextChar = data[i + 3];
             tokens.push_back({ distance, length, nextChar });
         }
-        return tokens;
     }
 }
\ No newline at end of file
@@ -1,10 +1,11 @@
 #pragma once
 #include <vector>
+#include <span>
 #include <cstdint>
 #include <string>
 
 namespace Cmp {
-    // Lz77Token \͕̂ύXȂ
+    // Lz77Token 構造体は変更なし
     struct Lz77Token {
         uint16_t distance;
         uint8_t length;
@@ -13,14 +14,23 @@ namespace Cmp {
 
     class Lz77 {
     public:
-        // kE𓀊֐͕ύXȂ
-        static std::vector<Lz77Token> Compress(const std::vector<char>& data);
-        static std::vector<char> Decompress(const std::vector<Lz77Token>& tokens);
+        // 出力は tokens / out の中身を置き換える。Decompress は距離が不正なら out を空にする
+        static void Compress(std::span<const char> data, std::vector<Lz77Token>& tokens);
+        static void Decompress(std::span<const Lz77Token> tokens, std::vector<char>& out);
 
-        // ǉ
-        // g[NXgoCgɕϊ
-        static std::vector<char> SerializeTokens(const std::vector<Lz77Token>& tokens);
-        // oCgg[NXgɕϊ
-        static std::vector<Lz77Token> DeserializeTokens(const std::vector<char>& data);
+        // ★ここから追加★
+        // トークンリストをバイト列に変換する
+        static void SerializeTokens(std::span<const Lz77Token> tokens, std::vector<char>& out);
+        // バイト列をトークンリストに変換する (サイズが不正なら空になる)
+        static void DeserializeTokens(std::span<const char> data, std::vector<Lz77Token>& tokens);
+        // SerializeTokens の出力から直接解凍する (トークンリストを作らない)
+        // サイズや距離が不正なら false を返し、out は空になる
+        static bool DecompressSerialized(std::span<const char> data, std::vector<char>& out);
+
+        // 新しいバッファを返す版
+        static std::vector<Lz77Token> Compress(std::span<const char> data) { std::vector<Lz77Token> tokens; Compress(data, tokens); return tokens; }
+        static std::vector<char> Decompress(std::span<const Lz77Token> tokens) { std::vector<char> out; Decompress(tokens, out); return out; }
+        static std::vector<char> SerializeTokens(std::span<const Lz77Token> tokens) { std::vector<char> out; SerializeTokens(tokens, out); return out; }
+        static std::vector<Lz77Token> DeserializeTokens(std::span<const char> data) { std::vector<Lz77Token> tokens; DeserializeTokens(data, tokens); return tokens; }
     };
 }
\ No newline at end of file
@@ -0,0 +1,28 @@
+#pragma once
+#include <cstddef>
+#include <cstring>
+
+namespace Cmp {
+    // LZ系の解凍で使う一致のコピー
+    // 8バイト単位でコピーするため一致の末尾を最大 WILD_COPY_SLACK バイト書き越す。
+    // 出力バッファは元サイズ + WILD_COPY_SLACK を確保し、書き終えてから元サイズに縮めること
+    constexpr size_t WILD_COPY_SLACK = 16;
+
+    // dst の distance バイト前から length バイトをコピーする (distance < length の重なりも可)
+    inline void CopyMatch(char* dst, size_t distance, size_t length) {
+        const char* src = dst - distance;
+        char* const end = dst + length;
+        if ( distance < 8 ) {
+            // 周期 distance のパターンを1バイトずつ8バイト分広げ、
+            // 以降は同じ位相で8バイト以上離れた位置から読むようにする
+            for ( int i = 0; i < 8; ++i ) dst[i] = src[i];
+            dst += 8;
+            src = dst - distance * ( ( 8 + distance - 1 ) / distance );
+        }
+        while ( dst < end ) {
+            std::memcpy(dst, src, 8);
+            dst += 8;
+            src += 8;
+        }
+    }
+}
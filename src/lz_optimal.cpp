@@ -0,0 +1,426 @@
+#include "lz_optimal.h"
+#include "entropy_coder.h"
+#include "match_finder.h"
+#include "lz_copy.h"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+
+namespace Cmp {
+    // --- パラメータと形式 ---
+    // 形式: varint 元サイズ + varint シーケンス数 + { varint 圧縮後サイズ + データ } * 4ストリーム
+    // 各シーケンスは「リテラル列 + 一致」。最後のシーケンスの後に残ったリテラルをそのまま続ける
+    //   コマンド: 1バイト (上位4ビット: リテラル数, 下位4ビット: 一致長 - MIN_MATCH, 15 は長さストリームに続きがある)
+    //   長さ    : 15 を超えた分の varint
+    //   オフセット: varint (0..2 はリピートオフセットの番号, それ以外は 距離 + 2)
+    namespace {
+        constexpr size_t MIN_MATCH = 3;
+        constexpr size_t MAX_MATCH = 65535;
+        constexpr size_t OPT_SEGMENT = 4096;    // 一度に最適化する範囲
+        constexpr size_t REP_COUNT = 3;
+        constexpr uint32_t EXTENDED = 15;
+        constexpr uint64_t REP_CODES = REP_COUNT;
+
+        // 一致の選び方
+        enum class ParseMode : uint8_t {
+            GREEDY,     // 各位置で最も得な一致をそのまま使う
+            LAZY,       // 1バイト先により得な一致があれば今の位置をリテラルにする
+            OPTIMAL,    // 価格に基づく動的計画法で区間ごとに最小価格の経路を選ぶ
+        };
+
+        struct LevelParams {
+            MatchFinderParams finder;
+            ParseMode parse;
+        };
+
+        // 圧縮レベル 1..9 の設定 (レベルによって出力形式は変わらない)
+        constexpr LevelParams LEVELS[] = {
+            { { MatchFinderType::HASH4, size_t(1) << 18, 1, 32 }, ParseMode::GREEDY },
+            { { MatchFinderType::HASH4, size_t(1) << 20, 1, 64 }, ParseMode::LAZY },
+            { { MatchFinderType::HASH_CHAIN, size_t(1) << 20, 8, 64 }, ParseMode::LAZY },
+            { { MatchFinderType::HASH_CHAIN, size_t(1) << 22, 16, 96 }, ParseMode::LAZY },
+            { { MatchFinderType::HASH_CHAIN, size_t(1) << 20, 24, 128 }, ParseMode::OPTIMAL },
+            { { MatchFinderType::HASH_CHAIN, size_t(1) << 20, 48, 128 }, ParseMode::OPTIMAL },
+            { { MatchFinderType::BINARY_TREE, size_t(1) << 24, 32, 128 }, ParseMode::OPTIMAL },
+            { { MatchFinderType::BINARY_TREE, size_t(1) << 25, 64, 192 }, ParseMode::OPTIMAL },
+            { { MatchFinderType::BINARY_TREE, size_t(1) << 26, 128, 273 }, ParseMode::OPTIMAL },
+        };
+
+        const LevelParams& GetLevel(int level) {
+            return LEVELS[std::clamp(level, LzOptimal::MIN_LEVEL, LzOptimal::MAX_LEVEL) - LzOptimal::MIN_LEVEL];
+        }
+
+        enum StreamId { LITERALS, COMMANDS, LENGTHS, OFFSETS, STREAM_COUNT };
+
+        using Reps = std::array<uint64_t, REP_COUNT>;
+        constexpr Reps INITIAL_REPS = { 1, 4, 8 };
+
+        // オフセット符号を使った後のリピートオフセット (使った距離を先頭に移す)
+        Reps UpdateReps(const Reps& reps, uint64_t offsetCode) {
+            if ( offsetCode == 0 ) return reps;
+            if ( offsetCode < REP_CODES ) {
+                Reps next = reps;
+                std::rotate(next.begin(), next.begin() + offsetCode, next.begin() + offsetCode + 1);
+                return next;
+            }
+            return { offsetCode - REP_CODES + 1, reps[0], reps[1] };
+        }
+
+        // --- 価格 (1/16 ビット単位の概算ビット数) ---
+        constexpr uint32_t PRICE_SCALE = 16;
+        constexpr uint32_t COMMAND_PRICE = 6 * PRICE_SCALE;
+        constexpr uint32_t INFINITE_PRICE = UINT32_MAX;
+
+        uint32_t OffsetPrice(uint64_t offsetCode) {
+            if ( offsetCode < REP_CODES ) return static_cast<uint32_t>( ( 1 + offsetCode ) * PRICE_SCALE );
+            return static_cast<uint32_t>( ( std::bit_width(offsetCode) + 2 ) * PRICE_SCALE );
+        }
+
+        uint32_t LengthPrice(size_t length) {
+            const size_t extra = length - MIN_MATCH;
+            if ( extra < EXTENDED ) return 0;
+            const size_t bytes = std::max<size_t>(1, ( std::bit_width(extra - EXTENDED) + 6 ) / 7);
+            return static_cast<uint32_t>( bytes * 8 * PRICE_SCALE );
+        }
+
+        uint32_t MatchPrice(uint64_t offsetCode, size_t length) {
+            return COMMAND_PRICE + OffsetPrice(offsetCode) + LengthPrice(length);
+        }
+
+        // 最適パースの各位置に到達する最小価格の経路
+        struct Node {
+            uint32_t price;
+            uint32_t length;        // 0 ならリテラルで到達
+            uint64_t offsetCode;
+            Reps reps;              // この位置に到達した後のリピートオフセット
+        };
+
+        class StreamWriter {
+        public:
+            void Literal(char c) {
+                streams[LITERALS].push_back(c);
+                literalRun++;
+            }
+
+            void Sequence(size_t length, uint64_t offsetCode) {
+                const uint64_t extra = length - MIN_MATCH;
+                const uint32_t literalCode = static_cast<uint32_t>( std::min<uint64_t>(literalRun, EXTENDED) );
+                const uint32_t matchCode = static_cast<uint32_t>( std::min<uint64_t>(extra, EXTENDED) );
+                streams[COMMANDS].push_back(static_cast<char>( ( literalCode << 4 ) | matchCode ));
+                if ( literalCode == EXTENDED ) WriteVarint(streams[LENGTHS], literalRun - EXTENDED);
+                if ( matchCode == EXTENDED ) WriteVarint(streams[LENGTHS], extra - EXTENDED);
+                WriteVarint(streams[OFFSETS], offsetCode);
+                literalRun = 0;
+                sequenceCount++;
+            }
+
+            std::array<std::vector<char>, STREAM_COUNT> streams;
+            uint64_t sequenceCount = 0;
+
+        private:
+            uint64_t literalRun = 0;
+        };
+
+        // 入力の0次の出現頻度からリテラルの価格を求める
+        std::array<uint32_t, 256> LiteralPrices(std::span<const uint8_t> data) {
+            std::array<size_t, 256> counts{};
+            for ( uint8_t c : data ) counts[c]++;
+            std::array<uint32_t, 256> prices{};
+            for ( int c = 0; c < 256; ++c ) {
+                const double bits = std::log2(static_cast<double>( data.size() ) / std::max<size_t>(counts[c], 1));
+                prices[c] = std::max<uint32_t>(1, static_cast<uint32_t>( bits * PRICE_SCALE ));
+            }
+            return prices;
+        }
+
+        // 0次エントロピー (リテラル1個の平均価格)
+        uint32_t AverageLiteralPrice(std::span<const uint8_t> data) {
+            std::array<size_t, 256> counts{};
+            for ( uint8_t c : data ) counts[c]++;
+            double bits = 0.0;
+            for ( size_t count : counts ) {
+                if ( count == 0 ) continue;
+                const double p = static_cast<double>( count ) / data.size();
+                bits -= p * std::log2(p);
+            }
+            return std::max<uint32_t>(1, static_cast<uint32_t>( bits * PRICE_SCALE ));
+        }
+
+        // 1か所で選んだ一致 (length 0 は一致なし)
+        struct Candidate {
+            size_t length = 0;
+            uint64_t offsetCode = 0;
+            int64_t score = 0;      // 同じ範囲をリテラルで符号化した場合より安くなる価格
+        };
+
+        // リピートオフセットと探索器の候補から、最も得になる一致を選ぶ
+        Candidate BestMatch(std::span<const uint8_t> data, size_t pos, const Reps& reps, MatchFinder& finder, std::vector<Match>& matches, uint32_t literalPrice) {
+            Candidate best;
+            if ( pos + MIN_MATCH > data.size() ) return best;
+            const size_t maxLength = std::min(MAX_MATCH, data.size() - pos);
+            auto consider = [ & ] (size_t length, uint64_t offsetCode) {
+                const int64_t score = static_cast<int64_t>( length * literalPrice ) - MatchPrice(offsetCode, length);
+                if ( score > best.score ) best = { length, offsetCode, score };
+            };
+            for ( size_t r = 0; r < REP_COUNT; ++r ) {
+                if ( reps[r] > pos ) continue;
+                const size_t length = MatchFinder::MatchLength(&data[pos], &data[pos - reps[r]], maxLength);
+                if ( length >= MIN_MATCH ) consider(length, r);
+            }
+            finder.Find(pos, maxLength, matches);
+            for ( const Match& match : matches ) consider(match.length, match.distance + REP_CODES - 1);
+            return best;
+        }
+
+        void ParseGreedy(std::span<const uint8_t> data, MatchFinder& finder, bool lazy, StreamWriter& writer) {
+            const size_t n = data.size();
+            if ( n == 0 ) return;
+            const uint32_t literalPrice = AverageLiteralPrice(data);
+            std::vector<Match> matches;
+            Reps reps = INITIAL_REPS;
+
+            size_t pos = 0;
+            Candidate current = BestMatch(data, pos, reps, finder, matches, literalPrice);
+            while ( pos < n ) {
+                if ( current.length == 0 ) {
+                    writer.Literal(static_cast<char>( data[pos++] ));
+                    if ( pos < n ) current = BestMatch(data, pos, reps, finder, matches, literalPrice);
+                    continue;
+                }
+                if ( lazy && pos + 1 < n ) {
+                    // 1バイト先の一致の方が得なら、今の位置はリテラルにして先の一致を使う
+                    Candidate next = BestMatch(data, pos + 1, reps, finder, matches, literalPrice);
+                    if ( next.score > current.score + static_cast<int64_t>( PRICE_SCALE ) ) {
+                        writer.Literal(static_cast<char>( data[pos++] ));
+                        current = next;
+                        continue;
+                    }
+                }
+                writer.Sequence(current.length, current.offsetCode);
+                reps = UpdateReps(reps, current.offsetCode);
+                pos += current.length;
+                current = ( pos < n ) ? BestMatch(data, pos, reps, finder, matches, literalPrice) : Candidate{};
+            }
+        }
+
+        void ParseOptimal(std::span<const uint8_t> data, MatchFinder& finder, size_t niceLength, StreamWriter& writer) {
+            const size_t n = data.size();
+            if ( n == 0 ) return;
+            const auto literalPrices = LiteralPrices(data);
+
+            std::vector<Node> nodes(OPT_SEGMENT + MAX_MATCH + 1);
+            std::vector<Match> matches;
+            std::vector<uint32_t> steps;
+            Reps reps = INITIAL_REPS;
+
+            size_t pos = 0;
+            while ( pos < n ) {
+                const size_t segment = std::min(OPT_SEGMENT, n - pos);
+                size_t reach = 0;
+                size_t last = segment;
+                nodes[0] = { 0, 0, 0, reps };
+
+                // 価格を下げられる場合だけ to の経路を更新する
+                auto relax = [ & ] (size_t from, size_t to, uint32_t price, size_t length, uint64_t offsetCode) {
+                    for ( ; reach < to; ) nodes[++reach].price = INFINITE_PRICE;
+                    Node& node = nodes[to];
+                    if ( price >= node.price ) return;
+                    node.price = price;
+                    node.length = static_cast<uint32_t>( length );
+                    node.offsetCode = offsetCode;
+                    node.reps = length ? UpdateReps(nodes[from].reps, offsetCode) : nodes[from].reps;
+                };
+
+                for ( size_t k = 0; k < segment; ++k ) {
+                    const size_t i = pos + k;
+                    const uint32_t base = nodes[k].price;
+                    relax(k, k + 1, base + literalPrices[data[i]], 0, 0);
+                    if ( i + MIN_MATCH > n ) continue;
+
+                    // リピートオフセットとハッシュチェーンの候補を集める
+                    const size_t maxLength = std::min(MAX_MATCH, n - i);
+                    std::array<size_t, REP_COUNT> repLengths{};
+                    const Reps current = nodes[k].reps;
+                    for ( size_t r = 0; r < REP_COUNT; ++r ) {
+                        if ( current[r] <= i ) repLengths[r] = MatchFinder::MatchLength(&data[i], &data[i - current[r]], maxLength);
+                    }
+                    finder.Find(i, maxLength, matches);
+
+                    // 十分に長い一致はそのまま採用してこの区間を終える
+                    size_t longest = matches.empty() ? 0 : matches.back().length;
+                    uint64_t longestCode = matches.empty() ? 0 : matches.back().distance + REP_CODES - 1;
+                    for ( size_t r = 0; r < REP_COUNT; ++r ) {
+                        if ( repLengths[r] >= longest && repLengths[r] >= MIN_MATCH ) {
+                            longest = repLengths[r];
+                            longestCode = r;
+                        }
+                    }
+                    if ( longest >= niceLength ) {
+                        relax(k, k + longest, base + MatchPrice(longestCode, longest), longest, longestCode);
+                        last = k + longest;
+                        break;
+                    }
+
+                    for ( size_t r = 0; r < REP_COUNT; ++r ) {
+                        for ( size_t length = MIN_MATCH; length <= repLengths[r]; ++length ) {
+                            relax(k, k + length, base + MatchPrice(r, length), length, r);
+                        }
+                    }
+                    size_t covered = MIN_MATCH - 1;
+                    for ( const Match& match : matches ) {
+                        const uint64_t offsetCode = match.distance + REP_CODES - 1;
+                        for ( size_t length = covered + 1; length <= match.length; ++length ) {
+                            relax(k, k + length, base + MatchPrice(offsetCode, length), length, offsetCode);
+                        }
+                        covered = match.length;
+                    }
+                }
+
+                // 終点から経路を逆にたどり、先頭から出力する
+                steps.clear();
+                for ( size_t j = last; j > 0; ) {
+                    const uint32_t length = nodes[j].length;
+                    steps.push_back(length);
+                    j -= length ? length : 1;
+                }
+                size_t cursor = pos;
+                size_t j = 0;
+                for ( auto it = steps.rbegin(); it != steps.rend(); ++it ) {
+                    if ( *it == 0 ) {
+                        writer.Literal(static_cast<char>( data[cursor] ));
+                        cursor++;
+                        j++;
+                    }
+                    else {
+                        cursor += *it;
+                        j += *it;
+                        writer.Sequence(*it, nodes[j].offsetCode);
+                    }
+                }
+                reps = nodes[last].reps;
+                pos += last;
+            }
+        }
+    }
+
+    void LzOptimal::Compress(std::span<const char> data, Entropy entropy, std::vector<char>& output, int level) {
+        const LevelParams& params = GetLevel(level);
+        const std::span<const uint8_t> bytes(reinterpret_cast<const uint8_t*>( data.data() ), data.size());
+        auto finder = MatchFinder::Create(bytes, params.finder);
+
+        StreamWriter writer;
+        writer.streams[LITERALS].reserve(data.size() / 2);
+        if ( params.parse == ParseMode::OPTIMAL ) {
+            ParseOptimal(bytes, *finder, params.finder.niceLength, writer);
+        }
+        else {
+            ParseGreedy(bytes, *finder, params.parse == ParseMode::LAZY, writer);
+        }
+
+        output.clear();
+        WriteVarint(output, data.size());
+        WriteVarint(output, writer.sequenceCount);
+        std::vector<char> coded;
+        for ( const auto& stream : writer.streams ) {
+            coded.clear();
+            if ( !stream.empty() ) EntropyCoder::Compress(stream, entropy, coded);
+            WriteVarint(output, coded.size());
+            output.insert(output.end(), coded.begin(), coded.end());
+        }
+    }
+
+    size_t LzOptimal::MemoryPerByte(int level) {
+        return MatchFinder::MemoryPerByte(GetLevel(level).finder.type);
+    }
+
+    void LzOptimal::Decompress(std::span<const char> data, Entropy entropy, std::vector<char>& output, uint64_t maxSize) {
+        output.clear();
+        const char* pos = data.data();
+        const char* end = pos + data.size();
+
+        uint64_t originalSize = 0;
+        uint64_t sequenceCount = 0;
+        if ( !ReadVarint(pos, end, originalSize) || !ReadVarint(pos, end, sequenceCount) ) return;
+        // 各シーケンスは MIN_MATCH バイト以上の一致を持つ
+        if ( originalSize > maxSize || sequenceCount > originalSize / MIN_MATCH ) return;
+
+        // 各ストリームの復号後の上限 (長さは1シーケンスに最大2つ、オフセットは1つの varint)
+        std::array<uint64_t, STREAM_COUNT> streamLimits;
+        streamLimits[LITERALS] = originalSize;
+        streamLimits[COMMANDS] = sequenceCount;
+        streamLimits[LENGTHS] = sequenceCount * 2 * MAX_VARINT_LENGTH;
+        streamLimits[OFFSETS] = sequenceCount * MAX_VARINT_LENGTH;
+
+        std::array<std::vector<char>, STREAM_COUNT> streams;
+        for ( size_t i = 0; i < STREAM_COUNT; ++i ) {
+            uint64_t size = 0;
+            if ( !ReadVarint(pos, end, size) || size > static_cast<uint64_t>( end - pos ) ) return;
+            if ( size > 0 ) {
+                EntropyCoder::Decompress(std::span<const char>(pos, size), entropy, streams[i],
+                    static_cast<size_t>( std::min<uint64_t>(streamLimits[i], SIZE_MAX) ));
+            }
+            pos += size;
+        }
+        // 一致長は MAX_MATCH を超えないので、元サイズはリテラル数とシーケンス数から上限が決まる
+        if ( streams[COMMANDS].size() != sequenceCount ||
+            originalSize > streams[LITERALS].size() + sequenceCount * MAX_MATCH ) return;
+
+        // 元サイズ分を先に確保し、各シーケンスの長さを確認しながら直接書き込む
+        output.resize(originalSize + WILD_COPY_SLACK);
+        char* const base = output.data();
+        char* const outEnd = base + originalSize;
+        char* dst = base;
+        const char* literal = streams[LITERALS].data();
+        const char* literalEnd = literal + streams[LITERALS].size();
+        const char* lengths = streams[LENGTHS].data();
+        const char* lengthsEnd = lengths + streams[LENGTHS].size();
+        const char* offsets = streams[OFFSETS].data();
+        const char* offsetsEnd = offsets + streams[OFFSETS].size();
+        Reps reps = INITIAL_REPS;
+
+        for ( char command : streams[COMMANDS] ) {
+            uint64_t literalRun = static_cast<uint8_t>( command ) >> 4;
+            uint64_t length = static_cast<uint8_t>( command ) & 0x0F;
+            uint64_t extra = 0;
+            if ( literalRun == EXTENDED ) {
+                if ( !ReadVarint(lengths, lengthsEnd, extra) ) { output.clear(); return; }
+                literalRun += extra;
+            }
+            if ( length == EXTENDED ) {
+                if ( !ReadVarint(lengths, lengthsEnd, extra) || extra > MAX_MATCH ) { output.clear(); return; }
+                length += extra;
+            }
+            length += MIN_MATCH;
+
+            uint64_t offsetCode = 0;
+            const uint64_t remaining = static_cast<uint64_t>( outEnd - dst );
+            if ( !ReadVarint(offsets, offsetsEnd, offsetCode) ||
+                literalRun > static_cast<uint64_t>( literalEnd - literal ) ||
+                literalRun > remaining || length > remaining - literalRun ) {
+                output.clear();
+                return;
+            }
+            // リテラルが1つも無い入力ではストリームが空 (literal が nullptr) になるので memcpy は使わない
+            std::copy_n(literal, literalRun, dst);
+            dst += literalRun;
+            literal += literalRun;
+
+            reps = UpdateReps(reps, offsetCode);
+            const uint64_t distance = reps[0];
+            if ( distance == 0 || distance > static_cast<uint64_t>( dst - base ) ) {
+                output.clear();
+                return;
+            }
+            CopyMatch(dst, distance, length);
+            dst += length;
+        }
+
+        if ( literalEnd - literal != outEnd - dst ) {
+            output.clear();
+            return;
+        }
+        std::copy_n(literal, literalEnd - literal, dst);
+        output.resize(originalSize);
+    }
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <vector>
+#include <span>
+#include <cstdint>
+#include "FileFormat.h"
+
+namespace Cmp {
+    // 価格に基づく最適パース (動的計画法) で一致を選ぶLZ圧縮
+    // リテラル・コマンド・拡張長さ・オフセットを別々のストリームに分け、それぞれをエントロピー符号化する
+    // オフセットは直近3つの距離 (リピートオフセット) を短い符号で参照できる
+    class LzOptimal {
+    public:
+        // 圧縮レベル: 1 (高速な単一候補ハッシュ) .. 9 (二分木と64MBのウィンドウ)
+        static constexpr int MIN_LEVEL = 1;
+        static constexpr int MAX_LEVEL = 9;
+        static constexpr int DEFAULT_LEVEL = 6;
+
+        // 出力は output の中身を置き換える。データが壊れている場合や元サイズが maxSize を超える場合 output は空になる
+        static void Compress(std::span<const char> data, Entropy entropy, std::vector<char>& output, int level = DEFAULT_LEVEL);
+        static void Decompress(std::span<const char> data, Entropy entropy, std::vector<char>& output, uint64_t maxSize = UINT64_MAX);
+
+        // 圧縮レベルの一致探索が使う、入力1バイトあたりの作業メモリ
+        static size_t MemoryPerByte(int level);
+    };
+}
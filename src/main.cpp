@@ -2,11 +2,19 @@
 #include <string>
 #include <vector>
 #include <filesystem>
+#include <algorithm>
 #include "Logger.h"
 #include "Compressor.h"
 #include "Decompressor.h"
+#include "Verifier.h"
+#include "Benchmark.h"
+#include "FileFormat.h"
+#include "MappedFile.h"
+#include "bwt_block.h"
+#include "lz_optimal.h"
+#include "context_mixing.h"
 
-// C++17ȍ~filesystemg
+// C++17以降のfilesystemを使うため
 namespace fs = std::filesystem;
 
 class Application {
@@ -20,25 +28,57 @@ public:
         std::vector<std::string> args(argv, argv + argc);
         const std::string mode = args[1];
 
-        if ( ( mode == "-c" || mode == "-t" ) && args.size() == 4 ) {
-            std::string sourcePath = args[2];
-            std::string outputPath = args[3];
+        // 位置引数とオプション (-j N など) を分ける
+        std::vector<std::string> positional;
+        Options options;
+        if ( !ParseOptions(args, positional, options) ) {
+            PrintUsage();
+            return 1;
+        }
+
+        if ( ( mode == "-c" || mode == "-t" ) && positional.size() == 2 ) {
+            std::string sourcePath = positional[0];
+            std::string outputPath = positional[1];
 
             if ( mode == "-c" ) {
-                // ʏ̈k
+                // 通常の圧縮
                 fs::path logPath = fs::path(outputPath).replace_extension(".log");
-                return DoCompress(sourcePath, outputPath, logPath.string());
+                return DoCompress(sourcePath, outputPath, logPath.string(), options);
             }
             else {
-                return DoTest(sourcePath, outputPath);
+                return DoTest(sourcePath, outputPath, options);
             }
         }
-        else if ( mode == "-d" && args.size() == 4 ) {
-            std::string sourcePath = args[2];
-            std::string outputPath = args[3];
-            // ʏ̉
+        else if ( mode == "-d" && positional.size() == 2 ) {
+            std::string sourcePath = positional[0];
+            std::string outputPath = positional[1];
+            // 通常の解凍
             fs::path logPath = fs::path(outputPath) / "decompress_log.log";
-            return DoDecompress(sourcePath, outputPath, logPath.string());
+            return DoDecompress(sourcePath, outputPath, logPath.string(), options);
+        }
+        else if ( mode == "-v" && positional.size() == 1 ) {
+            // アーカイブを書かずにメモリ上で圧縮・解凍して確かめる (入力を求めない)
+            return DoVerify(positional[0], options);
+        }
+        else if ( mode == "-b" && !positional.empty() ) {
+            // 各段の速度・圧縮率・ピークメモリを CSV で標準出力に書く
+            return DoBenchmark(positional, options);
+        }
+        else if ( mode == "-l" && positional.size() == 1 ) {
+            // 一覧表示 (インデックスのみを読む)
+            Decompressor decompressor;
+            return decompressor.ListArchive(positional[0]) ? 0 : 1;
+        }
+        else if ( mode == "-x" && ( positional.size() == 2 || positional.size() == 3 ) ) {
+            // 1ファイルだけを解凍 (出力先を省略した場合はカレントフォルダ)
+            std::string outputPath = ( positional.size() == 3 ) ? positional[2] : ".";
+            Decompressor decompressor;
+            if ( decompressor.ExtractFile(positional[0], positional[1], outputPath) ) {
+                std::cout << "Extracted: " << positional[1] << "\n";
+                return 0;
+            }
+            std::cerr << "Extraction failed.\n";
+            return 1;
         }
         else {
             PrintUsage();
@@ -47,21 +87,143 @@ public:
     }
 
 private:
+    // コマンドラインオプション
+    struct Options {
+        unsigned threads = 0;   // 0 はハードウェアの並列数
+        size_t bwtBlockSize = Cmp::BwtBlock::DEFAULT_BLOCK_SIZE;
+        Cmp::Entropy entropy = Cmp::Entropy::ADAPTIVE_ARITHMETIC;
+        size_t memoryLimit = Compressor::DEFAULT_MEMORY_LIMIT;
+        int level = Cmp::LzOptimal::DEFAULT_LEVEL;
+        unsigned trialCandidates = Compressor::DEFAULT_TRIAL_CANDIDATES;
+        Compressor::TextMode textMode = Compressor::TextMode::BWT;
+        size_t contextMixingMemory = Cmp::ContextMixing::DEFAULT_MEMORY;
+        unsigned iterations = Benchmark::DEFAULT_ITERATIONS;
+        std::string stages;     // 空は既定の段
+    };
+
+    // "store,rle,lz" のようなカンマ区切りの候補名 ("all" は全て) を TRIAL_* の組み合わせにする
+    bool ParseTrialCandidates(const std::string& list, unsigned& candidates) {
+        candidates = 0;
+        size_t begin = 0;
+        while ( begin <= list.size() ) {
+            size_t end = list.find(',', begin);
+            if ( end == std::string::npos ) end = list.size();
+            const std::string name = list.substr(begin, end - begin);
+            if ( name == "store" ) candidates |= Compressor::TRIAL_STORE;
+            else if ( name == "rle" ) candidates |= Compressor::TRIAL_RLE;
+            else if ( name == "lz" ) candidates |= Compressor::TRIAL_LZ;
+            else if ( name == "delta" ) candidates |= Compressor::TRIAL_DELTA;
+            else if ( name == "bwt" ) candidates |= Compressor::TRIAL_BWT;
+            else if ( name == "all" ) candidates |= Compressor::ALL_TRIAL_CANDIDATES;
+            else return false;
+            begin = end + 1;
+        }
+        return candidates != 0;
+    }
+
+    bool ParseOptions(const std::vector<std::string>& args, std::vector<std::string>& positional, Options& options) {
+        for ( size_t i = 2; i < args.size(); ++i ) {
+            const std::string& arg = args[i];
+            const bool hasValue = i + 1 < args.size();
+            try {
+                if ( arg == "-j" && hasValue ) {
+                    options.threads = static_cast<unsigned>( std::stoul(args[++i]) );
+                }
+                else if ( arg == "--block-size" && hasValue ) {
+                    options.bwtBlockSize = static_cast<size_t>( std::stoul(args[++i]) ) * 1024;
+                }
+                else if ( arg == "--memory" && hasValue ) {
+                    options.memoryLimit = static_cast<size_t>( std::stoull(args[++i]) ) << 20;
+                }
+                else if ( arg == "--level" && hasValue ) {
+                    options.level = std::stoi(args[++i]);
+                    if ( options.level < Cmp::LzOptimal::MIN_LEVEL || options.level > Cmp::LzOptimal::MAX_LEVEL ) return false;
+                }
+                else if ( arg == "--trial" && hasValue ) {
+                    if ( !ParseTrialCandidates(args[++i], options.trialCandidates) ) return false;
+                }
+                else if ( arg == "--text" && hasValue ) {
+                    const std::string& name = args[++i];
+                    if ( name == "bwt" ) options.textMode = Compressor::TextMode::BWT;
+                    else if ( name == "cm" ) options.textMode = Compressor::TextMode::CONTEXT_MIXING;
+                    else return false;
+                }
+                else if ( arg == "--cm-memory" && hasValue ) {
+                    options.contextMixingMemory = static_cast<size_t>( std::stoull(args[++i]) ) << 20;
+                }
+                else if ( arg == "--iterations" && hasValue ) {
+                    options.iterations = static_cast<unsigned>( std::stoul(args[++i]) );
+                    if ( options.iterations == 0 ) return false;
+                }
+                else if ( arg == "--stages" && hasValue ) {
+                    options.stages = args[++i];
+                }
+                else if ( arg == "--entropy" && hasValue ) {
+                    const std::string& name = args[++i];
+                    if ( name == "static" ) options.entropy = Cmp::Entropy::STATIC_ARITHMETIC;
+                    else if ( name == "adaptive" ) options.entropy = Cmp::Entropy::ADAPTIVE_ARITHMETIC;
+                    else if ( name == "rans" ) options.entropy = Cmp::Entropy::RANS;
+                    else if ( name == "huffman" ) options.entropy = Cmp::Entropy::HUFFMAN;
+                    else return false;
+                }
+                else if ( arg.size() > 1 && arg[0] == '-' ) {
+                    return false;
+                }
+                else {
+                    positional.push_back(arg);
+                }
+            }
+            catch ( const std::exception& ) {
+                return false;
+            }
+        }
+        return true;
+    }
+
     void PrintUsage() {
         std::cout << "Usage:\n";
-        std::cout << "  Compress:    MyCompressor.exe -c <source_folder> <output_file.cmp>\n";
-        std::cout << "  Decompress:  MyCompressor.exe -d <source_file.cmp> <output_folder>\n";
-        std::cout << "  Test:        MyCompressor.exe -t <source_folder> <output_file.cmp>\n";
+        std::cout << "  Compress:    MyCompressor.exe -c <source_folder> <output_file.cmp> [options]\n";
+        std::cout << "  Decompress:  MyCompressor.exe -d <source_file.cmp> <output_folder> [-j <N>]\n";
+        std::cout << "  Test:        MyCompressor.exe -t <source_folder> <output_file.cmp> [options]\n";
+        std::cout << "  Verify:      MyCompressor.exe -v <source_folder> [options]   (in memory, no files written)\n";
+        std::cout << "  Benchmark:   MyCompressor.exe -b <folder> [<folder> ...] [options]   (CSV to stdout)\n";
+        std::cout << "  List:        MyCompressor.exe -l <source_file.cmp>\n";
+        std::cout << "  Extract:     MyCompressor.exe -x <source_file.cmp> <path_in_archive> [output_folder]\n";
+        std::cout << "Options:\n";
+        std::cout << "  -j <N>                            Number of worker threads (default: all cores)\n";
+        std::cout << "  --block-size <KB>                 BWT block size for text files (default: 1024)\n";
+        std::cout << "  --entropy <coder>                 Entropy coder: static, adaptive, rans or huffman (default: adaptive)\n";
+        std::cout << "  --memory <MB>                     Working memory limit; larger files are compressed in chunks (default: 1024)\n";
+        std::cout << "  --level <1-9>                     LZ compression level: 1 is fastest, 9 searches deepest (default: 6)\n";
+        std::cout << "  --trial <list>                    Pipelines tried on unrecognized data: store,rle,lz,delta,bwt or all (default: store,rle,lz,delta)\n";
+        std::cout << "  --text <mode>                     Text compression: bwt (fast) or cm (context mixing, best ratio, slow) (default: bwt)\n";
+        std::cout << "  --cm-memory <MB>                  Context mixing model memory per file (default: 128)\n";
+        std::cout << "  --iterations <N>                  Benchmark: timed runs per stage; the fastest is reported (default: 3)\n";
+        std::cout << "  --stages <list>                   Benchmark: delta,exe,rle,lz77,lzopt,bwt,mtf,arith,arith-adaptive,rans,huffman,cm,pipeline\n";
+        std::cout << "                                    or all (default: all but cm)\n";
     }
 
-    // k̖{́ilogFilePathǉj
-    int DoCompress(const std::string& sourceFolder, const std::string& outputFile, const std::string& logFilePath) {
+    // コマンドラインオプションを圧縮器に設定する
+    void ConfigureCompressor(Compressor& compressor, const Options& options) {
+        compressor.SetThreadCount(options.threads);
+        compressor.SetBwtBlockSize(options.bwtBlockSize);
+        compressor.SetEntropy(options.entropy);
+        compressor.SetMemoryLimit(options.memoryLimit);
+        compressor.SetLevel(options.level);
+        compressor.SetTrialCandidates(options.trialCandidates);
+        compressor.SetTextMode(options.textMode);
+        compressor.SetContextMixingMemory(options.contextMixingMemory);
+    }
+
+    // 圧縮処理の本体（logFilePath引数を追加）
+    int DoCompress(const std::string& sourceFolder, const std::string& outputFile, const std::string& logFilePath, const Options& options) {
         Logger::Init(logFilePath);
         std::cout << "Starting compression... (Log: " << logFilePath << ")\n";
         std::cout << "Source: " << sourceFolder << "\n";
         std::cout << "Output: " << outputFile << "\n";
 
         Compressor compressor;
+        ConfigureCompressor(compressor, options);
         if ( compressor.CompressFolder(sourceFolder, outputFile) ) {
             std::cout << "Compression finished successfully.\n";
             return 0;
@@ -72,14 +234,15 @@ private:
         }
     }
 
-    // 𓀏̖{́ilogFilePathǉj
-    int DoDecompress(const std::string& inputFile, const std::string& outputFolder, const std::string& logFilePath) {
+    // 解凍処理の本体（logFilePath引数を追加）
+    int DoDecompress(const std::string& inputFile, const std::string& outputFolder, const std::string& logFilePath, const Options& options) {
         Logger::Init(logFilePath);
         std::cout << "Starting decompression... (Log: " << logFilePath << ")\n";
         std::cout << "Input:  " << inputFile << "\n";
         std::cout << "Output: " << outputFolder << "\n";
 
         Decompressor decompressor;
+        decompressor.SetThreadCount(options.threads);
         if ( decompressor.DecompressArchive(inputFile, outputFolder) ) {
             std::cout << "Decompression finished successfully.\n";
             return 0;
@@ -90,43 +253,94 @@ private:
         }
     }
 
-    // eXg̖{́i啝ɍXVj
-    int DoTest(const std::string& sourceFolder, const std::string& tempCmpFile) {
+    // 検証処理の本体。各ファイルをメモリ上で圧縮・解凍して比べ、全て一致すれば0を返す
+    int DoVerify(const std::string& sourceFolder, const Options& options) {
+        Compressor compressor;
+        ConfigureCompressor(compressor, options);
+        Verifier verifier(compressor);
+        verifier.SetThreadCount(options.threads);
+        if ( verifier.VerifyFolder(sourceFolder) ) {
+            std::cout << "Verification finished successfully.\n";
+            return 0;
+        }
+        std::cerr << "Verification failed.\n";
+        return 1;
+    }
+
+    // ベンチマークの本体。全ての段で復号結果が元と一致すれば0を返す
+    int DoBenchmark(const std::vector<std::string>& folders, const Options& options) {
+        Compressor compressor;
+        ConfigureCompressor(compressor, options);
+        Benchmark benchmark(compressor, options.level, options.entropy, options.contextMixingMemory);
+        benchmark.SetIterations(options.iterations);
+        if ( !options.stages.empty() && !benchmark.SelectStages(options.stages) ) {
+            std::cerr << "Unknown benchmark stage in: " << options.stages << "\n";
+            PrintUsage();
+            return 1;
+        }
+        return benchmark.Run(folders) ? 0 : 1;
+    }
+
+    // source 以下の全ファイルが restored の同じ相対パスに同じ内容で存在するかを確かめ、違うものを表示する
+    bool CompareFolders(const fs::path& source, const fs::path& restored) {
+        size_t compared = 0;
+        size_t mismatched = 0;
+        for ( const auto& entry : fs::recursive_directory_iterator(source) ) {
+            if ( !entry.is_regular_file() ) continue;
+            const fs::path relative = fs::relative(entry.path(), source);
+            Cmp::MappedFile original;
+            Cmp::MappedFile copy;
+            const bool same = original.OpenRead(entry.path()) && copy.OpenRead(restored / relative) &&
+                original.Size() == copy.Size() && std::equal(original.Data(), original.Data() + original.Size(), copy.Data());
+            if ( !same ) {
+                std::cerr << "  Mismatch: " << relative.string() << "\n";
+                mismatched++;
+            }
+            compared++;
+        }
+        std::cout << "Compared " << compared << " file(s), " << mismatched << " mismatch(es).\n";
+        return mismatched == 0;
+    }
+
+    // テスト処理の本体（大幅に更新）
+    int DoTest(const std::string& sourceFolder, const std::string& tempCmpFile, const Options& options) {
         std::cout << "--- Starting Test Mode ---\n";
 
         fs::path cmpPath(tempCmpFile);
         fs::path baseDir = cmpPath.parent_path();
 
-        // 1. epXƃt@C`
+        // 1. 各種パスとファイル名を定義
         fs::path tempDecompressFolder = baseDir / ( cmpPath.stem().string() + "_decompressed" );
         fs::path compressLogPath = baseDir / ( cmpPath.stem().string() + "_compress.log" );
         fs::path decompressLogPath = baseDir / ( cmpPath.stem().string() + "_decompress.log" );
 
-        // 2. k
-        if ( DoCompress(sourceFolder, tempCmpFile, compressLogPath.string()) != 0 ) {
+        // 2. 圧縮
+        if ( DoCompress(sourceFolder, tempCmpFile, compressLogPath.string(), options) != 0 ) {
             std::cerr << "Test failed: Compression step failed.\n";
             return 1;
         }
         std::cout << "\n";
 
-        // 3. 
-        if ( DoDecompress(tempCmpFile, tempDecompressFolder.string(), decompressLogPath.string()) != 0 ) {
+        // 3. 解凍
+        if ( DoDecompress(tempCmpFile, tempDecompressFolder.string(), decompressLogPath.string(), options) != 0 ) {
             std::cerr << "Test failed: Decompression step failed.\n";
             return 1;
         }
         std::cout << "\n";
 
-        // 4. r
+        // 4. 比較 (解凍時に CRC32C も確かめているが、ここでは元のファイルとバイト単位で比べる)
         std::cout << "Comparing original and decompressed files...\n";
-        // TODO: Ƀt@CriƉj
-        bool comparison_ok = true;
+        bool comparison_ok = CompareFolders(sourceFolder, tempDecompressFolder);
         if ( comparison_ok ) {
             std::cout << "Test completed successfully: Files are identical.\n\n";
         }
+        else {
+            std::cerr << "Test failed: Decompressed files differ from the originals.\n\n";
+        }
 
         Logger::Close();
 
-        // 5. N[Abv
+        // 5. クリーンアップ処理
         char choice;
         std::cout << "--- Test Cleanup ---\n";
 
@@ -151,7 +365,7 @@ private:
 };
 
 int main(int argc, char* argv[]) {
-    // std::cin / std::cout ̍i܂Ȃj
+    // std::cin / std::cout の高速化（おまじない）
     std::ios_base::sync_with_stdio(false);
     std::cin.tie(NULL);
 
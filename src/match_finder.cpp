@@ -0,0 +1,242 @@
+#include "match_finder.h"
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+namespace Cmp {
+    namespace {
+        constexpr uint32_t NO_POSITION = UINT32_MAX;
+        constexpr int HASH3_BITS = 17;
+        constexpr int HASH4_BITS = 20;
+
+        uint32_t Hash3(const uint8_t* p) {
+            const uint32_t v = p[0] | ( p[1] << 8 ) | ( p[2] << 16 );
+            return ( v * 2654435761u ) >> ( 32 - HASH3_BITS );
+        }
+
+        uint32_t Hash4(const uint8_t* p) {
+            uint32_t v;
+            std::memcpy(&v, p, 4);
+            return ( v * 2654435761u ) >> ( 32 - HASH4_BITS );
+        }
+
+        // ウィンドウ (入力より大きければ入力サイズまで切り詰める) を2のべき乗の循環バッファにする
+        size_t CyclicSize(size_t windowSize, size_t dataSize) {
+            return std::bit_ceil(std::max<size_t>(1, std::min(windowSize, dataSize)));
+        }
+
+        // 各探索器の共通部分。登録済みの位置を next で管理し、Find の前にまとめて登録する
+        class FinderBase : public MatchFinder {
+        public:
+            FinderBase(std::span<const uint8_t> data, const MatchFinderParams& params, size_t minLength)
+                : data(data), params(params), minLength(minLength), cyclicSize(CyclicSize(params.windowSize, data.size())) {}
+
+            size_t MinLength() const override { return minLength; }
+
+        protected:
+            bool InWindow(uint32_t candidate, size_t pos) const {
+                return candidate != NO_POSITION && pos - candidate < cyclicSize;
+            }
+
+            std::span<const uint8_t> data;
+            MatchFinderParams params;
+            size_t minLength;
+            size_t cyclicSize;
+            size_t next = 0;
+        };
+
+        class Hash4Finder : public FinderBase {
+        public:
+            Hash4Finder(std::span<const uint8_t> data, const MatchFinderParams& params)
+                : FinderBase(data, params, 4), head(size_t(1) << HASH4_BITS, NO_POSITION) {}
+
+            void Find(size_t pos, size_t maxLength, std::vector<Match>& matches) override {
+                matches.clear();
+                if ( pos + minLength > data.size() ) return;
+                for ( ; next < pos; ++next ) {
+                    if ( next + minLength <= data.size() ) head[Hash4(&data[next])] = static_cast<uint32_t>( next );
+                }
+
+                uint32_t& slot = head[Hash4(&data[pos])];
+                if ( InWindow(slot, pos) ) {
+                    const size_t length = MatchLength(&data[pos], &data[slot], maxLength);
+                    if ( length >= minLength ) matches.push_back({ length, pos - slot });
+                }
+                slot = static_cast<uint32_t>( pos );
+                next = pos + 1;
+            }
+
+        private:
+            std::vector<uint32_t> head;
+        };
+
+        class HashChainFinder : public FinderBase {
+        public:
+            HashChainFinder(std::span<const uint8_t> data, const MatchFinderParams& params)
+                : FinderBase(data, params, 3), head(size_t(1) << HASH3_BITS, NO_POSITION), chain(cyclicSize, NO_POSITION) {}
+
+            void Find(size_t pos, size_t maxLength, std::vector<Match>& matches) override {
+                matches.clear();
+                if ( pos + minLength > data.size() ) return;
+                for ( ; next < pos; ++next ) {
+                    if ( next + minLength <= data.size() ) Insert(next);
+                }
+
+                size_t best = minLength - 1;
+                const size_t nice = std::min(params.niceLength, maxLength);
+                uint32_t candidate = head[Hash3(&data[pos])];
+                for ( int probes = 0; probes < params.depth && InWindow(candidate, pos); ++probes ) {
+                    // 今の最長より長くなり得ない候補は末尾の1バイトで先に除外する
+                    if ( data[candidate + best] == data[pos + best] ) {
+                        const size_t length = MatchLength(&data[pos], &data[candidate], maxLength);
+                        if ( length > best ) {
+                            best = length;
+                            matches.push_back({ length, pos - candidate });
+                            if ( length >= nice ) break;
+                        }
+                    }
+                    candidate = chain[candidate & ( cyclicSize - 1 )];
+                }
+                Insert(pos);
+                next = pos + 1;
+            }
+
+        private:
+            void Insert(size_t pos) {
+                uint32_t& slot = head[Hash3(&data[pos])];
+                chain[pos & ( cyclicSize - 1 )] = slot;
+                slot = static_cast<uint32_t>( pos );
+            }
+
+            std::vector<uint32_t> head;
+            std::vector<uint32_t> chain;
+        };
+
+        // 同じハッシュを持つ位置を、その位置から始まる文字列の辞書順で並べた二分木 (LZMAのbt4と同じ構造)
+        // 新しい位置を根として挿入しながら、たどった経路上の一致を集める
+        // 木は4バイトハッシュで分けるので、3バイトの一致は直近の1候補だけを別のハッシュで探す
+        class BinaryTreeFinder : public FinderBase {
+        public:
+            BinaryTreeFinder(std::span<const uint8_t> data, const MatchFinderParams& params)
+                : FinderBase(data, params, 3), head3(size_t(1) << HASH3_BITS, NO_POSITION),
+                head(size_t(1) << HASH4_BITS, NO_POSITION), tree(cyclicSize * 2, NO_POSITION) {}
+
+            void Find(size_t pos, size_t maxLength, std::vector<Match>& matches) override {
+                matches.clear();
+                if ( pos + minLength > data.size() ) return;
+                // 木の形を保つため、読み飛ばした位置も一致を集めずに挿入する
+                for ( ; next < pos; ++next ) {
+                    if ( next + minLength <= data.size() ) Insert(next, data.size() - next, nullptr);
+                }
+                Insert(pos, maxLength, &matches);
+                next = pos + 1;
+            }
+
+        private:
+            void Insert(size_t pos, size_t maxLength, std::vector<Match>* matches) {
+                uint32_t& slot3 = head3[Hash3(&data[pos])];
+                const uint32_t candidate3 = slot3;
+                slot3 = static_cast<uint32_t>( pos );
+                size_t shortLength = 0;
+                if ( matches && InWindow(candidate3, pos) ) {
+                    shortLength = MatchLength(&data[pos], &data[candidate3], maxLength);
+                    if ( shortLength >= minLength ) matches->push_back({ shortLength, pos - candidate3 });
+                }
+                if ( pos + 4 > data.size() ) return;
+                InsertTree(pos, maxLength, matches, std::max(shortLength, minLength - 1));
+            }
+
+            void InsertTree(size_t pos, size_t maxLength, std::vector<Match>* matches, size_t best) {
+                const size_t limit = std::min(params.niceLength, maxLength);
+                uint32_t& slot = head[Hash4(&data[pos])];
+                uint32_t candidate = slot;
+                slot = static_cast<uint32_t>( pos );
+
+                uint32_t* smaller = &tree[( pos & ( cyclicSize - 1 ) ) * 2];
+                uint32_t* larger = smaller + 1;
+                size_t smallerLength = 0;
+                size_t largerLength = 0;
+
+                for ( int depth = params.depth; ; --depth ) {
+                    if ( depth == 0 || !InWindow(candidate, pos) ) {
+                        *smaller = NO_POSITION;
+                        *larger = NO_POSITION;
+                        return;
+                    }
+                    uint32_t* pair = &tree[( candidate & ( cyclicSize - 1 ) ) * 2];
+                    // 両側の部分木とは少なくとも min(smallerLength, largerLength) バイト一致している
+                    size_t length = std::min(smallerLength, largerLength);
+                    length += MatchLength(&data[pos + length], &data[candidate + length], limit - length);
+                    if ( length >= limit ) {
+                        // 十分に長い一致: 候補の子をそのまま引き継いで終える
+                        // 一致を集める場合だけ実際の長さまで伸ばす (登録だけの位置で伸ばすと長い連続で二乗の時間がかかる)
+                        if ( matches ) {
+                            length += MatchLength(&data[pos + length], &data[candidate + length], maxLength - length);
+                            if ( length > best ) matches->push_back({ length, pos - candidate });
+                        }
+                        *smaller = pair[0];
+                        *larger = pair[1];
+                        return;
+                    }
+                    if ( matches && length > best ) {
+                        best = length;
+                        matches->push_back({ length, pos - candidate });
+                    }
+                    if ( data[candidate + length] < data[pos + length] ) {
+                        *smaller = candidate;
+                        smaller = pair + 1;
+                        candidate = *smaller;
+                        smallerLength = length;
+                    }
+                    else {
+                        *larger = candidate;
+                        larger = pair;
+                        candidate = *larger;
+                        largerLength = length;
+                    }
+                }
+            }
+
+            std::vector<uint32_t> head3;
+            std::vector<uint32_t> head;
+            std::vector<uint32_t> tree;
+        };
+    }
+
+    std::unique_ptr<MatchFinder> MatchFinder::Create(std::span<const uint8_t> data, const MatchFinderParams& params) {
+        switch ( params.type ) {
+        case MatchFinderType::HASH4:
+            return std::make_unique<Hash4Finder>(data, params);
+        case MatchFinderType::HASH_CHAIN:
+            return std::make_unique<HashChainFinder>(data, params);
+        case MatchFinderType::BINARY_TREE:
+            return std::make_unique<BinaryTreeFinder>(data, params);
+        }
+        return nullptr;
+    }
+
+    size_t MatchFinder::MemoryPerByte(MatchFinderType type) {
+        switch ( type ) {
+        case MatchFinderType::HASH4: return 0;
+        case MatchFinderType::HASH_CHAIN: return sizeof(uint32_t);
+        case MatchFinderType::BINARY_TREE: return sizeof(uint32_t) * 2;
+        }
+        return 0;
+    }
+
+    size_t MatchFinder::MatchLength(const uint8_t* a, const uint8_t* b, size_t maxLength) {
+        size_t length = 0;
+        while ( length + 8 <= maxLength ) {
+            uint64_t x, y;
+            std::memcpy(&x, a + length, 8);
+            std::memcpy(&y, b + length, 8);
+            if ( x != y ) {
+                const uint64_t diff = x ^ y;
+                return length + ( std::endian::native == std::endian::little ? std::countr_zero(diff) : std::countl_zero(diff) ) / 8;
+            }
+            length += 8;
+        }
+        while ( length < maxLength && a[length] == b[length] ) length++;
+        return length;
+    }
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <vector>
+#include <span>
+#include <memory>
+#include <cstdint>
+
+namespace Cmp {
+    // pos から distance だけ前の位置と length バイト一致する
+    struct Match {
+        size_t length;
+        size_t distance;
+    };
+
+    enum class MatchFinderType : uint8_t {
+        HASH4,          // 4バイトハッシュごとに直前の1候補だけを見る (最速)
+        HASH_CHAIN,     // 3バイトハッシュのチェーンを depth 回までたどる
+        BINARY_TREE,    // 4バイトハッシュごとの二分探索木。深く探しても比較回数が少ない
+    };
+
+    struct MatchFinderParams {
+        MatchFinderType type = MatchFinderType::HASH_CHAIN;
+        size_t windowSize = size_t(1) << 20;    // 2のべき乗
+        int depth = 48;                         // チェーン・木をたどる最大回数
+        size_t niceLength = 128;                // この長さの一致が見つかったら探索を打ち切る
+    };
+
+    // 入力の先頭から順に位置を渡して一致を探す。位置は32ビットで持つので入力は4GB未満であること
+    class MatchFinder {
+    public:
+        virtual ~MatchFinder() = default;
+
+        // pos より前の未登録の位置を登録してから pos から始まる一致を探し、pos も登録する
+        // 一致は長さ・距離とも昇順に並ぶ。pos は呼び出しごとに増加していること
+        virtual void Find(size_t pos, size_t maxLength, std::vector<Match>& matches) = 0;
+
+        // 見つけられる最短の一致長
+        virtual size_t MinLength() const = 0;
+
+        static std::unique_ptr<MatchFinder> Create(std::span<const uint8_t> data, const MatchFinderParams& params);
+
+        // 入力1バイトあたりの探索用メモリ (ウィンドウが入力より大きい場合)
+        static size_t MemoryPerByte(MatchFinderType type);
+
+        // a と b の共通接頭辞の長さ (最大 maxLength)。8バイトずつ比較する
+        static size_t MatchLength(const uint8_t* a, const uint8_t* b, size_t maxLength);
+    };
+}
@@ -1,62 +1,139 @@
 #include "mtf.h"
-#include <list>
+#include <array>
+#include <cstring>
+#include <cstdint>
 #include <numeric>
 #include <algorithm>
 
 namespace Cmp {
-    std::vector<char> Mtf::Transform(const std::vector<char>& data) {
-        std::vector<char> transformedData;
-        transformedData.reserve(data.size());
-
-        // 0255܂ł̕Xg
-        std::list<char> alphabet;
-        for ( int i = 0; i < 256; ++i ) {
-            alphabet.push_back(static_cast<char>( i ));
-        }
+    void Mtf::Transform(std::span<const char> data, std::vector<char>& out) {
+        out.assign(data.begin(), data.end());
+        TransformInPlace(out);
+    }
 
-        for ( char c : data ) {
-            int index = 0;
-            auto it = alphabet.begin();
-            while ( it != alphabet.end() ) {
-                if ( *it == c ) {
-                    // 1. ݂̌̃CfbNXo
-                    transformedData.push_back(static_cast<char>( index ));
-
-                    // 2. ̕Xg̐擪Ɉړ
-                    alphabet.erase(it);
-                    alphabet.push_front(c);
-                    break;
+    void Mtf::InverseTransform(std::span<const char> data, std::vector<char>& out) {
+        out.assign(data.begin(), data.end());
+        InverseTransformInPlace(out);
+    }
+
+    namespace {
+        // 0から255までを並べた表 (256バイトなので常にキャッシュに載る)
+        struct Alphabet {
+            Alphabet() { std::iota(order.begin(), order.end(), 0); }
+
+            // c の現在の位置を返し、先頭に移動する (位置の検索は memchr に任せる)
+            uint8_t Encode(uint8_t c) {
+                if ( order[0] == c ) return 0;
+                const uint8_t* found = static_cast<const uint8_t*>( std::memchr(order.data(), c, order.size()) );
+                const size_t index = found - order.data();
+                std::memmove(order.data() + 1, order.data(), index);
+                order[0] = c;
+                return static_cast<uint8_t>( index );
+            }
+
+            // index の位置にある文字を返し、先頭に移動する
+            uint8_t Decode(uint8_t index) {
+                const uint8_t c = order[index];
+                if ( index != 0 ) {
+                    std::memmove(order.data() + 1, order.data(), index);
+                    order[0] = c;
                 }
-                it++;
-                index++;
+                return c;
+            }
+
+            std::array<uint8_t, 256> order;
+        };
+
+        // MTF+RLE0 の出力記号
+        // 0 の連続は長さ-1 を全単射2進数で RUN_A/RUN_B の並びにする (bzip2 と同じ)
+        // 1..253 は +1 した値、254/255 は ESCAPE に続けて 0/1 を出す
+        constexpr uint8_t RUN_A = 0;
+        constexpr uint8_t RUN_B = 1;
+        constexpr uint8_t ESCAPE = 255;
+
+        void PutZeroRun(std::vector<char>& out, size_t run) {
+            size_t z = run - 1;
+            while ( true ) {
+                out.push_back(static_cast<char>( ( z & 1 ) ? RUN_B : RUN_A ));
+                if ( z < 2 ) break;
+                z = ( z - 2 ) / 2;
             }
         }
-        return transformedData;
     }
 
-    std::vector<char> Mtf::InverseTransform(const std::vector<char>& data) {
-        std::vector<char> originalData;
-        originalData.reserve(data.size());
+    void Mtf::TransformInPlace(std::span<char> data) {
+        Alphabet alphabet;
+        for ( char& slot : data ) {
+            slot = static_cast<char>( alphabet.Encode(static_cast<uint8_t>( slot )) );
+        }
+    }
 
-        std::list<char> alphabet;
-        for ( int i = 0; i < 256; ++i ) {
-            alphabet.push_back(static_cast<char>( i ));
+    void Mtf::InverseTransformInPlace(std::span<char> data) {
+        Alphabet alphabet;
+        for ( char& slot : data ) {
+            slot = static_cast<char>( alphabet.Decode(static_cast<uint8_t>( slot )) );
         }
+    }
 
-        for ( char index_char : data ) {
-            int index = static_cast<unsigned char>( index_char );
+    void Mtf::TransformZeroRun(std::span<const char> data, std::vector<char>& out) {
+        out.clear();
+        out.reserve(data.size());
+        Alphabet alphabet;
+        size_t run = 0;
+        for ( char c : data ) {
+            const uint8_t index = alphabet.Encode(static_cast<uint8_t>( c ));
+            if ( index == 0 ) {
+                run++;
+                continue;
+            }
+            if ( run > 0 ) {
+                PutZeroRun(out, run);
+                run = 0;
+            }
+            if ( index < 254 ) {
+                out.push_back(static_cast<char>( index + 1 ));
+            }
+            else {
+                out.push_back(static_cast<char>( ESCAPE ));
+                out.push_back(static_cast<char>( index - 254 ));
+            }
+        }
+        if ( run > 0 ) PutZeroRun(out, run);
+    }
 
-            auto it = alphabet.begin();
-            std::advance(it, index);
+    bool Mtf::InverseTransformZeroRun(std::span<const char> data, std::vector<char>& out, size_t maxSize) {
+        out.clear();
+        Alphabet alphabet;
+        size_t run = 0;
+        size_t weight = 1;
+        // たまった 0 の連続を、先頭の文字の繰り返しとして出力する
+        auto flushRun = [ & ] () {
+            if ( run == 0 ) return true;
+            if ( run > maxSize - out.size() ) return false;
+            out.insert(out.end(), run, static_cast<char>( alphabet.Decode(0) ));
+            run = 0;
+            weight = 1;
+            return true;
+        };
 
-            // 1. CfbNXʒuɂ镶擾ďo
-            char c = *it;
-            originalData.push_back(c);
+        for ( size_t i = 0; i < data.size(); ++i ) {
+            const uint8_t symbol = static_cast<uint8_t>( data[i] );
+            if ( symbol == RUN_A || symbol == RUN_B ) {
+                run += ( symbol == RUN_A ) ? weight : weight * 2;
+                weight <<= 1;
+                if ( run > maxSize ) return false;
+                continue;
+            }
+            if ( !flushRun() ) return false;
 
-            // 2. ̕Xg̐擪Ɉړ
-            alphabet.erase(it);
-            alphabet.push_front(c);
+            uint8_t index = symbol - 1;
+            if ( symbol == ESCAPE ) {
+                if ( ++i >= data.size() || static_cast<uint8_t>( data[i] ) > 1 ) return false;
+                index = 254 + static_cast<uint8_t>( data[i] );
+            }
+            if ( out.size() >= maxSize ) return false;
+            out.push_back(static_cast<char>( alphabet.Decode(index) ));
         }
-        return originalData;
+        return flushRun();
     }
-}
\ No newline at end of file
+}
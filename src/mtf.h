@@ -1,10 +1,25 @@
 #pragma once
 #include <vector>
+#include <span>
 
 namespace Cmp {
     class Mtf {
     public:
-        static std::vector<char> Transform(const std::vector<char>& data);
-        static std::vector<char> InverseTransform(const std::vector<char>& data);
+        // 出力は out の中身を置き換える (out は入力と別のバッファであること)
+        static void Transform(std::span<const char> data, std::vector<char>& out);
+        static void InverseTransform(std::span<const char> data, std::vector<char>& out);
+
+        // バッファをその場で変換する版 (各バイトを対応する出力で置き換えるだけなので追加のバッファは不要)
+        static void TransformInPlace(std::span<char> data);
+        static void InverseTransformInPlace(std::span<char> data);
+
+        // MTFの結果の0の連続を全単射2進数で短くする (MTF+RLE0, BWTの後段用)
+        static void TransformZeroRun(std::span<const char> data, std::vector<char>& out);
+        // 出力が maxSize を超えるか記号が不正な場合は false を返す
+        static bool InverseTransformZeroRun(std::span<const char> data, std::vector<char>& out, size_t maxSize);
+
+        // 新しいバッファを返す版
+        static std::vector<char> Transform(std::span<const char> data) { std::vector<char> out; Transform(data, out); return out; }
+        static std::vector<char> InverseTransform(std::span<const char> data) { std::vector<char> out; InverseTransform(data, out); return out; }
     };
-}
\ No newline at end of file
+}
@@ -0,0 +1,350 @@
+#include "rans.h"
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+
+namespace Cmp {
+    // --- rANSパラメータ ---
+    namespace {
+        constexpr int SCALE_BITS = 12;
+        constexpr uint32_t TOTAL_FREQ = 1u << SCALE_BITS;
+        constexpr uint32_t RANS_L = 1u << 23;    // 状態の下限 (正規化後は [RANS_L, RANS_L << 8) )
+        constexpr int STREAMS = 4;               // インターリーブする状態の数
+        constexpr int CONTEXTS = 256;
+
+        // 正規化済みの頻度表
+        struct FreqTable {
+            std::array<uint16_t, 256> freq{};
+            std::array<uint16_t, 256> cum{};
+        };
+
+        // 復号用: スロット -> シンボルの逆引き表
+        struct DecodeTable {
+            FreqTable table;
+            std::array<uint8_t, TOTAL_FREQ> symbol{};
+        };
+
+        using Counts = std::array<uint32_t, 256>;
+
+        // データを STREAMS 個の区間に分け、各区間を別々の状態で符号化する。
+        // 区間 j は [j*q, (j+1)*q) で、最後の区間だけ末尾の余りも受け持つ。
+        // 各区間の先頭はコンテキスト0から始まるので、区間ごとに独立して復号できる。
+        inline unsigned char ContextAt(const unsigned char* data, size_t pos, size_t segmentStart, bool order1) {
+            if ( !order1 || pos == segmentStart ) return 0;
+            return data[pos - 1];
+        }
+
+        // 頻度の合計が TOTAL_FREQ になるよう正規化する (出現したシンボルは最低1)
+        void Normalize(const Counts& counts, FreqTable& table) {
+            uint64_t total = 0;
+            for ( uint32_t c : counts ) total += c;
+
+            std::array<uint32_t, 256> freq{};
+            uint32_t sum = 0;
+            int largest = 0;
+            for ( int s = 0; s < 256; ++s ) {
+                if ( counts[s] == 0 ) continue;
+                freq[s] = std::max<uint32_t>(1, static_cast<uint32_t>( static_cast<uint64_t>( counts[s] ) * TOTAL_FREQ / total ));
+                sum += freq[s];
+                if ( freq[s] > freq[largest] ) largest = s;
+            }
+
+            // 丸め誤差は最も頻度の高いシンボルで吸収する
+            if ( sum < TOTAL_FREQ ) {
+                freq[largest] += TOTAL_FREQ - sum;
+            }
+            while ( sum > TOTAL_FREQ ) {
+                int maxSymbol = 0;
+                for ( int s = 1; s < 256; ++s ) {
+                    if ( freq[s] > freq[maxSymbol] ) maxSymbol = s;
+                }
+                uint32_t take = std::min(sum - TOTAL_FREQ, freq[maxSymbol] - 1);
+                freq[maxSymbol] -= take;
+                sum -= take;
+            }
+
+            uint32_t cum = 0;
+            for ( int s = 0; s < 256; ++s ) {
+                table.freq[s] = static_cast<uint16_t>( freq[s] );
+                table.cum[s] = static_cast<uint16_t>( cum );
+                cum += freq[s];
+            }
+        }
+
+        // 生の頻度から符号長を見積もる (バイト単位, ヘッダ概算込み)
+        double EstimateCost(const Counts& counts) {
+            uint64_t total = 0;
+            int distinct = 0;
+            for ( uint32_t c : counts ) {
+                total += c;
+                if ( c > 0 ) distinct++;
+            }
+            if ( total == 0 ) return 0.0;
+            double bits = 0.0;
+            for ( uint32_t c : counts ) {
+                if ( c > 0 ) bits += c * std::log2(static_cast<double>( total ) / c);
+            }
+            return bits / 8.0 + 32 + distinct * 1.5;
+        }
+
+        void WriteUint32(std::vector<char>& out, uint32_t value) {
+            out.push_back(( value >> 24 ) & 0xFF);
+            out.push_back(( value >> 16 ) & 0xFF);
+            out.push_back(( value >> 8 ) & 0xFF);
+            out.push_back(value & 0xFF);
+        }
+
+        // 頻度表: [出現シンボルのビットマップ(32)] + 出現シンボルごとの頻度 (128未満は1バイト, それ以外は2バイト)
+        void SerializeTable(std::vector<char>& out, const FreqTable& table) {
+            for ( int i = 0; i < 256; i += 8 ) {
+                uint8_t bits = 0;
+                for ( int b = 0; b < 8; ++b ) {
+                    if ( table.freq[i + b] > 0 ) bits |= 1 << b;
+                }
+                out.push_back(static_cast<char>( bits ));
+            }
+            for ( int s = 0; s < 256; ++s ) {
+                uint16_t f = table.freq[s];
+                if ( f == 0 ) continue;
+                if ( f < 0x80 ) {
+                    out.push_back(static_cast<char>( f ));
+                }
+                else {
+                    out.push_back(static_cast<char>( 0x80 | ( f >> 8 ) ));
+                    out.push_back(static_cast<char>( f & 0xFF ));
+                }
+            }
+        }
+
+        // 範囲外の読み込みを検出するバイトリーダー
+        class ByteReader {
+        public:
+            ByteReader(std::span<const char> data, size_t pos) : data(data), pos(pos) {}
+            uint8_t Get() {
+                if ( pos >= data.size() ) {
+                    overrun = true;
+                    return 0;
+                }
+                return static_cast<uint8_t>( data[pos++] );
+            }
+            uint32_t GetUint32() {
+                uint32_t value = 0;
+                for ( int i = 0; i < 4; ++i ) value = ( value << 8 ) | Get();
+                return value;
+            }
+            bool Overrun() const { return overrun; }
+            size_t Position() const { return pos; }
+        private:
+            std::span<const char> data;
+            size_t pos;
+            bool overrun = false;
+        };
+
+        bool DeserializeTable(ByteReader& reader, DecodeTable& decode) {
+            std::array<uint8_t, 32> bitmap;
+            for ( auto& bits : bitmap ) bits = reader.Get();
+
+            uint32_t cum = 0;
+            for ( int s = 0; s < 256; ++s ) {
+                uint32_t f = 0;
+                if ( ( bitmap[s >> 3] >> ( s & 7 ) ) & 1 ) {
+                    f = reader.Get();
+                    if ( f & 0x80 ) f = ( ( f & 0x7F ) << 8 ) | reader.Get();
+                    if ( f == 0 || cum + f > TOTAL_FREQ ) return false;
+                    std::fill(decode.symbol.begin() + cum, decode.symbol.begin() + cum + f, static_cast<uint8_t>( s ));
+                }
+                decode.table.freq[s] = static_cast<uint16_t>( f );
+                decode.table.cum[s] = static_cast<uint16_t>( cum );
+                cum += f;
+            }
+            return cum == TOTAL_FREQ && !reader.Overrun();
+        }
+    }
+
+    // 形式: [元サイズ(4)] [オーダー(1)] [頻度表] [状態 x4 (各4)] [rANSバイト列]
+    // オーダー1の頻度表は [使用コンテキストのビットマップ(32)] に続いて使用コンテキスト分並ぶ
+    void Rans::Compress(std::span<const char> input, std::vector<char>& output) {
+        output.clear();
+        if ( input.empty() ) return;
+
+        const unsigned char* data = reinterpret_cast<const unsigned char*>( input.data() );
+        const size_t n = input.size();
+        const size_t q = n / STREAMS;
+
+        // 1. オーダー0/1の頻度を数え、見積もりの小さい方を選ぶ
+        std::vector<Counts> counts1(CONTEXTS, Counts{});
+        Counts counts0{};
+        for ( int j = 0; j < STREAMS; ++j ) {
+            const size_t start = j * q;
+            const size_t end = ( j == STREAMS - 1 ) ? n : start + q;
+            for ( size_t p = start; p < end; ++p ) {
+                counts1[ContextAt(data, p, start, true)][data[p]]++;
+                counts0[data[p]]++;
+            }
+        }
+        double cost0 = EstimateCost(counts0);
+        double cost1 = 32;
+        for ( const auto& c : counts1 ) cost1 += EstimateCost(c);
+        const bool order1 = cost1 < cost0;
+
+        std::vector<FreqTable> tables(order1 ? CONTEXTS : 1);
+        std::vector<bool> used(tables.size(), false);
+        if ( order1 ) {
+            for ( int ctx = 0; ctx < CONTEXTS; ++ctx ) {
+                for ( uint32_t c : counts1[ctx] ) {
+                    if ( c > 0 ) {
+                        used[ctx] = true;
+                        break;
+                    }
+                }
+                if ( used[ctx] ) Normalize(counts1[ctx], tables[ctx]);
+            }
+        }
+        else {
+            used[0] = true;
+            Normalize(counts0, tables[0]);
+        }
+
+        // 2. ヘッダを書き込む
+        WriteUint32(output, static_cast<uint32_t>( n ));
+        output.push_back(order1 ? 1 : 0);
+        if ( order1 ) {
+            for ( int i = 0; i < CONTEXTS; i += 8 ) {
+                uint8_t bits = 0;
+                for ( int b = 0; b < 8; ++b ) {
+                    if ( used[i + b] ) bits |= 1 << b;
+                }
+                output.push_back(static_cast<char>( bits ));
+            }
+        }
+        for ( size_t ctx = 0; ctx < tables.size(); ++ctx ) {
+            if ( used[ctx] ) SerializeTable(output, tables[ctx]);
+        }
+
+        // 3. 復号と逆順にシンボルを符号化する (出力は後ろから前へ書き込む)
+        std::vector<uint8_t> buffer(n * 2 + STREAMS * 4 + 16);
+        uint8_t* const bufferEnd = buffer.data() + buffer.size();
+        uint8_t* ptr = bufferEnd;
+        std::array<uint32_t, STREAMS> states;
+        states.fill(RANS_L);
+
+        auto encode = [ & ] (int j, size_t pos, size_t segmentStart) {
+            const FreqTable& table = tables[order1 ? ContextAt(data, pos, segmentStart, true) : 0];
+            const unsigned char symbol = data[pos];
+            const uint32_t freq = table.freq[symbol];
+            uint32_t x = states[j];
+            const uint32_t xMax = ( ( RANS_L >> SCALE_BITS ) << 8 ) * freq;
+            while ( x >= xMax ) {
+                *--ptr = static_cast<uint8_t>( x & 0xFF );
+                x >>= 8;
+            }
+            states[j] = ( ( x / freq ) << SCALE_BITS ) + ( x % freq ) + table.cum[symbol];
+        };
+
+        const size_t lastStart = ( STREAMS - 1 ) * q;
+        for ( size_t p = n; p-- > STREAMS * q; ) {
+            encode(STREAMS - 1, p, lastStart);
+        }
+        for ( size_t i = q; i-- > 0; ) {
+            for ( int j = STREAMS - 1; j >= 0; --j ) {
+                encode(j, j * q + i, j * q);
+            }
+        }
+
+        // 4. 最終状態を書き込む (復号側は状態0から順に読む)
+        for ( int j = STREAMS - 1; j >= 0; --j ) {
+            ptr -= 4;
+            ptr[0] = static_cast<uint8_t>( states[j] >> 24 );
+            ptr[1] = static_cast<uint8_t>( states[j] >> 16 );
+            ptr[2] = static_cast<uint8_t>( states[j] >> 8 );
+            ptr[3] = static_cast<uint8_t>( states[j] );
+        }
+
+        output.insert(output.end(), reinterpret_cast<const char*>( ptr ), reinterpret_cast<const char*>( bufferEnd ));
+    }
+
+    void Rans::Decompress(std::span<const char> input, std::vector<char>& output, size_t maxSize) {
+        output.clear();
+        if ( input.size() < 5 ) return;
+
+        ByteReader reader(input, 0);
+        const uint32_t n = reader.GetUint32();
+        const bool order1 = reader.Get() != 0;
+        // 確率1のシンボルは0ビットで符号化されるので、ペイロードの大きさからは元サイズの上限が決まらない
+        if ( n == 0 || n > maxSize ) return;
+
+        // 1. 頻度表を復元する (使用されているコンテキストの分だけ逆引き表を確保する)
+        std::array<const DecodeTable*, CONTEXTS> contextTables{};
+        std::vector<bool> used(CONTEXTS, false);
+        if ( order1 ) {
+            for ( int i = 0; i < CONTEXTS; i += 8 ) {
+                uint8_t bits = reader.Get();
+                for ( int b = 0; b < 8; ++b ) used[i + b] = ( bits >> b ) & 1;
+            }
+        }
+        else {
+            used[0] = true;
+        }
+        std::vector<DecodeTable> tables(std::count(used.begin(), used.end(), true));
+        for ( int ctx = 0, t = 0; ctx < CONTEXTS; ++ctx ) {
+            if ( !used[ctx] ) continue;
+            if ( !DeserializeTable(reader, tables[t]) ) return;
+            contextTables[ctx] = &tables[t++];
+        }
+
+        std::array<uint32_t, STREAMS> states;
+        for ( auto& x : states ) x = reader.GetUint32();
+        if ( reader.Overrun() ) return;
+
+        // 2. 各状態で順にシンボルを復号する
+        output.resize(n);
+        unsigned char* out = reinterpret_cast<unsigned char*>( output.data() );
+        const uint8_t* in = reinterpret_cast<const uint8_t*>( input.data() ) + reader.Position();
+        const uint8_t* const inEnd = reinterpret_cast<const uint8_t*>( input.data() ) + input.size();
+        const size_t q = n / STREAMS;
+        bool corrupt = false;
+
+        // オーダー0では全てのコンテキストが同じ表を指すようにして、ループ内の分岐を減らす
+        if ( !order1 ) contextTables.fill(&tables[0]);
+
+        // 各状態の直前のシンボル (区間の先頭はコンテキスト0)
+        std::array<unsigned char, STREAMS> contexts{};
+        auto decode = [ & ] (int j, size_t pos) {
+            const DecodeTable* table = contextTables[contexts[j]];
+            if ( !table ) {
+                corrupt = true;
+                return;
+            }
+            uint32_t x = states[j];
+            const uint32_t slot = x & ( TOTAL_FREQ - 1 );
+            const unsigned char symbol = table->symbol[slot];
+            out[pos] = symbol;
+            contexts[j] = symbol;
+            x = table->table.freq[symbol] * ( x >> SCALE_BITS ) + slot - table->table.cum[symbol];
+            while ( x < RANS_L ) {
+                if ( in >= inEnd ) {
+                    corrupt = true;
+                    break;
+                }
+                x = ( x << 8 ) | *in++;
+            }
+            states[j] = x;
+        };
+
+        for ( size_t i = 0; i < q && !corrupt; ++i ) {
+            for ( int j = 0; j < STREAMS; ++j ) {
+                decode(j, j * q + i);
+            }
+        }
+        for ( size_t p = STREAMS * q; p < n && !corrupt; ++p ) {
+            decode(STREAMS - 1, p);
+        }
+
+        // 全ての状態が初期値に戻っていれば正しく復号できている
+        for ( uint32_t x : states ) {
+            if ( x != RANS_L ) corrupt = true;
+        }
+        if ( corrupt ) output.clear();
+    }
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include <vector>
+#include <span>
+#include <cstdint>
+
+namespace Cmp {
+    // 4状態インターリーブのrANS (バイト単位の正規化) による静的エントロピー符号化
+    // 頻度表は12ビットに正規化してヘッダに持ち、データに応じてオーダー0/1を選ぶ
+    class Rans {
+    public:
+        // 出力は output の中身を置き換える (output は入力と別のバッファであること)
+        static void Compress(std::span<const char> data, std::vector<char>& output);
+        // 元サイズのヘッダが maxSize を超える場合は、壊れたデータとして確保する前に output を空にする
+        static void Decompress(std::span<const char> data, std::vector<char>& output, size_t maxSize = SIZE_MAX);
+
+        // 新しいバッファを返す版
+        static std::vector<char> Compress(std::span<const char> data) { std::vector<char> out; Compress(data, out); return out; }
+        static std::vector<char> Decompress(std::span<const char> data) { std::vector<char> out; Decompress(data, out); return out; }
+    };
+}
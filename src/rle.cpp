@@ -1,15 +1,15 @@
 #include "rle.h"
 
 namespace Cmp {
-    // RLE̓}[J[ƍő僉
+    // RLEの特殊マーカーと最大ラン長
     namespace {
         constexpr char RLE_MARKER = (char)0xFE;
         constexpr int MAX_RUN_LENGTH = 255;
     }
 
-    std::vector<char> Rle::Compress(const std::vector<char>& data) {
-        std::vector<char> compressedData;
-        if ( data.empty() ) return compressedData;
+    void Rle::Compress(std::span<const char> data, std::vector<char>& compressedData) {
+        compressedData.clear();
+        if ( data.empty() ) return;
 
         for ( size_t i = 0; i < data.size(); ++i ) {
             char currentChar = data[i];
@@ -30,13 +30,13 @@ namespace Cmp {
                 }
             }
         }
-        return compressedData;
     }
 
-    std::vector<char> Rle::Decompress(const std::vector<char>& data) {
-        std::vector<char> decompressedData;
+    void Rle::Decompress(std::span<const char> data, std::vector<char>& decompressedData) {
+        decompressedData.clear();
         for ( size_t i = 0; i < data.size(); ++i ) {
             if ( data[i] == RLE_MARKER ) {
+                if ( i + 2 >= data.size() ) break; // 途中で切れたランは捨てる
                 uint8_t runLength = static_cast<uint8_t>( data[i + 1] );
                 char D = data[i + 2];
                 for ( int j = 0; j < runLength; ++j ) {
@@ -48,6 +48,5 @@ namespace Cmp {
                 decompressedData.push_back(data[i]);
             }
         }
-        return decompressedData;
     }
 }
\ No newline at end of file
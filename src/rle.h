@@ -1,10 +1,16 @@
 #pragma once
 #include <vector>
+#include <span>
 
 namespace Cmp {
     class Rle {
     public:
-        static std::vector<char> Compress(const std::vector<char>& data);
-        static std::vector<char> Decompress(const std::vector<char>& data);
+        // 出力は out の中身を置き換える (out は入力と別のバッファであること)
+        static void Compress(std::span<const char> data, std::vector<char>& out);
+        static void Decompress(std::span<const char> data, std::vector<char>& out);
+
+        // 新しいバッファを返す版
+        static std::vector<char> Compress(std::span<const char> data) { std::vector<char> out; Compress(data, out); return out; }
+        static std::vector<char> Decompress(std::span<const char> data) { std::vector<char> out; Decompress(data, out); return out; }
     };
 }
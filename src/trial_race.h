@@ -0,0 +1,59 @@
+#pragma once
+#include <vector>
+#include <span>
+#include <atomic>
+#include <functional>
+#include <cstdint>
+#include "Parallel.h"
+
+namespace Cmp {
+    // 複数の候補パイプラインで同じ入力を並列に試し、出力が最小のものを選ぶ
+    // 入力を pieceSize ごとに区切って圧縮し、区間ごとに出力サイズの合計を確かめる。
+    // 合計が既に終わった候補の最小サイズ以上になった候補はそこで打ち切る
+    class TrialRace {
+    public:
+        // input を圧縮して output の中身を置き換える。候補ごとに別のスレッドから呼ばれる
+        using Encoder = std::function<void(std::span<const char> input, std::vector<char>& output)>;
+
+        static constexpr size_t CANCELLED = SIZE_MAX;
+
+        // 最小の候補の番号を返す (候補が無ければ SIZE_MAX)。sizes[i] は候補 i の出力サイズの合計か CANCELLED
+        // 入力が1区間に収まる場合は、選ばれた候補の出力を winnerOutput に返す (それ以外は空)
+        static size_t Run(std::span<const Encoder> encoders, std::span<const char> input, size_t pieceSize, unsigned threads,
+            std::vector<size_t>& sizes, std::vector<char>& winnerOutput) {
+            sizes.assign(encoders.size(), CANCELLED);
+            winnerOutput.clear();
+            if ( encoders.empty() ) return SIZE_MAX;
+
+            const bool singlePiece = input.size() <= pieceSize;
+            std::vector<std::vector<char>> outputs(singlePiece ? encoders.size() : 0);
+            std::atomic<size_t> best{ CANCELLED };
+            ParallelFor(encoders.size(), threads, [ & ] (size_t i) {
+                // 最小の候補は途中の合計が best を超えることがないので、打ち切られるのは勝てない候補だけ
+                // 同じサイズの候補は打ち切らず、最後に番号で選ぶ
+                std::vector<char> output;
+                size_t total = 0;
+                size_t offset = 0;
+                do {
+                    if ( total > best.load(std::memory_order_relaxed) ) return;
+                    encoders[i](input.subspan(offset, std::min(pieceSize, input.size() - offset)), output);
+                    total += output.size();
+                    offset += pieceSize;
+                } while ( offset < input.size() );
+                if ( total > best.load(std::memory_order_relaxed) ) return;
+                sizes[i] = total;
+                size_t current = best.load(std::memory_order_relaxed);
+                while ( total < current && !best.compare_exchange_weak(current, total, std::memory_order_relaxed) ) {}
+                if ( singlePiece ) outputs[i].swap(output);
+            });
+
+            // 同じサイズなら番号の小さい候補を選ぶ (スレッドの実行順によって結果が変わらないように)
+            size_t winner = SIZE_MAX;
+            for ( size_t i = 0; i < sizes.size(); ++i ) {
+                if ( sizes[i] != CANCELLED && ( winner == SIZE_MAX || sizes[i] < sizes[winner] ) ) winner = i;
+            }
+            if ( winner != SIZE_MAX && singlePiece ) winnerOutput.swap(outputs[winner]);
+            return winner;
+        }
+    };
+}
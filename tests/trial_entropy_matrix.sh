@@ -0,0 +1,22 @@
+#!/bin/sh
+# 全ての --trial の候補と --entropy の符号化器の組み合わせで、メモリ上の圧縮・解凍が一致するか確かめる
+# usage: trial_entropy_matrix.sh <compressor> <source_folder>
+if [ $# -ne 2 ]; then
+    echo "usage: $0 <compressor> <source_folder>" >&2
+    exit 2
+fi
+compressor=$1
+source=$2
+
+failed=0
+for trial in store rle lz delta bwt all; do
+    for entropy in static adaptive rans huffman; do
+        if "$compressor" -v "$source" --trial "$trial" --entropy "$entropy" -j 1 > /dev/null 2>&1; then
+            echo "ok   --trial $trial --entropy $entropy"
+        else
+            echo "FAIL --trial $trial --entropy $entropy (exit $?)"
+            failed=1
+        fi
+    done
+done
+exit $failed